@@ -1,4 +1,8 @@
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <string>
+#include <thread>
 #include "camera_manager.hpp"
 #include "camera_platform.hpp"
 #include "log.hpp"
@@ -48,6 +52,15 @@ void enumerate()
   }
 }
 
+void dump_composites()
+{
+  CameraManager mgr;
+  for (const auto& composite : mgr.EnumerateComposites())
+  {
+    std::cout << composite;
+  }
+}
+
 void dump_controls()
 {
   CameraManager mgr;
@@ -179,6 +192,32 @@ void test()
   }
 }
 
+void stats(int seconds)
+{
+  CameraManager mgr;
+  auto infoList = mgr.Enumerate();
+  if (infoList.size() == 0) return;
+
+  auto camera = mgr.Create(infoList[0]);
+  auto info   = camera->GetCameraInfo();
+  if (info.formats.size() == 0)
+  {
+    return;
+  }
+
+  camera->SetFormat(*info.formats.begin());
+  std::cout << info.name << " " << *info.formats.begin() << std::endl;
+
+  // Print the counters once a second while streaming
+  camera->Start();
+  for (int i = 0; i < seconds; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    std::cout << "[" << (i + 1) << "s]" << std::endl << camera->GetStats();
+  }
+  camera->Stop();
+}
+
 int main(int argc, char** argv)
 {
   // For this app, logging is kinda redundant
@@ -187,7 +226,8 @@ int main(int argc, char** argv)
 
   if (argc == 1)
   {
-    std::cout << "Usage: zebra_camera_util [enum|res|4ccs|supported|allmodes|controls]"
+    std::cout << "Usage: zebra_camera_util "
+                 "[enum|res|4ccs|supported|allmodes|controls|composites|stats [seconds]]"
               << std::endl;
   }
   for (int i = 1; i < argc; ++i)
@@ -220,6 +260,19 @@ int main(int argc, char** argv)
     {
       dump_controls();
     }
+    else if (std::strcmp(argv[i], "composites") == 0)
+    {
+      dump_composites();
+    }
+    else if (std::strcmp(argv[i], "stats") == 0)
+    {
+      int seconds = 10;
+      if ((i + 1 < argc) && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+      {
+        seconds = std::atoi(argv[++i]);
+      }
+      stats(seconds);
+    }
   }
   return 0;
 }
@@ -0,0 +1,400 @@
+/// \file async.hpp
+/// Coroutine support - a single-threaded event loop, tasks, and awaitable operations
+#ifndef LIGHTBOX_CAMERA_ASYNC_HPP_
+#define LIGHTBOX_CAMERA_ASYNC_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+#include "executor.hpp"
+
+namespace zebral
+{
+template <class T = void>
+class Task;
+
+/// Single-threaded event loop for coroutines.
+///
+/// Coroutines are started with Spawn() and run on the thread that calls Run().  When they
+/// co_await a camera frame, parameter change or serial line, they're suspended without
+/// holding a thread, and resumed on the loop when it arrives (or on timeout/cancellation).
+/// One loop can service any number of cameras.
+///
+/// Also an Executor, so it can run a camera's frame callbacks.
+///
+/// Destroying the loop destroys any coroutines still suspended on it - their pending
+/// operations unregister themselves, and their frames and locals are released.
+class EventLoop : public Executor
+{
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Identifies a timer queued with PostAt(), so it can be cancelled
+  struct TimerId
+  {
+    Clock::time_point when;  ///< Time it's due
+    uint64_t id;             ///< Unique among the loop's timers
+  };
+
+  EventLoop();
+
+  /// Dtor - destroys coroutines that haven't finished.  Don't destroy a running loop.
+  ~EventLoop() override;
+
+  /// Queues a function to run on the loop. Thread-safe.
+  /// \param task - function to run
+  void Post(std::function<void()> task) override;
+
+  /// Queues a function to run on the loop at a given time. Thread-safe.
+  /// \param when - time to run it
+  /// \param task - function to run
+  /// \returns TimerId - pass to CancelTimer() to drop it before it runs
+  TimerId PostAt(Clock::time_point when, std::function<void()> task);
+
+  /// Drops a timer that hasn't run yet. Thread-safe, and does nothing if it already ran.
+  /// \param timer - timer from PostAt()
+  void CancelTimer(const TimerId& timer);
+
+  /// Starts a coroutine on the loop. Thread-safe.
+  /// \param task - coroutine to run.  Exceptions it throws are logged.
+  void Spawn(Task<void> task);
+
+  /// Runs the loop on this thread until Stop() is called.
+  void Run();
+
+  /// Runs the loop on this thread until all spawned coroutines finish or Stop() is called.
+  void RunUntilComplete();
+
+  /// Makes Run() return once the current function finishes. Thread-safe.
+  void Stop();
+
+ protected:
+  struct Detached;
+
+  /// Runs a spawned task to completion
+  /// \param id - key of the task in spawned_
+  static Detached Drive(EventLoop* loop, Task<void> task, uint64_t id);
+
+  /// Runs the loop
+  /// \param until_complete - return once no spawned tasks are left
+  void RunLoop(bool until_complete);
+
+  /// Called when a spawned task finishes
+  /// \param id - key of the task in spawned_
+  void OnTaskDone(uint64_t id);
+
+  /// Timers by due time, then id
+  using TimerQueue = std::map<std::pair<Clock::time_point, uint64_t>, std::function<void()>>;
+
+  std::mutex mutex_;                                     ///< Protects the queues
+  std::condition_variable cv_;                           ///< Signalled on Post()
+  std::deque<std::function<void()>> tasks_;              ///< Ready to run
+  TimerQueue timers_;                                    ///< Run at a time
+  uint64_t next_timer_;                                  ///< Id of the next timer
+  std::map<uint64_t, std::coroutine_handle<>> spawned_;  ///< Spawned tasks, not done
+  uint64_t next_task_;                                   ///< Id of the next spawned task
+  bool stopping_;                                        ///< Stop() was called
+};
+
+namespace detail
+{
+/// Promise parts shared by all Task types
+struct TaskPromiseBase
+{
+  /// Resumes whoever awaited the task when it finishes
+  struct FinalAwaiter
+  {
+    bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    template <class Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+      auto continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept
+  {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() noexcept
+  {
+    return {};
+  }
+
+  void unhandled_exception()
+  {
+    error = std::current_exception();
+  }
+
+  std::coroutine_handle<> continuation;  ///< Coroutine awaiting this one
+  std::exception_ptr error;              ///< Exception thrown by the task
+};
+
+/// Promise for a Task returning a value
+template <class T>
+struct TaskPromise : TaskPromiseBase
+{
+  Task<T> get_return_object();
+
+  void return_value(T result)
+  {
+    value = std::move(result);
+  }
+
+  T result()
+  {
+    if (error) std::rethrow_exception(error);
+    return std::move(*value);
+  }
+
+  std::optional<T> value;  ///< Returned value
+};
+
+/// Promise for a Task returning nothing
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+  Task<void> get_return_object();
+
+  void return_void() {}
+
+  void result()
+  {
+    if (error) std::rethrow_exception(error);
+  }
+};
+}  // namespace detail
+
+/// Coroutine returning T.
+/// Starts when it's co_awaited (or passed to EventLoop::Spawn()), and resumes the awaiting
+/// coroutine when it finishes.
+template <class T>
+class Task
+{
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  ~Task()
+  {
+    if (handle_) handle_.destroy();
+  }
+
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+  {
+    handle_.promise().continuation = continuation;
+    return handle_;
+  }
+
+  T await_resume()
+  {
+    return handle_.promise().result();
+  }
+
+ protected:
+  friend promise_type;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;  ///< Coroutine
+};
+
+template <class T>
+Task<T> detail::TaskPromise<T>::get_return_object()
+{
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object()
+{
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template <class T>
+class AsyncOp;
+
+/// Shared state of an awaitable operation.
+///
+/// Whatever produces the result (a capture thread, a param callback, a serial reader) calls
+/// Complete() from any thread; so do the timeout and cancellation.  The first one wins, and
+/// the awaiting coroutine is resumed on its event loop.
+template <class T>
+class AsyncState : public std::enable_shared_from_this<AsyncState<T>>
+{
+ public:
+  /// Ctor
+  /// \param loop - loop to resume the coroutine on
+  explicit AsyncState(EventLoop& loop) : loop_(loop), done_(false), value_{}, resumed_(false)
+  {
+  }
+
+  /// Completes the operation. Thread-safe, and only the first call has any effect.
+  /// \param value - result
+  /// \returns true if this call completed it
+  bool Complete(T value)
+  {
+    if (done_.exchange(true)) return false;
+    value_ = std::move(value);
+    loop_.Post([self = this->shared_from_this()] { self->Resume(); });
+    return true;
+  }
+
+  /// True once completed
+  bool done() const
+  {
+    return done_;
+  }
+
+  /// Sets a function to run on the loop after completion, before the coroutine resumes.
+  /// Use it to unregister from whatever was going to complete the operation.
+  void SetCleanup(std::function<void()> cleanup)
+  {
+    cleanup_ = std::move(cleanup);
+  }
+
+ protected:
+  friend class AsyncOp<T>;
+
+  /// Runs cleanup and resumes the coroutine (on the loop)
+  void Resume()
+  {
+    resumed_ = true;
+    Release();
+    handle_.resume();
+  }
+
+  /// Drops the timeout, cancellation and cleanup, so nothing refers to the coroutine
+  void Release()
+  {
+    stop_callback_.reset();
+    if (timer_) loop_.CancelTimer(*timer_);
+    timer_.reset();
+    if (cleanup_) cleanup_();
+    cleanup_ = nullptr;
+  }
+
+  EventLoop& loop_;                 ///< Loop to resume on
+  std::atomic<bool> done_;          ///< Set by the first Complete()
+  T value_;                         ///< Result
+  std::coroutine_handle<> handle_;  ///< Awaiting coroutine
+  std::function<void()> cleanup_;   ///< Run before resuming
+  bool resumed_;                    ///< Resume() has run
+
+  /// Timeout timer, cancelled on resume so it doesn't linger in the loop
+  std::optional<EventLoop::TimerId> timer_;
+
+  /// Completes the operation on cancellation
+  std::optional<std::stop_callback<std::function<void()>>> stop_callback_;
+};
+
+/// Awaitable operation. co_await it for a T, which is default-constructed (e.g. an empty
+/// FrameHandle or false) on timeout or cancellation.
+template <class T>
+class AsyncOp
+{
+ public:
+  /// Registers the state with whatever will complete it
+  using StartFn = std::function<void(const std::shared_ptr<AsyncState<T>>& state)>;
+
+  /// Ctor
+  /// \param loop - loop the awaiting coroutine runs on
+  /// \param start - called when awaited, to register the state
+  /// \param timeout - completes with T{} after this long, 0 for no timeout
+  /// \param stop - completes with T{} when stop is requested
+  AsyncOp(EventLoop& loop, StartFn start, std::chrono::milliseconds timeout,
+          std::stop_token stop = {})
+      : state_(std::make_shared<AsyncState<T>>(loop)),
+        start_(std::move(start)),
+        timeout_(timeout),
+        stop_(std::move(stop))
+  {
+  }
+
+  /// Dtor - if the awaiting coroutine is destroyed while suspended, unregisters the
+  /// operation so it's never completed
+  ~AsyncOp()
+  {
+    if (state_ && state_->handle_ && !state_->resumed_)
+    {
+      state_->done_ = true;
+      state_->Release();
+    }
+  }
+
+  AsyncOp(AsyncOp&&)            = default;
+  AsyncOp& operator=(AsyncOp&&) = delete;
+
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> handle)
+  {
+    state_->handle_ = handle;
+
+    // Timeout and cancellation don't keep the operation alive once it's resumed.
+    std::weak_ptr<AsyncState<T>> weak = state_;
+    auto expire                        = [weak] {
+      if (auto state = weak.lock()) state->Complete(T{});
+    };
+    if (timeout_.count() > 0)
+    {
+      state_->timer_ = state_->loop_.PostAt(EventLoop::Clock::now() + timeout_, expire);
+    }
+    if (stop_.stop_possible())
+    {
+      state_->stop_callback_.emplace(stop_, expire);
+    }
+    start_(state_);
+  }
+
+  T await_resume()
+  {
+    return std::move(state_->value_);
+  }
+
+ protected:
+  std::shared_ptr<AsyncState<T>> state_;  ///< Shared with whatever completes it
+  StartFn start_;                         ///< Registers the state
+  std::chrono::milliseconds timeout_;     ///< Timeout, 0 for none
+  std::stop_token stop_;                  ///< Cancellation
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_ASYNC_HPP_
@@ -1,15 +1,20 @@
 /// \file buffer_memmap.hpp
-/// Utility class for keeping track of V4L2 memory-mapped buffers
+/// Utility class for keeping track of V4L2 memory-mapped and user pointer buffers
 #ifndef LIGHTBOX_CAMERA_BUFFER_MEMMAP_HPP_
 #define LIGHTBOX_CAMERA_BUFFER_MEMMAP_HPP_
 
+#include <sys/time.h>
 #include <memory>
+#include <mutex>
 #include <vector>
+#include "buffer_types.hpp"
 #include "device_v4l2.hpp"
+#include "frame_allocator.hpp"
 
 namespace zebral
 {
-/// This class handles a V4L2 capture buffer for us.
+/// This class handles a V4L2 capture buffer for us - either the driver's, mapped into our
+/// memory (V4L2_MEMORY_MMAP), or ours, that the driver captures into (V4L2_MEMORY_USERPTR).
 /// BufferGroup will contain all the buffers for a device.
 class BufferMemmap
 {
@@ -22,6 +27,16 @@ class BufferMemmap
   /// \param idx - buffer index for the device
   BufferMemmap(DeviceV4L2Ptr& device, int idx);
 
+  /// Initializer for a user pointer buffer
+  /// \param device - device handle for buffer
+  /// \param idx - buffer index for the device
+  /// \param data - memory for the driver to capture into, or null to allocate it
+  /// \param length - bytes at data, or to allocate
+  /// \param allocator - if data is null, the allocation is charged to its FrameAccount.
+  ///                    The memory itself is mapped pages, as drivers need page alignment.
+  BufferMemmap(DeviceV4L2Ptr& device, int idx, void* data, size_t length,
+               const FrameAllocator<uint8_t>& allocator);
+
   /// Dtor - unmaps memory
   ~BufferMemmap();
 
@@ -42,24 +57,68 @@ class BufferMemmap
     return length_;
   }
 
+  /// Bytes the driver filled in the last frame dequeued
+  size_t BytesUsed() const
+  {
+    return bytes_used_;
+  }
+
   /// Queues the buffer up for the devices
   void Queue();
 
-  /// Returns true if a buffer is dequeued with data
-  /// \returns true on success, false if we don't have a buffer.
-  bool Dequeue();
+  /// Exports the buffer as a dmabuf (VIDIOC_EXPBUF), the first time it's called.
+  /// The fd is closed with the buffer; other processes can keep duplicates of it.
+  /// \returns int - dmabuf file descriptor
+  int Export();
+
+  /// dmabuf file descriptor from Export(), -1 if not exported
+  int DmabufFd() const
+  {
+    return dmabuf_fd_;
+  }
+
+  /// Buffer index for the device
+  int Index() const
+  {
+    return index_;
+  }
 
+  /// Driver's timestamp for the last frame dequeued
   timeval GetTimestamp()
   {
     return timestamp_;
   }
 
+  /// Driver's sequence number for the last frame dequeued
+  uint32_t GetSequence() const
+  {
+    return sequence_;
+  }
+
+  /// True if the driver stamped the buffer with CLOCK_MONOTONIC (rather than copying a
+  /// timestamp from elsewhere, or not saying)
+  bool HasMonotonicTimestamp() const
+  {
+    return (flags_ & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+  }
+
  protected:
+  friend class BufferGroup;
+
   DeviceV4L2Ptr device_;  ///< Device handle
   int index_;             ///< Buffer index
+  uint32_t memory_;       ///< V4L2_MEMORY_MMAP or V4L2_MEMORY_USERPTR
   size_t length_;         ///< Length of buffer in bytes
   void* data_;            ///< Ptr to buffer
   timeval timestamp_;     ///< hardware timestamp
+  uint32_t flags_;        ///< v4l2_buffer flags from the last dequeue
+  uint32_t sequence_;     ///< v4l2_buffer sequence from the last dequeue
+  size_t bytes_used_;     ///< v4l2_buffer bytesused from the last dequeue
+  int dmabuf_fd_;         ///< Exported dmabuf, -1 if none
+
+  void* storage_;                          ///< Pages we mapped for a user pointer buffer
+  size_t storage_size_;                    ///< Bytes mapped at storage_
+  std::shared_ptr<FrameAccount> account_;  ///< Account storage_ is charged to, may be null
 };
 
 /// This class handles all the buffers for
@@ -69,21 +128,64 @@ class BufferGroup
  public:
   /// Ctor
   /// \param device - Device handle
-  /// \param numBuffers - number of buffers we want for the device
+  /// \param numBuffers - number of buffers we want for the device.  The driver may
+  ///                     allocate more or fewer - see size().
   BufferGroup(DeviceV4L2Ptr& device, size_t numBuffers);
 
+  /// Ctor for user pointer buffers, that the driver captures straight into.
+  /// Throws if the driver doesn't support them.
+  /// \param device - Device handle
+  /// \param userBuffers - memory to capture into.  If empty, numBuffers buffers are
+  ///                      allocated instead.
+  /// \param numBuffers - number of buffers to allocate, without userBuffers
+  /// \param bufferSize - bytes per buffer to allocate - the format's image size
+  /// \param allocator - allocator for the buffers
+  BufferGroup(DeviceV4L2Ptr& device, const std::vector<UserBuffer>& userBuffers,
+              size_t numBuffers, size_t bufferSize, const FrameAllocator<uint8_t>& allocator);
+
   /// Dtor - cleans up the buffers and releases them
   ~BufferGroup();
 
   /// Retrieves a buffer
   BufferMemmap& Get(size_t index);
 
+  /// Number of buffers allocated
+  size_t size() const
+  {
+    return buffers_.size();
+  }
+
   /// Queues all the buffers for use by the device
   void QueueAll();
 
+  /// Exports all the buffers as dmabufs.  Only driver (MMAP) buffers can be exported.
+  void ExportAll();
+
+  /// Dequeues whichever buffer the driver filled first, using the index it returns.
+  /// Call it again until it returns nullptr to take every buffer that's ready.
+  /// \returns BufferMemmap* - the filled buffer, or nullptr if none is ready yet.
+  BufferMemmap* Dequeue();
+
+  /// Requeues a buffer that was lent out, unless the stream has been stopped since.
+  /// The group (and its mappings) must outlive any loans - hold it in a shared_ptr.
+  /// \param buffer - buffer from Dequeue()
+  void Return(BufferMemmap& buffer);
+
+  /// Marks the stream as stopped, so buffers returned later aren't requeued.
+  /// Waits for a Return() that's requeueing a buffer.
+  void Stop();
+
  private:
+  /// Asks the driver for buffers
+  /// \param numBuffers - buffers wanted
+  /// \returns size_t - buffers the driver allocated
+  size_t Request(size_t numBuffers);
+
   DeviceV4L2Ptr device_;               ///< device handle
+  uint32_t memory_;                    ///< V4L2_MEMORY_MMAP or V4L2_MEMORY_USERPTR
   std::vector<BufferMemmap> buffers_;  ///< allocated/memmapped buffers
+  std::mutex mutex_;                   ///< Orders Return()'s requeue against Stop()
+  bool streaming_;                     ///< False once Stop() is called
 };
 
 }  // namespace zebral
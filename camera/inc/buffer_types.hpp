@@ -0,0 +1,25 @@
+/// \file buffer_types.hpp
+/// Types describing where a camera's driver captures frames to
+#ifndef LIGHTBOX_CAMERA_BUFFER_TYPES_HPP_
+#define LIGHTBOX_CAMERA_BUFFER_TYPES_HPP_
+
+#include <cstddef>
+
+namespace zebral
+{
+/// Where a V4L2 camera's driver captures frames to, see Camera::SetBufferMemory()
+enum class BufferMemory
+{
+  MMAP,    ///< The driver's own buffers, mapped into our memory
+  USERPTR  ///< Our memory - the driver captures straight into it
+};
+
+/// Memory from the application for the driver to capture into
+struct UserBuffer
+{
+  void* data;   ///< Start of the buffer
+  size_t size;  ///< Bytes available - at least the mode's image size
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_BUFFER_TYPES_HPP_
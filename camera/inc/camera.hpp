@@ -3,6 +3,8 @@
 #ifndef LIGHTBOX_CAMERA_CAMERA_HPP_
 #define LIGHTBOX_CAMERA_CAMERA_HPP_
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
@@ -11,22 +13,73 @@
 #include <optional>
 #include <thread>
 
+#include "async.hpp"
+#include "buffer_types.hpp"
 #include "camera_frame.hpp"
 #include "camera_info.hpp"
+#include "camera_stats.hpp"
+#include "capture_reactor.hpp"
+#include "executor.hpp"
+#include "frame_budget.hpp"
+#include "frame_loan.hpp"
+#include "frame_ring.hpp"
+#include "frame_subscriber.hpp"
+#include "frame_throttle.hpp"
 
 namespace zebral
 {
 class Param;
 
-/// Frame callback for hosts
-/// \param info - information about the camera
-/// \param image - CameraFrame containing image.
-typedef std::function<void(const CameraInfo& info, const CameraFrame& image)> FrameCallback;
+/// Timing of the frame callback passed to Camera::Start()
+struct CallbackStats
+{
+  uint64_t calls;                  ///< Callbacks run
+  uint64_t skipped;                ///< Frames skipped because callbacks were backed up
+  std::chrono::nanoseconds total;  ///< Total time in callbacks
+  std::chrono::nanoseconds max;    ///< Longest callback
+  std::chrono::nanoseconds last;   ///< Most recent callback
+};
+
+/// A rectangle of a camera's image in pixels, see Camera::SetCrop()
+struct CropRect
+{
+  int x      = 0;  ///< Left edge
+  int y      = 0;  ///< Top edge
+  int width  = 0;  ///< Width, 0 for no crop
+  int height = 0;  ///< Height, 0 for no crop
+
+  /// True if it doesn't crop anything
+  bool empty() const
+  {
+    return (width <= 0) || (height <= 0);
+  }
+};
+
+/// Where a camera's crop is done
+enum class CropMode
+{
+  NONE,      ///< Frames aren't cropped
+  HARDWARE,  ///< The device crops, so only the crop crosses the bus
+  SOFTWARE   ///< Whole frames are captured and cropped as they're published
+};
 
 /// Camera interface / Base class
 /// This may be used as an asynchronous frame source (using the callback)
 /// OR as a synchronous one using GetNextFrame() and GetLastFrame().
 ///
+/// Received frames are published to a FrameRing, so the capture thread never waits on
+/// readers.  GetLatestFrameHandle() and GetFrameAfter() share frames from the ring without
+/// copying them; GetNewFrame() and GetLastFrame() return copies.
+///
+/// The Start() callback runs on the callback executor after the device buffer has been
+/// returned to the driver, so a slow callback can't starve the device of buffers.
+///
+/// Any number of consumers can Subscribe() to get frames on their own thread, from their own
+/// queue, so a slow consumer doesn't hold up the others.
+///
+/// For raw capture with no copies at all, SetLoanCallback() lends the driver's buffers
+/// themselves, and they're requeued when the consumer lets go.
+///
 /// All camera types should derive from this and implement the pure functions.
 /// Also call OnFrameReceived() when we receive frames.
 class Camera
@@ -36,16 +89,122 @@ class Camera
   /// \param info - CameraInfo (returned by CameraManager::Enumerate)
   Camera(const CameraInfo& info);
 
-  /// Virtual dtor
-  virtual ~Camera() = default;
+  /// Virtual dtor - stops any subscribers
+  virtual ~Camera();
 
   /// Start the frame stream.
   /// @param cb - callback that will be called each frame we receive.
   virtual void Start(FrameCallback cb = nullptr);
 
   /// Stop the frame stream
+  /// Waits for callbacks in progress (unless called from one).
   virtual void Stop();
 
+  /// Stops delivering frames but leaves the device streaming with its buffers mapped, so
+  /// Resume() takes a frame or so - a Stop() and Start() renegotiates the buffers, which
+  /// can black out a camera for seconds.  While paused, frames go straight back to the
+  /// driver without being converted or delivered, and are counted in CameraStats::paused.
+  /// Works whether or not the camera is started; Stop() resumes it.
+  void Pause();
+
+  /// Delivers frames again after Pause()
+  void Resume();
+
+  /// True between Pause() and Resume()/Stop()
+  bool IsPaused() const
+  {
+    return paused_;
+  }
+
+  /// Sets where the Start() callback runs. Call before Start().
+  /// The default is Executor::Inline() - on the capture thread, after the device buffer is
+  /// requeued.  On other executors, a frame's callback is skipped if kMaxPendingCallbacks
+  /// are already waiting or running.
+  /// \param executor - executor for callbacks, e.g. a ThreadPoolExecutor(1) for a
+  ///                   dedicated thread, or Executor::SharedPool().
+  void SetCallbackExecutor(std::shared_ptr<Executor> executor);
+
+  /// Has the camera's device serviced by a reactor shared with other cameras, instead of a
+  /// capture thread of its own (V4L2).  With many cameras, that keeps the thread count and
+  /// context switches flat.  Takes effect on the next Start().  Timeouts aren't counted in
+  /// CameraStats while on a reactor.  If the device fails on the reactor, the error is
+  /// counted and IsRunning() goes false - Stop() and Start() to recover.
+  /// \param reactor - e.g. CaptureReactor::Shared(), or null for a capture thread
+  void SetCaptureReactor(std::shared_ptr<CaptureReactor> reactor);
+
+  /// Timing of the Start() callback
+  CallbackStats GetCallbackStats() const;
+
+  /// Snapshot of the camera's performance counters - frame rate, frames captured, delivered
+  /// and dropped, decode and callback timing, and subscriber queues.  Lock-free on the
+  /// capture side, so it's cheap to call while streaming.
+  CameraStats GetStats() const;
+
+  /// Clears the performance counters (but not the subscribers' own counts)
+  void ResetStats();
+
+  /// Only deliver some of the camera's frames - every Nth, and/or at most max_fps using the
+  /// hardware timestamps.  Skipped frames go back to the driver without being converted or
+  /// copied, so they cost almost nothing.  Applies to all consumers; subscribers can also
+  /// throttle themselves with SubscriberOptions::throttle.
+  /// \param settings - which frames to deliver
+  void SetThrottle(const ThrottleSettings& settings);
+
+  /// Current throttle settings
+  ThrottleSettings GetThrottle() const;
+
+  /// Frames skipped by the throttle
+  uint64_t GetThrottledFrames() const;
+
+  /// Most callbacks queued or running on a non-inline executor at once
+  static constexpr int kMaxPendingCallbacks = 2;
+
+  /// Sets how many buffers the driver captures into (V4L2).  With more buffers, a slow
+  /// conversion or callback is absorbed by the queue instead of the driver dropping frames,
+  /// at the cost of memory and - when the queue backs up - latency.  Takes effect on the
+  /// next Start().  See CameraStats::queue_depth for how full the queue gets.
+  /// \param count - buffers to request, 1 to kMaxBufferCount
+  void SetBufferCount(size_t count);
+
+  /// Buffers requested from the driver - the number of user buffers, if there are any
+  size_t GetBufferCount() const;
+
+  /// Sets where the driver captures frames to (V4L2).  Takes effect on the next Start().
+  ///
+  /// With USERPTR, the driver captures straight into our memory: the buffers given, or
+  /// otherwise SetBufferCount() buffers allocated like frames (huge pages if that's the
+  /// frame memory, and charged to GetFrameAccount()).  Copying frames out of them doesn't
+  /// go through the driver's mapping, and with SetLoanCallback() and DecodeType::NONE,
+  /// frames arrive in the application's memory - e.g. a shared memory segment - with no
+  /// copies at all.  Start() throws if the driver doesn't support USERPTR.
+  /// \param memory - MMAP (the default) or USERPTR
+  /// \param buffers - for USERPTR, the application's memory to capture into, or empty to
+  ///                  allocate it.  Each must hold a full image of the mode, and stay valid
+  ///                  until Stop() and any loans of it are released.
+  void SetBufferMemory(BufferMemory memory, const std::vector<UserBuffer>& buffers = {});
+
+  /// Where the driver captures frames to
+  BufferMemory GetBufferMemory() const;
+
+  /// Exports the driver's buffers as dmabufs on Start() (V4L2, MMAP buffers), so lent
+  /// frames carry a FrameLoan::dmabuf_fd that other libraries or processes can import -
+  /// see FrameSharePublisher.  Takes effect on the next Start().
+  /// \param enable - true to export
+  void SetDmabufExport(bool enable);
+
+  static constexpr size_t kDefaultBufferCount = 4;   ///< Buffers requested by default
+  static constexpr size_t kMaxBufferCount     = 32;  ///< Most buffers V4L2 will allocate
+
+  /// Lends raw frames to a callback straight from the driver's buffers, with no copies
+  /// (V4L2, with DecodeType::NONE).  Each buffer is requeued when the last copy of its
+  /// FrameLoan is released.  Lent frames go only to the loan callback; when max_loans are
+  /// already out, frames are copied and delivered as usual (to the ring, Start() callback
+  /// and subscribers) instead.  At least one buffer always stays with the driver, so lending
+  /// needs SetBufferCount() of 2 or more.  Call before Start().
+  /// \param cb - called on the capture thread with each lent frame, nullptr to stop lending
+  /// \param max_loans - most buffers on loan at once
+  void SetLoanCallback(FrameLoanCallback cb, size_t max_loans = 1);
+
   /// Get the next frame. Waits until a new one comes in.
   /// \param timeout_ms - length of time to wait for a frame (milliseconds)
   /// \returns std::optional<CameraFrame> - camera frame or empty on timeout/empty frame.
@@ -55,8 +214,46 @@ class Camera
   /// \return std::optional<CameraFrame> - last frame or empty if none.
   virtual std::optional<CameraFrame> GetLastFrame();
 
+  /// Gets the latest frame without copying it.
+  /// The frame isn't reused while the handle is held, so don't hold on to it for long.
+  /// \return FrameHandle - latest frame and its sequence number, empty if none yet.
+  FrameHandle GetLatestFrameHandle() const;
+
+  /// Gets the next frame after a sequence number without copying it, waiting if needed.
+  /// \param sequence - sequence number of the last frame seen, 0 for any.
+  /// \param timeout_ms - length of time to wait for a frame (milliseconds)
+  /// \return FrameHandle - frame and its sequence number, empty on timeout.
+  FrameHandle GetFrameAfter(uint64_t sequence, size_t timeout_ms = 5000);
+
+  /// Awaitable for the next frame, for coroutines running on an EventLoop.
+  /// Like GetFrameAfter(), but doesn't hold a thread while waiting:
+  ///   auto handle = co_await camera->NextFrame(loop);
+  /// \param loop - loop the awaiting coroutine runs on
+  /// \param timeout - how long to wait, 0 for no timeout
+  /// \param stop - cancels the wait
+  /// \returns AsyncOp<FrameHandle> - co_await for the frame, empty on timeout or cancellation.
+  AsyncOp<FrameHandle> NextFrame(
+      EventLoop& loop,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(5000),
+      std::stop_token stop = {});
+
+  /// Adds a subscriber, which gets each frame on its own thread from its own queue.
+  /// Subscribers stay subscribed across Start() and Stop().
+  /// \param name - subscriber name. Its queued frames are charged to "<account>/<name>".
+  /// \param cb - called for each frame on the subscriber's thread
+  /// \param options - queue size and what to do when the queue is full
+  /// \returns std::shared_ptr<FrameSubscriber> - the subscriber, for stats and Unsubscribe()
+  std::shared_ptr<FrameSubscriber> Subscribe(const std::string& name,
+                                             FrameCallback cb,
+                                             const SubscriberOptions& options = {});
+
+  /// Removes a subscriber and stops its thread, dropping any frames it still has queued.
+  /// May be called from the subscriber's own callback.
+  /// \param subscriber - subscriber from Subscribe()
+  void Unsubscribe(const std::shared_ptr<FrameSubscriber>& subscriber);
+
   /// Is the camera started?
-  /// \returns true if Start() has been called.
+  /// \returns true if Start() has been called, and capture hasn't failed since.
   bool IsRunning();
 
   /// Retrieve the camera's info
@@ -73,7 +270,8 @@ class Camera
   {
     SYSTEM,    ///< Use system codecs
     INTERNAL,  ///< Use internal decoding
-    NONE       ///< Provide raw encoded buffers
+    NONE,      ///< Provide raw encoded buffers
+    DEFERRED   ///< Keep raw buffers, decode (internally) only frames that are read
   };
 
   /// Sets the camera mode (should be done before calling Start()!)
@@ -83,15 +281,61 @@ class Camera
   /// \param info - Struct from the CameraInfo after creation,
   ///               or build your own and set unimportant members to 0.
   /// \param decode - specifies if/how buffers are decoded from their native format.
+  ///                 With DEFERRED, frames are published raw and decoded on first access:
+  ///                 GetNewFrame(), GetLastFrame(), callbacks and subscribers get decoded
+  ///                 frames, and FrameHandle::Decoded() decodes (once) for handle readers.
+  ///                 Compressed formats are still decoded as they're captured.
   ///
   /// Will take the first format that matches non-zero members.
   virtual void SetFormat(const FormatInfo& info, DecodeType decode = DecodeType::INTERNAL);
 
+  /// Changes the mode of a running camera without tearing it down: streaming stops, the new
+  /// mode is set and streaming starts again, keeping the Start() callback, subscribers,
+  /// ring, throttle and stats.  Every frame published before the call is in the old mode
+  /// and every one after it in the new mode - check a frame's size and format rather than
+  /// assuming them.  If the camera isn't running, this is just SetFormat().
+  ///
+  /// Throws without stopping if the mode isn't available or buffers are on loan.  If the
+  /// device then refuses the mode, the camera is left stopped.
+  /// \param info - mode to switch to, as for SetFormat()
+  /// \param decode - how buffers are decoded in the new mode
+  void SwitchFormat(const FormatInfo& info, DecodeType decode = DecodeType::INTERNAL);
+
+  /// Crops frames to a rectangle of the mode's image.  Where the device can (V4L2
+  /// VIDIOC_S_SELECTION, or VIDIOC_S_CROP on older drivers), the sensor crops, so only the
+  /// rectangle crosses the bus and the mode's size becomes the crop's.  Otherwise whole
+  /// frames are captured and cropped as they're published - to the ring, callback and
+  /// subscribers, and in the view of lent frames.  The device or the pixel format's chroma
+  /// subsampling may adjust the rectangle; GetCrop() has the one applied.
+  ///
+  /// Applies to the current mode straight away (restarting streaming like SwitchFormat()
+  /// if it's running), and to later SetFormat() calls.
+  /// \param rect - crop in the mode's pixels, or empty for whole frames
+  void SetCrop(const CropRect& rect);
+
+  /// The crop applied to the current mode - in sensor pixels if the device crops, otherwise
+  /// in the mode's pixels.  Empty if frames aren't cropped.
+  CropRect GetCrop() const
+  {
+    return crop_applied_;
+  }
+
+  /// Where the current mode's crop is done
+  CropMode GetCropMode() const
+  {
+    return crop_mode_;
+  }
+
   /// Retrieves the camera mode. empty if not yet set with SetFormat
   /// \returns std::optional<FormatInfo> - empty if SetFormat not called, otherwise
   ///          contains current format.
   virtual std::optional<FormatInfo> GetFormat();
 
+  /// Account the camera's own frame buffers are charged to in the FrameBudget.
+  /// Frames from GetNewFrame()/GetLastFrame() go to a "<account>/readers" account.
+  /// \returns std::shared_ptr<FrameAccount> - the camera's account
+  std::shared_ptr<FrameAccount> GetFrameAccount() const;
+
   virtual std::vector<std::string> GetParameterNames() const;
   virtual std::shared_ptr<Param> GetParameter(const std::string& name);
   virtual int GetParameterCount() const;
@@ -104,14 +348,80 @@ class Camera
   /// If false is returned, it won't be enumerated in the camera's available
   /// options.
   ///
-  /// Right now, just allowing nv12 and yuy2
-  virtual bool IsFormatSupported(const std::string& format);
+  /// Right now, it's the formats flagged for capture in the pixel format table.
+  virtual bool IsFormatSupported(PixelFormat format);
 
-  /// Handles received frame by updating last_frame_ and calling callback if available.
+  /// Convenience for checking a FourCC string
+  bool IsFormatSupported(const std::string& format);
+
+  /// Handles received frame by publishing it to the ring, queueing it for subscribers,
+  /// and calling callback if available.
+  /// If the FrameBudget refuses the frame, it isn't delivered.
   /// Inheriting classes should call this when they get a frame!
   /// \param frame - frame that has been received.
   virtual void OnFrameReceived(const CameraFrame& frame);
 
+  /// Checks for Pause() and the throttle. Platforms call this with the hardware timestamp
+  /// before decoding, and requeue the buffer without decoding it if it returns false.
+  /// \param timestamp - frame timestamp
+  /// \returns true if the frame should be decoded and delivered
+  bool AcceptFrame(TimeStamp timestamp)
+  {
+    ++frames_captured_;
+    if (paused_)
+    {
+      ++frames_paused_;
+      return false;
+    }
+    return throttle_.Accept(timestamp);
+  }
+
+  /// True if the platform should copy raw buffers and leave decoding to the readers
+  /// (DecodeType::DEFERRED with an uncompressed mode).
+  bool DeferDecode() const
+  {
+    return (decode_ == DecodeType::DEFERRED) && current_mode_ &&
+           !current_mode_->traits().compressed;
+  }
+
+  /// Retrieves a published frame for a reader, decoding it first with DecodeType::DEFERRED.
+  std::shared_ptr<const CameraFrame> DecodedFrame(const FrameHandle& handle) const;
+
+  /// Counts a published frame and updates the frame rate
+  void CountDelivery();
+
+  /// Lends a driver buffer to the loan callback instead of copying it, if there is one
+  /// (with DecodeType::NONE) and a loan is free.  Fills in the loan's format, view and lease.
+  /// \param loan - data, size, timestamp, timing and sequence of the filled buffer
+  /// \param release - returns the buffer to the driver, from whichever thread lets go last
+  /// \returns true if the buffer was lent - the platform mustn't requeue it itself.
+  bool LendBuffer(FrameLoan loan, std::function<void()> release);
+
+  /// True while lent buffers haven't been returned
+  bool HasLoansOut() const
+  {
+    return *loans_out_ != 0;
+  }
+
+  /// Counts how many filled buffers the platform found waiting when it dequeued
+  /// \param ready - buffers dequeued together (1 if the capture thread is keeping up)
+  void CountBufferQueue(size_t ready);
+
+  /// Sets up cropping frames as they're published, when the platform didn't crop on the
+  /// device - the crop is aligned to the chroma subsampling of the frames delivered.
+  void SetSoftwareCrop();
+
+  /// Copies the software crop of a frame
+  /// \param frame - whole frame from the platform
+  /// \param cropped - receives the crop
+  void CropFrame(const CameraFrame& frame, CameraFrame& cropped) const;
+
+  /// Runs the callback and updates its timing.  Exceptions it throws are logged.
+  void RunCallback(const CameraFrame& frame);
+
+  /// Waits for callbacks queued on the executor to finish
+  void WaitForCallbacks();
+
   /// Camera/API specific startup
   /// This should fill out formats in the info_ member and start the camera streaming.
   virtual void OnStart() = 0;
@@ -122,6 +432,8 @@ class Camera
   virtual void OnStop() = 0;
 
   /// Camera/API specific set camera mode.
+  /// Platforms that can crop on the device apply crop_ here, setting crop_applied_ and
+  /// crop_mode_ = HARDWARE and returning the cropped size.
   /// \param mode - Requested mode. Fields set to 0 can be ignored.
   /// \returns FormatInfo - Fully filled out format details of the mode actually set.
   virtual FormatInfo OnSetFormat(const FormatInfo& mode) = 0;
@@ -131,24 +443,81 @@ class Camera
 
   /// Copy a raw buffer into our cur_frame_, making sure that we are allocated
   /// correctly for the raw buffer and not just the decoded buffer.
+  /// Planar YUV (NV12, I420) is copied into a planar frame.
   /// \param srcPtr - source ptr to data
   /// \param srcStride - width of a line in bytes of source. If 0, assumes unpadded.
   void CopyRawBuffer(const void* srcPtr, int srcStride = 0);
 
   CameraInfo info_;                           ///< Camera info, used for creation
   std::unique_ptr<FormatInfo> current_mode_;  ///< Current mode, null if unset.
+  FormatInfo requested_mode_;                 ///< Mode last passed to SetFormat()
+  CropRect crop_;                             ///< Crop asked for with SetCrop()
+  CropRect crop_applied_;                     ///< Crop of the current mode - set by platforms
+  CropMode crop_mode_;                        ///< Where crop_applied_ is done - set by platforms
   FrameCallback callback_;                    ///< Optional frame callback
-  bool exiting_;                              ///< Exiting flag for capture thread (if any)
-  bool running_;                              ///< Running flag - true if camera started
-  mutable std::mutex frame_mutex_;            ///< Lock on last_frame
-  CameraFrame cur_frame_;                     ///< Last frame received
-  CameraFrame last_frame_;                    ///< Last frame received
-  TimeStamp last_timestamp_;                  ///< Timestamp of last frame received
-  std::condition_variable cv_;                ///< Condition var for frame notification
+  std::atomic<bool> exiting_;                 ///< Exiting flag for capture thread (if any)
+  std::atomic<bool> running_;                 ///< Running flag - true if camera started
+  std::atomic<bool> paused_;                  ///< Frames are discarded, see Pause()
+  mutable std::mutex frame_mutex_;            ///< Lock on info
+  CameraFrame cur_frame_;                     ///< Frame being captured / decoded into
+  FrameRing ring_;                            ///< Published frames
+  FrameThrottle throttle_;                    ///< Decides which frames to deliver
   DecodeType decode_;                         ///< Specifies if/how buffers are decoded
   std::vector<FormatInfo> all_modes_;         ///< All modes available, even those we don't support
   mutable std::mutex parameter_mutex_;        ///< Protect parameters
 
+  std::shared_ptr<FrameAccount> frame_account_;   ///< Budget account for our frame buffers
+  std::shared_ptr<FrameAccount> reader_account_;  ///< Budget account for frames we hand out
+
+  std::shared_ptr<Executor> callback_executor_;  ///< Where callback_ runs
+  std::atomic<int> pending_callbacks_;           ///< Callbacks queued or running
+  std::mutex callback_mutex_;                    ///< Lock for callback_cv_
+  std::condition_variable callback_cv_;          ///< Signalled when a callback finishes
+  std::atomic<uint64_t> callback_skipped_;       ///< Callbacks skipped
+  TimingHistogram callback_timing_;              ///< Callback durations
+
+  std::atomic<uint64_t> frames_captured_;      ///< Frames from the device (AcceptFrame())
+  std::atomic<uint64_t> frames_delivered_;     ///< Frames published
+  std::atomic<uint64_t> frames_dropped_;       ///< Frames refused or without a ring frame
+  std::atomic<uint64_t> frames_paused_;        ///< Frames discarded while paused
+  std::atomic<uint64_t> capture_errors_;       ///< Failed dequeues/decodes/connections
+  std::atomic<uint64_t> capture_timeouts_;     ///< Device waits that timed out
+  std::atomic<uint64_t> driver_dropped_;       ///< Gaps in the driver's sequence numbers
+  std::atomic<int64_t> last_delivery_ns_;      ///< TimeStamp of the latest frame, in ns
+  std::atomic<int64_t> delivery_interval_ns_;  ///< Smoothed time between frames
+  TimingHistogram decode_timing_;              ///< Platform decode durations
+  TimingHistogram publish_latency_;            ///< Dequeued to published
+  TimingHistogram driver_latency_;             ///< Driver timestamp to callback start
+  TimingHistogram capture_latency_;            ///< Dequeued to callback start
+
+  size_t buffer_count_;                              ///< Driver buffers to request on Start()
+  std::atomic<size_t> allocated_buffers_;            ///< Driver buffers streaming, 0 if stopped
+  BufferMemory buffer_memory_;                       ///< Where the driver captures to
+  std::vector<UserBuffer> user_buffers_;             ///< Application memory for USERPTR, if any
+  bool dmabuf_export_;                               ///< Export buffers as dmabufs on Start()
+  std::shared_ptr<CaptureReactor> capture_reactor_;  ///< Services the device, if set
+
+  FrameLoanCallback loan_callback_;                 ///< Gets lent buffers, if set
+  size_t max_loans_;                                ///< Most buffers on loan at once
+  std::shared_ptr<std::atomic<size_t>> loans_out_;  ///< Buffers on loan - shared with leases
+  std::atomic<uint64_t> frames_lent_;               ///< Frames passed to loan_callback_
+  std::atomic<uint64_t> loans_refused_;             ///< Frames copied with every loan out
+
+  /// Dequeues by the number of filled buffers found together, less one
+  std::array<std::atomic<uint64_t>, kMaxBufferCount> queue_depth_;
+
+  std::mutex frame_waiter_mutex_;        ///< Protects frame_waiters_
+  std::atomic<bool> has_frame_waiters_;  ///< True if frame_waiters_ isn't empty
+
+  /// Coroutines waiting in NextFrame()
+  std::vector<std::shared_ptr<AsyncState<FrameHandle>>> frame_waiters_;
+
+  /// Subscribers. The list is replaced (not modified) on Subscribe/Unsubscribe, so the
+  /// capture thread only holds subscriber_mutex_ long enough to take a reference.
+  using SubscriberList = std::vector<std::shared_ptr<FrameSubscriber>>;
+  std::shared_ptr<const SubscriberList> subscribers_;
+  mutable std::mutex subscriber_mutex_;  ///< Protects subscribers_
+
   /// map of adjustable parameters by name
   std::map<std::string, std::shared_ptr<Param>> parameters_;
 };
@@ -32,11 +32,27 @@ class Converter
 {
  public:
   /// Converts a CameraFrame object to a cv::Mat of the appropriate type.
+  /// Planar YUV frames come out as OpenCV expects them for cv::cvtColor - a single
+  /// channel mat of height * 1.5 rows.  OpenCV can't describe odd sized planar frames
+  /// (the chroma rows are a different width), so those throw ZBA_UNSUPPORTED_FMT.
   /// NOTE: This is faster, but the data is dependent on the CameraFrame's
   ///       lifespan.
   static cv::Mat Camera2CvNoCopy(const CameraFrame& image)
   {
-    return cv::Mat(image.height(), image.width(), CVTypeFromImage(image),
+    int rows = image.height();
+    if (image.is_planar())
+    {
+      if ((image.width() % 2) || (image.height() % 2))
+      {
+        ZBA_THROW("Planar frames need even dimensions for OpenCV", Result::ZBA_UNSUPPORTED_FMT);
+      }
+      rows = image.height() + image.height() / 2;
+      if (static_cast<size_t>(rows) * image.stride() > image.data_size())
+      {
+        ZBA_THROW("Planar frame is smaller than its dimensions", Result::ZBA_INVALID_RANGE);
+      }
+    }
+    return cv::Mat(rows, image.width(), CVTypeFromImage(image),
                    const_cast<void*>(reinterpret_cast<const void*>(image.data())));
   }
 
@@ -44,9 +60,28 @@ class Converter
   /// and makes a copy of the data
   static cv::Mat Camera2Cv(const CameraFrame& image)
   {
-    return cv::Mat(image.height(), image.width(), CVTypeFromImage(image),
-                   const_cast<void*>(reinterpret_cast<const void*>(image.data())))
-        .clone();
+    return Camera2CvNoCopy(image).clone();
+  }
+
+  /// Wraps a FrameView (e.g. an ROI of a CameraFrame) in a cv::Mat header without copying.
+  /// NOTE: The data is dependent on the lifespan of whatever the view refers to.
+  static cv::Mat View2CvNoCopy(const FrameView& view)
+  {
+    return cv::Mat(view.height(), view.width(), CVTypeFromImage(view),
+                   const_cast<void*>(reinterpret_cast<const void*>(view.data())), view.stride());
+  }
+
+  /// Wraps a cv::Mat (or a cv::Mat ROI) in a writable FrameView without copying.
+  /// NOTE: The view is dependent on the cv::Mat's lifespan.
+  static MutableFrameView CvToView(cv::Mat& frame)
+  {
+    if (frame.empty()) return MutableFrameView();
+    bool is_signed = false;
+    bool is_float  = false;
+    CvDepthTraits(frame, is_signed, is_float);
+    return MutableFrameView(frame.data, frame.cols, frame.rows, frame.step[0], frame.channels(),
+                            static_cast<int>(frame.elemSize1()), is_signed, is_float,
+                            TimeStampNow());
   }
 
   /// Converts a cv::Mat to a CameraFrame object of the appropriate type
@@ -54,30 +89,16 @@ class Converter
   static CameraFrame CvToCameraFrame(const cv::Mat& frame)
   {
     if (frame.empty()) return CameraFrame();
-    bool is_signed = true;
+    bool is_signed = false;
     bool is_float  = false;
-    auto depth     = frame.type() & CV_MAT_DEPTH_MASK;
-    switch (depth)
+    CvDepthTraits(frame, is_signed, is_float);
+
+    // Mats that are ROIs of a larger mat are padded - copy through a view.
+    if (!frame.isContinuous())
     {
-      case CV_8U:
-      case CV_16U:
-        is_signed = false;
-        is_float  = false;
-        break;
-      case CV_8S:
-      case CV_16S:
-      case CV_32S:
-        is_signed = true;
-        is_float  = false;
-        break;
-      case CV_64F:
-      case CV_32F:
-        is_signed = true;
-        is_float  = true;
-        break;
-      default:
-        throw Error("Unsupported cv::Mat type:" + std::to_string(frame.type()),
-                    Result::ZBA_UNSUPPORTED_FMT);
+      return CameraFrame(FrameView(frame.data, frame.cols, frame.rows, frame.step[0],
+                                   frame.channels(), static_cast<int>(frame.elemSize1()),
+                                   is_signed, is_float, TimeStampNow()));
     }
 
     return CameraFrame(frame.cols, frame.rows, frame.channels(),
@@ -85,8 +106,9 @@ class Converter
                        frame.data);
   }
 
-  /// Retrieves the appropriate OpenCV type from the CameraFrame.
-  static int CVTypeFromImage(const CameraFrame& image)
+  /// Retrieves the appropriate OpenCV type from the CameraFrame or FrameView.
+  template <class Image>
+  static int CVTypeFromImage(const Image& image)
   {
     int type_id = -1;
 
@@ -129,6 +151,34 @@ class Converter
   }
 
  private:
+  /// Sets signed/floating flags from the cv::Mat's depth, throws if unsupported.
+  static void CvDepthTraits(const cv::Mat& frame, bool& is_signed, bool& is_float)
+  {
+    auto depth = frame.type() & CV_MAT_DEPTH_MASK;
+    switch (depth)
+    {
+      case CV_8U:
+      case CV_16U:
+        is_signed = false;
+        is_float  = false;
+        break;
+      case CV_8S:
+      case CV_16S:
+      case CV_32S:
+        is_signed = true;
+        is_float  = false;
+        break;
+      case CV_64F:
+      case CV_32F:
+        is_signed = true;
+        is_float  = true;
+        break;
+      default:
+        throw Error("Unsupported cv::Mat type:" + std::to_string(frame.type()),
+                    Result::ZBA_UNSUPPORTED_FMT);
+    }
+  }
+
   /// Static class, deleted constructor
   Converter() = delete;
   /// Static class, deleted destructor
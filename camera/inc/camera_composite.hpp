@@ -0,0 +1,69 @@
+/// \file camera_composite.hpp
+/// Composite devices - several capture nodes of one device, started and paired together
+#ifndef LIGHTBOX_CAMERA_CAMERA_COMPOSITE_HPP_
+#define LIGHTBOX_CAMERA_CAMERA_COMPOSITE_HPP_
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "camera.hpp"
+#include "camera_group.hpp"
+#include "camera_info.hpp"
+
+namespace zebral
+{
+/// One physical device with several capture nodes, e.g. a depth camera's Z16 depth and GREY
+/// IR streams.  Set each node's format with GetNodes(), then Start() them together to get
+/// their frames paired up by the driver's sequence numbers.
+///
+/// Create these with CameraManager::CreateComposite().
+class CompositeCamera
+{
+ public:
+  /// Ctor
+  /// \param info - composite from CameraManager::EnumerateComposites()
+  /// \param nodes - a camera for each of info's nodes, in the same order
+  CompositeCamera(const CompositeInfo& info, const std::vector<std::shared_ptr<Camera>>& nodes);
+
+  /// Dtor - stops the nodes
+  ~CompositeCamera();
+
+  /// Starts all the nodes, and delivers a FrameSet (one frame per node, in node order)
+  /// for each frame the device captured on every node.
+  /// \param callback - called for each set of frames
+  /// \param options - window and tolerance; sets are always matched by GroupMatch::SEQUENCE.
+  void Start(FrameSetCallback callback, const GroupOptions& options = {});
+
+  /// Stops all the nodes
+  void Stop();
+
+  /// Are the nodes started?
+  bool IsRunning() const
+  {
+    return group_ != nullptr;
+  }
+
+  /// Device info
+  const CompositeInfo& GetInfo() const
+  {
+    return info_;
+  }
+
+  /// Cameras for each node, for setting formats and parameters
+  const std::vector<std::shared_ptr<Camera>>& GetNodes() const
+  {
+    return nodes_;
+  }
+
+  /// Pairing counters, empty if not started
+  std::optional<GroupStats> GetStats() const;
+
+ protected:
+  CompositeInfo info_;                          ///< Device info
+  std::vector<std::shared_ptr<Camera>> nodes_;  ///< Camera for each node
+  std::unique_ptr<CameraGroup> group_;          ///< Pairs the nodes' frames while running
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_CAMERA_COMPOSITE_HPP_
@@ -1,8 +1,10 @@
 /// \file camera_frame.hpp
-/// CameraFrame class for holding a camera image
+/// CameraFrame class for holding a camera image, and FrameView for referring to one without copying
 #ifndef LIGHTBOX_CAMERA_CAMERA_FRAME_HPP_
 #define LIGHTBOX_CAMERA_CAMERA_FRAME_HPP_
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -10,10 +12,17 @@
 #include <type_traits>
 #include <vector>
 
+#include "errors.hpp"
+#include "frame_allocator.hpp"
+#include "pixel_format.hpp"
+
 namespace zebral
 {
-// Select clock for timestamps
-using Clock = std::chrono::system_clock;
+// Select clock for timestamps.
+// Monotonic (CLOCK_MONOTONIC on Linux, QPC on Windows) in nanoseconds - the clock the drivers
+// stamp frames with, so hardware timestamps are used as-is, and wall clock steps don't
+// disturb them.
+using Clock = std::chrono::steady_clock;
 
 /// TimeStamp used by camera calls
 using TimeStamp = zebral::Clock::time_point;
@@ -21,6 +30,238 @@ using TimeStamp = zebral::Clock::time_point;
 /// \return TimeStamp - current time_point on the chosen clock
 TimeStamp TimeStampNow();
 
+/// Converts a TimeStamp to wall clock time, e.g. for display or logging.
+/// Uses the current offset between the clocks, so it follows wall clock steps.
+/// \param timestamp - time on the TimeStamp clock
+/// \return std::chrono::system_clock::time_point - the same moment on the wall clock
+std::chrono::system_clock::time_point TimeStampToSystem(TimeStamp timestamp);
+
+/// When a frame reached each stage of capture, on the TimeStamp clock.
+/// The frame's own timestamp is the driver's (sensor) time; stages a platform doesn't
+/// report are left at TimeStamp{}.
+struct FrameTiming
+{
+  TimeStamp dequeued;   ///< Capture thread got the buffer from the driver
+  TimeStamp converted;  ///< Decoded / copied out of the driver's buffer
+  TimeStamp published;  ///< Published to readers
+};
+
+/// Non-owning view of an image (or a rectangle of one).
+///
+/// A view is just a pointer, dimensions, a stride and the pixel traits, so it is cheap to
+/// create and copy.  Use it to hand ROIs / tiles of a CameraFrame (or of an external buffer)
+/// to the converters or to OpenCV without copying any pixels.
+///
+/// The view does NOT keep the underlying memory alive - it is only valid while the frame or
+/// buffer it was taken from is.
+///
+/// \tparam T - uint8_t for a writable view, const uint8_t for a read-only one.
+template <class T>
+class BasicFrameView
+{
+ public:
+  /// Default ctor - empty view.
+  BasicFrameView()
+      : data_(nullptr),
+        width_(0),
+        height_(0),
+        stride_(0),
+        channels_(0),
+        bytes_per_channel_(0),
+        is_signed_(false),
+        is_floating_(false),
+        timestamp_()
+  {
+  }
+
+  /// Create a view on existing memory
+  /// \param data - pointer to the first pixel of the view
+  /// \param width - width of the view in pixels
+  /// \param height - height of the view in pixels
+  /// \param stride - bytes from the start of one row to the next. If 0, assumes unpadded.
+  /// \param channels - number of interleaved channels
+  /// \param bytesPerChannel - bytes per pixel per channel
+  /// \param is_signed - is data a signed type?
+  /// \param is_floating_point - is data a floating type?
+  /// \param timestamp - timestamp of the image the view refers to
+  BasicFrameView(T* data, int width, int height, size_t stride, int channels,
+                 int bytesPerChannel, bool is_signed = false, bool is_floating_point = false,
+                 TimeStamp timestamp = TimeStamp())
+      : data_(data),
+        width_(width),
+        height_(height),
+        stride_(stride),
+        channels_(channels),
+        bytes_per_channel_(bytesPerChannel),
+        is_signed_(is_signed),
+        is_floating_(is_floating_point),
+        timestamp_(timestamp)
+  {
+    if (0 == stride_)
+    {
+      stride_ = row_bytes();
+    }
+  }
+
+  /// Writable views convert implicitly to read-only ones.
+  template <class U, class = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  BasicFrameView(const BasicFrameView<U>& view)
+      : data_(view.data()),
+        width_(view.width()),
+        height_(view.height()),
+        stride_(view.stride()),
+        channels_(view.channels()),
+        bytes_per_channel_(view.bytes_per_channel()),
+        is_signed_(view.is_signed()),
+        is_floating_(view.is_floating()),
+        timestamp_(view.get_timestamp())
+  {
+  }
+
+  /// Returns true if the view doesn't refer to any pixels
+  /// \return true if view is empty
+  bool empty() const
+  {
+    return (data_ == nullptr) || (width_ == 0) || (height_ == 0);
+  }
+
+  /// Width of the view (pixels)
+  /// \return int view width in pixels
+  int width() const
+  {
+    return width_;
+  }
+
+  /// Height of the view (pixels)
+  /// \return int view height in pixels
+  int height() const
+  {
+    return height_;
+  }
+
+  /// Bytes from the start of one row to the start of the next
+  /// \return size_t - row stride in bytes
+  size_t stride() const
+  {
+    return stride_;
+  }
+
+  /// Number of channels (e.g. RGBA = 4)
+  /// \return int number of channels
+  int channels() const
+  {
+    return channels_;
+  }
+
+  /// Bytes per pixel per channel
+  /// \return int - bytes per pixel per channel
+  int bytes_per_channel() const
+  {
+    return bytes_per_channel_;
+  }
+
+  /// Bytes per pixel (all channels)
+  /// \return size_t - bytes per pixel
+  size_t bytes_per_pixel() const
+  {
+    return static_cast<size_t>(channels_) * bytes_per_channel_;
+  }
+
+  /// Bytes of pixel data in a row (excluding any padding)
+  /// \return size_t - bytes of pixel data per row
+  size_t row_bytes() const
+  {
+    return bytes_per_pixel() * width_;
+  }
+
+  /// Is the data a signed type?
+  /// \return true if is signed
+  bool is_signed() const
+  {
+    return is_signed_;
+  }
+
+  /// Is the data a floating type?
+  /// \return - true if is floating point
+  bool is_floating() const
+  {
+    return is_floating_;
+  }
+
+  /// True if the rows are packed with no padding between them
+  /// \return true if contiguous
+  bool is_contiguous() const
+  {
+    return stride_ == row_bytes();
+  }
+
+  /// Pointer to the first pixel of the view
+  /// \return T* - ptr to the top-left pixel
+  T* data() const
+  {
+    return data_;
+  }
+
+  /// Pointer to the start of a row
+  /// \param y - row in the view
+  /// \return T* - ptr to the first pixel of row y
+  T* row(int y) const
+  {
+    return data_ + stride_ * y;
+  }
+
+  /// Timestamp of the frame the view refers to
+  TimeStamp get_timestamp() const
+  {
+    return timestamp_;
+  }
+
+  /// Returns a view of a rectangle within this view. No pixels are copied.
+  /// Throws if the rectangle isn't entirely within this view.
+  /// \param x - left of the rectangle in pixels
+  /// \param y - top of the rectangle in pixels
+  /// \param width - width of the rectangle in pixels
+  /// \param height - height of the rectangle in pixels
+  /// \return BasicFrameView - view of the rectangle, with the same stride as this one.
+  BasicFrameView roi(int x, int y, int width, int height) const
+  {
+    if ((x < 0) || (y < 0) || (width < 0) || (height < 0) || (x + width > width_) ||
+        (y + height > height_))
+    {
+      ZBA_THROW("ROI out of range of frame", Result::ZBA_INVALID_RANGE);
+    }
+    return BasicFrameView(row(y) + bytes_per_pixel() * x, width, height, stride_, channels_,
+                          bytes_per_channel_, is_signed_, is_floating_, timestamp_);
+  }
+
+ protected:
+  T* data_;                ///< first pixel of the view
+  int width_;              ///< width of view in pixels
+  int height_;             ///< height of view in pixels
+  size_t stride_;          ///< bytes between rows
+  int channels_;           ///< number of channels (interleaved)
+  int bytes_per_channel_;  ///< bytes per pixel per channel
+  bool is_signed_;         ///< is data a signed type?
+  bool is_floating_;       ///< is data a floating type?
+  TimeStamp timestamp_;    ///< timestamp of the frame
+};
+
+/// Read-only view of an image
+using FrameView = BasicFrameView<const uint8_t>;
+
+/// Writable view of an image
+using MutableFrameView = BasicFrameView<uint8_t>;
+
+/// A plane within a CameraFrame's data.
+struct FramePlane
+{
+  size_t offset;      ///< Offset of the plane from the start of the frame data in bytes
+  size_t stride;      ///< Bytes between rows of the plane
+  int width;          ///< Width of the plane in samples
+  int height;         ///< Height of the plane in samples
+  PlaneFormat layout;  ///< Channels and subsampling of the plane
+};
+
 /// Simple image class.
 /// This is meant as a very simple wrapper for an image grabbed from a camera.
 /// The intention is to not have the camera API depend on OpenCV, but to allow
@@ -29,11 +270,23 @@ TimeStamp TimeStampNow();
 /// It is NOT meant to be used for image processing - just holding the image from capture
 /// until it's out of the library.
 ///
-/// This will ONLY work for images where each pixel channel is 1 T currently,
-/// If we decide to support packed formats this will need to get a lot more complex.
+/// Each pixel channel is 1 T, channels are interleaved within a plane.
+/// Most frames have a single plane, but planar YUV (NV12, I420) is kept as-is with a plane
+/// per component so it can go to consumers that want YUV without conversion.  For those,
+/// width()/height()/channels()/view() describe the first (luma) plane, and plane_view()
+/// gives access to the others.  The planes are stored back to back without padding.
+///
+/// Storage comes from a FrameAllocator, so large frames can use huge pages - see
+/// SetDefaultFrameMemory() and set_frame_memory().
+///
+/// Frames carry a PixelFormat tag when their layout is a known format (raw captures, or
+/// decoded BGR), and PixelFormat::UNKNOWN when built from plain dimensions.
 class CameraFrame
 {
  public:
+  /// Storage for frame data
+  using FrameBuffer = std::vector<uint8_t, FrameAllocator<uint8_t>>;
+
   /// Default ctor, just zeros everything.
   /// empty() will return true.
   CameraFrame()
@@ -43,8 +296,21 @@ class CameraFrame
         bytes_per_channel_(0),
         is_signed_(false),
         is_floating_(false),
-        timestamp_(TimeStampNow())
+        timestamp_(TimeStampNow()),
+        timing_{},
+        hw_sequence_(0),
+        num_planes_(0),
+        planes_{},
+        pixel_format_(PixelFormat::UNKNOWN)
+  {
+  }
+
+  /// Empty frame whose storage will come from a specific allocator
+  /// (e.g. huge pages, or charged to a consumer's FrameAccount).
+  /// \param allocator - allocator for the frame data
+  explicit CameraFrame(const FrameAllocator<uint8_t>& allocator) : CameraFrame()
   {
+    data_ = FrameBuffer(allocator);
   }
 
   /// Normal ctor - if data is provided, copies it into the vector.
@@ -52,23 +318,41 @@ class CameraFrame
   CameraFrame(int width, int height, int channels, int bytesPerChannel, bool is_signed,
               bool is_floating_point, TimeStamp timestamp = TimeStampNow(),
               const uint8_t* data = nullptr)
-      : width_(width),
-        height_(height),
-        channels_(channels),
-        bytes_per_channel_(bytesPerChannel),
-        is_signed_(is_signed),
-        is_floating_(is_floating_point),
-        timestamp_(timestamp)
+      : CameraFrame()
   {
-    /// {TODO} won't work with stepped/padded data.
-    size_t dataSize = static_cast<size_t>(width_) * height_ * channels_ * bytes_per_channel_;
-    if (data)
-    {
-      data_.assign((data), (data + dataSize));
-    }
-    else
+    reset(width, height, channels, bytesPerChannel, is_signed, is_floating_point, timestamp,
+          data);
+  }
+
+  /// Planar ctor - if data is provided, copies it into the vector (planes back to back).
+  /// Otherwise, reserves space for it.
+  CameraFrame(int width, int height, int bytesPerChannel, const std::vector<PlaneFormat>& planes,
+              TimeStamp timestamp = TimeStampNow(), const uint8_t* data = nullptr)
+      : CameraFrame()
+  {
+    reset(width, height, bytesPerChannel, planes, timestamp, data);
+  }
+
+  /// Pixel format ctor - lays out the frame from the pixel format table.
+  /// If data is provided, copies it into the vector. Otherwise, reserves space for it.
+  CameraFrame(int width, int height, PixelFormat format, TimeStamp timestamp = TimeStampNow(),
+              const uint8_t* data = nullptr)
+      : CameraFrame()
+  {
+    reset(width, height, format, timestamp, data);
+  }
+
+  /// Copy ctor from a view - copies the pixels the view refers to into a new,
+  /// unpadded frame.  Use this to keep an ROI around after the source goes away.
+  /// \param view - view to copy
+  explicit CameraFrame(const FrameView& view)
+      : CameraFrame(view.width(), view.height(), view.channels(), view.bytes_per_channel(),
+                    view.is_signed(), view.is_floating(), view.get_timestamp())
+  {
+    const size_t row_bytes = view.row_bytes();
+    for (int y = 0; y < height_; ++y)
     {
-      data_.resize(dataSize);
+      std::copy(view.row(y), view.row(y) + row_bytes, data_.data() + row_bytes * y);
     }
   }
 
@@ -81,24 +365,64 @@ class CameraFrame
              bool is_floating_point, TimeStamp timestamp = TimeStampNow(),
              const uint8_t* data = nullptr)
   {
-    width_             = width;
-    height_            = height;
-    channels_          = channels;
-    bytes_per_channel_ = bytesPerChannel;
-    is_signed_         = is_signed;
-    is_floating_       = is_floating_point;
-    timestamp_         = timestamp;
+    const PlaneFormat layout = {channels, 1, 1};
+    is_signed_               = is_signed;
+    is_floating_             = is_floating_point;
+    pixel_format_            = PixelFormat::UNKNOWN;
+    reset_planes(width, height, bytesPerChannel, &layout, 1, timestamp, data);
+  }
 
-    /// {TODO} won't work with stepped/padded data.
-    size_t dataSize = static_cast<size_t>(width_) * height_ * channels_ * bytes_per_channel_;
-    if (data)
-    {
-      data_.assign((data), (data + dataSize));
-    }
-    else
+  /// Resets the frame as a planar frame. Planes are laid out back to back, unpadded.
+  /// \param width - width of the full image in pixels
+  /// \param height - height of the full image in pixels
+  /// \param bytesPerChannel - bytes per sample, same for all planes
+  /// \param planes - layout of each plane
+  /// \param timestamp - frame timestamp
+  /// \param data - if non-null, copied into the frame.
+  void reset(int width, int height, int bytesPerChannel, const std::vector<PlaneFormat>& planes,
+             TimeStamp timestamp = TimeStampNow(), const uint8_t* data = nullptr)
+  {
+    is_signed_    = false;
+    is_floating_  = false;
+    pixel_format_ = PixelFormat::UNKNOWN;
+    reset_planes(width, height, bytesPerChannel, planes.data(), static_cast<int>(planes.size()),
+                 timestamp, data);
+  }
+
+  /// Resets the frame to hold an image in a pixel format from the table.
+  /// Throws ZBA_UNSUPPORTED_FMT if the format isn't in the table.
+  /// \param width - width of the full image in pixels
+  /// \param height - height of the full image in pixels
+  /// \param format - pixel format of the image
+  /// \param timestamp - frame timestamp
+  /// \param data - if non-null, copied into the frame.
+  void reset(int width, int height, PixelFormat format, TimeStamp timestamp = TimeStampNow(),
+             const uint8_t* data = nullptr)
+  {
+    const auto& traits = GetPixelFormatInfo(format);
+    if (traits.format == PixelFormat::UNKNOWN)
     {
-      data_.resize(dataSize);
+      ZBA_THROW("Pixel format not in format table", Result::ZBA_UNSUPPORTED_FMT);
     }
+    is_signed_    = false;
+    is_floating_  = false;
+    pixel_format_ = format;
+    reset_planes(width, height, traits.bytes_per_component, traits.planes.data(),
+                 traits.num_planes, timestamp, data);
+  }
+
+  /// Pixel format of the frame, or PixelFormat::UNKNOWN if it was built from dimensions.
+  /// \return PixelFormat - format of the data
+  PixelFormat pixel_format() const
+  {
+    return pixel_format_;
+  }
+
+  /// Tags the frame with a pixel format without changing its layout
+  /// \param format - pixel format of the data
+  void set_pixel_format(PixelFormat format)
+  {
+    pixel_format_ = format;
   }
 
   /// Returns true if the data buffer has no data.
@@ -122,7 +446,7 @@ class CameraFrame
     return height_;
   }
 
-  /// Number of channels (e.g. RGBA = 4)
+  /// Number of channels (e.g. RGBA = 4). For planar frames, the channels of the first plane.
   /// \return int number of channels
   int channels() const
   {
@@ -150,7 +474,7 @@ class CameraFrame
     return is_floating_;
   }
 
-  /// Size of image data in bytes
+  /// Size of image data in bytes (all planes)
   /// \return size_t - size of data in bytes
   size_t data_size() const
   {
@@ -176,7 +500,98 @@ class CameraFrame
     return data_.data();
   }
 
+  /// Bytes from the start of one row to the next (of the first plane)
+  /// \return size_t - row stride in bytes (frames are always unpadded)
+  size_t stride() const
+  {
+    return static_cast<size_t>(width_) * channels_ * bytes_per_channel_;
+  }
+
+  /// Number of planes. 1 for interleaved frames, 0 if empty.
+  /// \return int - number of planes
+  int plane_count() const
+  {
+    return num_planes_;
+  }
+
+  /// Is the frame planar (more than one plane)?
+  /// \return true if planar
+  bool is_planar() const
+  {
+    return num_planes_ > 1;
+  }
+
+  /// Retrieves the location and size of a plane
+  /// \param index - index of the plane
+  /// \return const FramePlane& - plane description
+  const FramePlane& plane(int index) const
+  {
+    if ((index < 0) || (index >= num_planes_))
+    {
+      ZBA_THROW("Invalid plane index", Result::ZBA_INVALID_RANGE);
+    }
+    return planes_[index];
+  }
+
+  /// Read-only view of a plane
+  /// \param index - index of the plane
+  /// \return FrameView - view of the plane
+  FrameView plane_view(int index) const
+  {
+    const auto& p = plane(index);
+    return FrameView(data_.data() + p.offset, p.width, p.height, p.stride, p.layout.channels,
+                     bytes_per_channel_, is_signed_, is_floating_, timestamp_);
+  }
+
+  /// Writable view of a plane
+  /// \param index - index of the plane
+  /// \return MutableFrameView - view of the plane
+  MutableFrameView plane_view(int index)
+  {
+    const auto& p = plane(index);
+    return MutableFrameView(data_.data() + p.offset, p.width, p.height, p.stride,
+                            p.layout.channels, bytes_per_channel_, is_signed_, is_floating_,
+                            timestamp_);
+  }
+
+  /// Read-only view of the whole frame (first plane if planar)
+  /// \return FrameView - view of the frame's pixels
+  FrameView view() const
+  {
+    return const_view();
+  }
+
+  /// Read-only view of the whole frame, even from a non-const frame (first plane if planar)
+  FrameView const_view() const
+  {
+    return FrameView(data_.data(), width_, height_, stride(), channels_, bytes_per_channel_,
+                     is_signed_, is_floating_, timestamp_);
+  }
+
+  /// Writable view of the whole frame (first plane if planar)
+  /// \return MutableFrameView - view of the frame's pixels
+  MutableFrameView view()
+  {
+    return MutableFrameView(data_.data(), width_, height_, stride(), channels_,
+                            bytes_per_channel_, is_signed_, is_floating_, timestamp_);
+  }
+
+  /// Read-only view of a rectangle of the frame. No pixels are copied.
+  /// \return FrameView - view of the rectangle
+  FrameView roi(int x, int y, int width, int height) const
+  {
+    return const_view().roi(x, y, width, height);
+  }
+
+  /// Writable view of a rectangle of the frame. No pixels are copied.
+  /// \return MutableFrameView - view of the rectangle
+  MutableFrameView roi(int x, int y, int width, int height)
+  {
+    return view().roi(x, y, width, height);
+  }
+
   /// Write the frame to a text-based image for debugging
+  /// For planar frames, writes the first plane as greyscale.
   /// returns false if not supported for frame type.
   bool write_ppm(std::ostream& out)
   {
@@ -186,7 +601,7 @@ class CameraFrame
       out << "P6" << std::endl;
       out << width_ << " " << height_ << std::endl;
       out << "255" << std::endl;
-      out.write(reinterpret_cast<char*>(data_.data()), data_.size());
+      out.write(reinterpret_cast<char*>(data_.data()), stride() * height_);
       return true;
     }
     else if ((channels_ == 1) && (bytes_per_channel_ <= 2))
@@ -203,7 +618,7 @@ class CameraFrame
       {
         out << "65535" << std::endl;
       }
-      out.write(reinterpret_cast<char*>(data_.data()), data_.size());
+      out.write(reinterpret_cast<char*>(data_.data()), stride() * height_);
       return true;
     }
     return false;
@@ -219,15 +634,133 @@ class CameraFrame
     timestamp_ = timestamp;
   }
 
+  /// When the frame reached each stage of capture
+  const FrameTiming& get_timing() const
+  {
+    return timing_;
+  }
+
+  /// Sets the capture stage times
+  /// \param timing - stage times
+  void set_timing(const FrameTiming& timing)
+  {
+    timing_ = timing;
+  }
+
+  /// Driver's sequence number for the frame (e.g. v4l2_buffer.sequence), 0 if not reported.
+  /// Gaps mean the driver dropped frames.
+  uint64_t get_hw_sequence() const
+  {
+    return hw_sequence_;
+  }
+
+  /// Sets the driver's sequence number
+  /// \param sequence - sequence number
+  void set_hw_sequence(uint64_t sequence)
+  {
+    hw_sequence_ = sequence;
+  }
+
+  /// Memory type the frame's data is stored in
+  /// \return FrameMemory - memory type
+  FrameMemory frame_memory() const
+  {
+    return data_.get_allocator().memory();
+  }
+
+  /// Moves the frame's data into another memory type (e.g. huge pages).
+  /// Later resets keep using that memory type.
+  /// \param memory - memory type to use
+  void set_frame_memory(FrameMemory memory)
+  {
+    set_allocator(FrameAllocator<uint8_t>(memory, data_.get_allocator().account()));
+  }
+
+  /// Account the frame's data is charged to in the FrameBudget, may be null.
+  /// \return const std::shared_ptr<FrameAccount>& - account
+  const std::shared_ptr<FrameAccount>& frame_account() const
+  {
+    return data_.get_allocator().account();
+  }
+
+  /// Moves the frame's data to be charged to another account
+  /// \param account - account to charge, or null
+  void set_frame_account(std::shared_ptr<FrameAccount> account)
+  {
+    set_allocator(FrameAllocator<uint8_t>(frame_memory(), std::move(account)));
+  }
+
+  /// Moves the frame's data into storage from another allocator
+  /// \param allocator - allocator to use from now on
+  void set_allocator(const FrameAllocator<uint8_t>& allocator)
+  {
+    if (allocator == data_.get_allocator()) return;
+    FrameBuffer moved(data_.begin(), data_.end(), allocator);
+    data_ = std::move(moved);
+  }
+
  protected:
+  /// Lays out the planes back to back and sizes the data vector to hold them.
+  void reset_planes(int width, int height, int bytesPerChannel, const PlaneFormat* planes,
+                    int numPlanes, TimeStamp timestamp, const uint8_t* data)
+  {
+    if (numPlanes > kMaxPlanes)
+    {
+      ZBA_THROW("Too many planes for frame", Result::ZBA_INVALID_RANGE);
+    }
+
+    width_             = width;
+    height_            = height;
+    channels_          = (numPlanes == 0) ? 0 : planes[0].channels;
+    bytes_per_channel_ = bytesPerChannel;
+    timestamp_         = timestamp;
+    num_planes_        = 0;
+
+    size_t dataSize = 0;
+    for (int i = 0; i < numPlanes; ++i)
+    {
+      const auto& layout = planes[i];
+      auto& p            = planes_[num_planes_++];
+
+      p.layout = layout;
+      // Round up so odd sizes still cover the whole image
+      p.width  = (width + layout.x_subsampling - 1) / layout.x_subsampling;
+      p.height = (height + layout.y_subsampling - 1) / layout.y_subsampling;
+      p.stride = static_cast<size_t>(p.width) * layout.channels * bytes_per_channel_;
+      p.offset = dataSize;
+      dataSize += p.stride * p.height;
+    }
+
+    if (0 == (static_cast<size_t>(width_) * height_ * channels_ * bytes_per_channel_))
+    {
+      num_planes_ = 0;
+      dataSize    = 0;
+    }
+
+    if (data)
+    {
+      data_.assign((data), (data + dataSize));
+    }
+    else
+    {
+      data_.resize(dataSize);
+    }
+  }
+
   int width_;                  ///< width of image in pixels
   int height_;                 ///< height of image in pixels
   int channels_;               ///< number of channels (expect interleaved channels in data)
   int bytes_per_channel_;      ///< bytes per pixel per channel
   bool is_signed_;             ///< is data a signed type?
   bool is_floating_;           ///< is data a floating type?
-  std::vector<uint8_t> data_;  ///< Vector to store data
-  TimeStamp timestamp_;
+  FrameBuffer data_;           ///< Vector to store data
+  TimeStamp timestamp_;        ///< Driver (sensor) timestamp of the frame
+  FrameTiming timing_;         ///< When the frame reached each stage of capture
+  uint64_t hw_sequence_;       ///< Driver's sequence number, 0 if not reported
+  int num_planes_;             ///< Number of planes in use
+
+  std::array<FramePlane, kMaxPlanes> planes_;  ///< Plane layouts
+  PixelFormat pixel_format_;                   ///< Format tag, UNKNOWN if not from the table
 };
 
 }  // namespace zebral
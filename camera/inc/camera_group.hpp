@@ -0,0 +1,176 @@
+/// \file camera_group.hpp
+/// Synchronized capture from several cameras, matching their frames by timestamp
+#ifndef LIGHTBOX_CAMERA_CAMERA_GROUP_HPP_
+#define LIGHTBOX_CAMERA_CAMERA_GROUP_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+#include "camera_stats.hpp"
+
+namespace zebral
+{
+/// Frames from every camera in a group, taken at (nearly) the same time
+struct FrameSet
+{
+  uint64_t sequence = 0;             ///< Sets emitted by the group before this one
+  TimeStamp timestamp;               ///< Earliest frame timestamp in the set
+  std::chrono::nanoseconds skew{0};  ///< Latest minus earliest frame timestamp
+  std::vector<CameraFrame> frames;   ///< One frame per camera, in the group's camera order
+};
+
+/// Frame set callback
+/// \param set - matched frames. Only valid during the callback - copy what you keep.
+typedef std::function<void(const FrameSet& set)> FrameSetCallback;
+
+/// How a CameraGroup decides which frames belong together
+enum class GroupMatch
+{
+  TIMESTAMP,  ///< Timestamps within the tolerance - for separate, synchronized cameras
+  SEQUENCE    ///< Driver sequence numbers - for streams from one device, see CompositeCamera.
+              ///< The offset between the streams' counters is found by timestamp first.
+};
+
+/// Options for a CameraGroup
+struct GroupOptions
+{
+  std::string name = "group";                   ///< Name for subscribers and budget
+  std::chrono::nanoseconds tolerance{5000000};  ///< Max skew within a set
+  size_t window    = 4;                         ///< Frames buffered per camera
+  GroupMatch match = GroupMatch::TIMESTAMP;     ///< How frames are matched
+};
+
+/// Counters for a CameraGroup
+struct GroupStats
+{
+  uint64_t sets    = 0;  ///< Frame sets emitted
+  uint64_t dropped = 0;  ///< Frames dropped without a match (incomplete sets)
+  uint64_t overrun = 0;  ///< Frames dropped because a camera's window was full
+  TimingStats skew;      ///< Skew of the emitted sets
+
+  std::vector<uint64_t> camera_dropped;  ///< Unmatched or overrun frames, per camera
+};
+
+/// Subscribes to several cameras and emits sets of frames whose timestamps are within a
+/// tolerance of each other - e.g. one frame from each camera in a lightbox rig, per
+/// hardware trigger.
+///
+/// Each camera's frames go into a ring of `window` frames.  Frames from each camera arrive
+/// in timestamp order, so only the oldest frame of each ring is ever a candidate: when they
+/// all fall within the tolerance they're emitted as a set, and otherwise the ones too old
+/// to match the newest can never be part of a set, and are dropped.  Each frame is matched
+/// or dropped once, so the cost per frame doesn't depend on the window.
+///
+/// With GroupMatch::SEQUENCE, the first set is matched by timestamp to find the offset
+/// between each stream's sequence numbers, and later sets by sequence number alone - so a
+/// frame the driver dropped on one stream can't pair up the wrong frames.
+///
+/// Cameras' timestamps must come from the same clock (the TimeStamp clock).  Start and stop
+/// the cameras as usual - the group only subscribes to them.
+class CameraGroup
+{
+ public:
+  /// Ctor - subscribes to the cameras
+  /// \param cameras - cameras to match frames from (at least 2)
+  /// \param callback - called for each set, on the thread of the camera's subscriber that
+  ///                   completed it.  Calls are serialized, and in set order.
+  /// \param options - tolerance and window
+  CameraGroup(const std::vector<std::shared_ptr<Camera>>& cameras,
+              FrameSetCallback callback,
+              const GroupOptions& options = {});
+
+  /// Dtor - unsubscribes from the cameras
+  ~CameraGroup();
+
+  CameraGroup(const CameraGroup&)            = delete;
+  CameraGroup& operator=(const CameraGroup&) = delete;
+
+  /// Number of cameras in the group
+  size_t size() const
+  {
+    return slots_.size();
+  }
+
+  /// Snapshot of the group's counters
+  GroupStats GetStats() const;
+
+  /// Drops any buffered frames, e.g. after restarting the cameras
+  void Flush();
+
+ protected:
+  /// Ring of frames from one camera, oldest first
+  struct Slots
+  {
+    std::vector<CameraFrame> frames;  ///< Ring storage, `window` frames
+    size_t head      = 0;             ///< Oldest frame
+    size_t count     = 0;             ///< Frames buffered
+    uint64_t dropped = 0;             ///< Frames dropped from this camera
+    int64_t offset   = 0;             ///< Subtracted from sequence numbers, for SEQUENCE
+
+    CameraFrame& front()
+    {
+      return frames[head];
+    }
+
+    void pop()
+    {
+      head = (head + 1) % frames.size();
+      --count;
+    }
+
+    /// Sequence number of the oldest frame, less the stream's offset
+    int64_t key()
+    {
+      return static_cast<int64_t>(front().get_hw_sequence()) - offset;
+    }
+  };
+
+  /// Buffers a frame from a camera and emits any set it completes
+  /// \param index - camera index in the group
+  /// \param frame - frame from the camera's subscriber
+  void OnFrame(size_t index, const CameraFrame& frame);
+
+  /// Matches the oldest frames of each camera (lock held)
+  /// \param set - filled in with the complete set, if there is one
+  /// \returns bool - true if a set was matched
+  bool Match(FrameSet& set);
+
+  /// Copies the oldest frame of each camera into a set and pops them (lock held)
+  /// \param set - set to fill in.  Its frames' storage is reused.
+  void TakeSet(FrameSet& set);
+
+  /// Calls the callback for sets, once the sets before them have been emitted
+  /// \param sets - matched sets, with consecutive sequence numbers
+  /// \param count - number of sets to emit
+  void Emit(const std::vector<FrameSet>& sets, size_t count);
+
+  std::vector<std::shared_ptr<Camera>> cameras_;               ///< Cameras in the group
+  std::vector<std::shared_ptr<FrameSubscriber>> subscribers_;  ///< Our subscription to each
+  FrameSetCallback callback_;                                  ///< Frame set callback
+  GroupOptions options_;                                       ///< Tolerance and window
+  std::shared_ptr<FrameAccount> account_;                      ///< Budget for buffered frames
+
+  mutable std::mutex mutex_;   ///< Protects the rings and counters
+  std::vector<Slots> slots_;   ///< Buffered frames per camera
+  uint64_t sets_;              ///< Sets emitted
+  uint64_t dropped_;           ///< Unmatched frames
+  uint64_t overrun_;           ///< Frames dropped with a full window
+  bool synced_;                ///< SEQUENCE offsets have been found
+  TimingHistogram skew_;       ///< Set skew
+
+  std::mutex emit_mutex_;            ///< Protects next_emit_
+  std::condition_variable emit_cv_;  ///< Signalled when next_emit_ advances
+  uint64_t next_emit_;               ///< Sequence number of the next set to emit
+
+  /// Sets being emitted, per camera - only used on that camera's subscriber thread
+  std::vector<std::vector<FrameSet>> pending_;
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_CAMERA_GROUP_HPP_
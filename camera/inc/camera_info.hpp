@@ -8,6 +8,7 @@
 #include <set>
 #include <string>
 #include <vector>
+#include "pixel_format.hpp"
 
 namespace zebral
 {
@@ -20,12 +21,6 @@ int BytesPPPCFromFourCC(const std::string& fmt_format);
 /// FourCC for arbitrary incoming strings.
 uint32_t FourCCToUInt32(const std::string& fmt_format);
 
-/// FourCC for statics (for switch/case and the like)
-constexpr uint32_t FOURCCTOUINT32(char const format[5])
-{
-  return (format[0]) | (format[1] << 8) | (format[2] << 16) | (format[3] << 24);
-}
-
 /// Generic OSHandle for creation when needed. Using this so we don't have to pollute everything
 typedef void* OSHANDLE;
 
@@ -41,11 +36,26 @@ struct FormatInfo
              const std::string& fmt_format = "")
       : width(fmt_width),
         height(fmt_height),
+        min_width(0),
+        min_height(0),
+        step_width(0),
+        step_height(0),
         fps(fmt_fps),
-        channels(ChannelsFromFourCC(fmt_format)),
-        bytespppc(BytesPPPCFromFourCC(fmt_format)),
-        format(fmt_format)
+        min_fps(0.0f),
+        channels(0),
+        bytespppc(0),
+        format(fmt_format),
+        pixel_format(PixelFormatFromString(fmt_format))
+  {
+    const auto& traits = GetPixelFormatInfo(pixel_format);
+    channels           = traits.channels;
+    bytespppc          = traits.bytes_per_component;
+  }
+
+  /// Traits of the format from the pixel format table
+  const PixelFormatInfo& traits() const
   {
+    return GetPixelFormatInfo(pixel_format);
   }
 
   /// Less than comparison between FormatInfo for sorting.
@@ -53,15 +63,34 @@ struct FormatInfo
 
   /// Returns true if the fields of the format struct match.
   /// 0 values are considered wildcards, so a fully blank
-  /// FormatInfo will match anything.
+  /// FormatInfo will match anything.  A size or rate matches anywhere in a range.
   bool Matches(const FormatInfo& f) const;
 
-  int width;           ///< Width in pixels
-  int height;          ///< Height in pixels
-  float fps;           ///< Expected frames per second
+  /// True if the device can capture the mode at any size from min_width x min_height to
+  /// width x height, in steps of step_width x step_height
+  bool HasSizeRange() const
+  {
+    return (min_width > 0) && (min_height > 0) && ((min_width < width) || (min_height < height));
+  }
+
+  /// True if the device can run the mode at any rate from min_fps to fps
+  bool HasFpsRange() const
+  {
+    return (min_fps > 0) && (min_fps < fps);
+  }
+
+  int width;           ///< Width in pixels - the largest, for a range of sizes
+  int height;          ///< Height in pixels - the largest, for a range of sizes
+  int min_width;       ///< Smallest width of a stepwise/continuous range, 0 if size is fixed
+  int min_height;      ///< Smallest height of a stepwise/continuous range
+  int step_width;      ///< Width increment within a range of sizes
+  int step_height;     ///< Height increment within a range of sizes
+  float fps;           ///< Expected frames per second - the fastest, for a range of rates
+  float min_fps;       ///< Slowest rate of a stepwise/continuous range, 0 if fps is fixed
   int channels;        ///< Num channels
   int bytespppc;       ///< Bytes per pixel per channel
   std::string format;  ///< Format string (FourCC usually)
+  PixelFormat pixel_format;  ///< Format as a FourCC code, for comparisons in the capture path
 };
 
 /// Information about a camera gathered from enumeration via CameraMgr
@@ -118,9 +147,23 @@ struct CameraInfo
   int selected_format;  ///< index into formats of selected one, or NO_FORMAT_SELECTED for none.
 };
 
+/// Several capture nodes of one physical device - e.g. the depth and IR streams of a depth
+/// camera, which show up as separate cameras on the same USB device.
+struct CompositeInfo
+{
+  std::string name;               ///< Friendly device name (of the first node)
+  std::string bus;                ///< Bus path the nodes share
+  uint16_t vid = 0;               ///< Vendor ID (USB)
+  uint16_t pid = 0;               ///< Product ID (USB)
+  std::vector<CameraInfo> nodes;  ///< Capture nodes, in enumeration order
+};
+
 /// Convenience operator for dumping CameraInfos for debugging
 std::ostream& operator<<(std::ostream& os, const CameraInfo& camInfo);
 
+/// Convenience operator for dumping CompositeInfos for debugging
+std::ostream& operator<<(std::ostream& os, const CompositeInfo& compInfo);
+
 /// Convenience operator for dumping FormatInfoss for debugging
 std::ostream& operator<<(std::ostream& os, const FormatInfo& fmtInfo);
 
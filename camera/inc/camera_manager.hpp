@@ -10,7 +10,9 @@
 namespace zebral
 {
 struct CameraInfo;
+struct CompositeInfo;
 class Camera;
+class CompositeCamera;
 
 /// Enumerates and creates cameras
 ///
@@ -34,6 +36,22 @@ class CameraManager
   /// \param info - Info about the camera to create.
   /// \returns - std::shared_ptr<Camera> - pointer to created camera, or nullptr on failure.
   std::shared_ptr<Camera> Create(const CameraInfo& info);
+
+  /// Get a list of composite devices - physical devices with more than one capture node
+  /// (e.g. depth + IR), which Enumerate() lists as separate cameras.
+  /// \return std::vector<CompositeInfo> - list of composite devices.
+  std::vector<CompositeInfo> EnumerateComposites();
+
+  /// Groups cameras that share a USB device into composites
+  /// \param cameras - cameras from Enumerate()
+  /// \return std::vector<CompositeInfo> - devices with more than one node, in the order
+  ///         their first node was enumerated.
+  static std::vector<CompositeInfo> GroupComposites(const std::vector<CameraInfo>& cameras);
+
+  /// Create a composite camera, with a camera for each of its nodes
+  /// \param info - composite from EnumerateComposites()
+  /// \returns std::shared_ptr<CompositeCamera> - composite camera
+  std::shared_ptr<CompositeCamera> CreateComposite(const CompositeInfo& info);
 };
 
 }  // namespace zebral
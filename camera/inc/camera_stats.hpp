@@ -0,0 +1,127 @@
+/// \file camera_stats.hpp
+/// Lock-free performance counters and timing histograms for cameras
+#ifndef LIGHTBOX_CAMERA_CAMERA_STATS_HPP_
+#define LIGHTBOX_CAMERA_CAMERA_STATS_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace zebral
+{
+/// Snapshot of a TimingHistogram
+struct TimingStats
+{
+  /// Number of buckets - bucket i counts durations under 2^i microseconds, and the last
+  /// bucket counts everything longer.
+  static constexpr size_t kBuckets = 24;
+
+  uint64_t count = 0;                        ///< Durations recorded
+  std::chrono::nanoseconds total{0};         ///< Sum of the durations
+  std::chrono::nanoseconds max{0};           ///< Longest duration
+  std::chrono::nanoseconds last{0};          ///< Most recent duration
+  std::array<uint64_t, kBuckets> buckets{};  ///< Counts per power-of-two bucket
+
+  /// Average duration, 0 if none recorded
+  std::chrono::nanoseconds mean() const;
+
+  /// Approximate percentile - the upper limit of the bucket it falls in (capped at max)
+  /// \param fraction - 0.5 for the median, 0.99 for the 99th percentile, etc.
+  std::chrono::nanoseconds Percentile(double fraction) const;
+
+  /// Upper limit of a bucket
+  static std::chrono::nanoseconds BucketLimit(size_t bucket);
+};
+
+/// Histogram of durations that can be recorded from any thread without locking
+class TimingHistogram
+{
+ public:
+  TimingHistogram();
+
+  /// Records a duration
+  void Record(std::chrono::nanoseconds duration);
+
+  /// Records the time since start
+  /// \param start - when the timed work began
+  void RecordSince(std::chrono::steady_clock::time_point start)
+  {
+    Record(std::chrono::steady_clock::now() - start);
+  }
+
+  /// Copies out the counts. Buckets are read one at a time, so a snapshot taken while
+  /// durations are recorded can be off by those few.
+  TimingStats Snapshot() const;
+
+  /// Clears the counts
+  void Reset();
+
+ protected:
+  std::atomic<uint64_t> count_;                                       ///< Durations recorded
+  std::atomic<int64_t> total_ns_;                                     ///< Sum of durations
+  std::atomic<int64_t> max_ns_;                                       ///< Longest duration
+  std::atomic<int64_t> last_ns_;                                      ///< Latest duration
+  std::array<std::atomic<uint64_t>, TimingStats::kBuckets> buckets_;  ///< Counts per bucket
+};
+
+/// Counters for one of a camera's subscribers
+struct SubscriberStats
+{
+  std::string name;     ///< Subscriber name
+  uint64_t delivered;   ///< Frames passed to its callback
+  uint64_t dropped;     ///< Frames dropped by its policy or the FrameBudget
+  uint64_t throttled;   ///< Frames skipped by its throttle
+  size_t queued;        ///< Frames waiting in its queue
+  TimingStats latency;  ///< Driver timestamp to the start of its callback
+};
+
+/// Snapshot of a camera's counters, from Camera::GetStats().
+/// Counts are since the camera was created (or ResetStats() was called).
+struct CameraStats
+{
+  uint64_t captured  = 0;  ///< Frames received from the device, before throttling
+  uint64_t delivered = 0;  ///< Frames published to readers
+  uint64_t throttled = 0;  ///< Frames skipped by the camera's throttle
+  uint64_t dropped   = 0;  ///< Frames refused by the FrameBudget or with the ring pool in use
+  uint64_t paused    = 0;  ///< Frames discarded while the camera was paused
+  uint64_t errors    = 0;  ///< Failed dequeues, decodes and connections
+  uint64_t timeouts  = 0;  ///< Waits for the device that timed out
+  double fps         = 0;  ///< Recent delivered frame rate
+
+  /// Driver buffer queue (V4L2).  queue_depth[n] counts the times the capture thread found
+  /// n + 1 filled buffers waiting - anything past [0] means it fell behind, and the last
+  /// entry means every buffer was full, so the driver had nowhere to capture to.
+  size_t buffers          = 0;        ///< Buffers requested, from Camera::SetBufferCount()
+  uint64_t driver_dropped = 0;        ///< Frames the driver dropped (sequence number gaps)
+  std::vector<uint64_t> queue_depth;  ///< Dequeues by filled buffers waiting, less one
+
+  uint64_t lent          = 0;  ///< Frames lent without copying, see Camera::SetLoanCallback()
+  uint64_t loans_refused = 0;  ///< Frames copied instead, because every loan was out
+  size_t loans_out       = 0;  ///< Buffers on loan right now
+
+  TimingStats decode;    ///< Converting device buffers, on the capture thread
+  TimingStats callback;  ///< Running the Start() callback
+
+  /// Latency of each stage, measured from the frames' FrameTiming when the Start() callback
+  /// runs.  Driver-to-user includes the exposure/transfer the driver's timestamp covers;
+  /// capture-to-user starts when the capture thread dequeued the buffer.
+  TimingStats publish;          ///< Dequeued to published
+  TimingStats driver_to_user;   ///< Driver timestamp to callback start
+  TimingStats capture_to_user;  ///< Dequeued to callback start
+
+  int pending_callbacks      = 0;  ///< Callbacks queued or running on the executor
+  uint64_t callbacks_skipped = 0;  ///< Callbacks skipped because the executor was backed up
+
+  std::vector<SubscriberStats> subscribers;  ///< Per-subscriber counters
+};
+
+/// Dumps stats, one line per item
+std::ostream& operator<<(std::ostream& os, const TimingStats& stats);
+std::ostream& operator<<(std::ostream& os, const CameraStats& stats);
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_CAMERA_STATS_HPP_
@@ -0,0 +1,116 @@
+/// \file capture_reactor.hpp
+/// One set of threads servicing many cameras' devices with epoll (Linux)
+#ifndef LIGHTBOX_CAMERA_CAPTURE_REACTOR_HPP_
+#define LIGHTBOX_CAMERA_CAPTURE_REACTOR_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zebral
+{
+/// Waits on many file descriptors with one epoll instance, and runs each one's handler when
+/// it's readable - so capturing from 16 cameras takes a few threads instead of 16.
+///
+/// Each fd is registered one-shot and re-armed after its handler returns, so a handler never
+/// runs on two threads at once, and with several threads, different cameras are serviced in
+/// parallel.  Fds can be added and removed while it's running.
+///
+/// Handlers run on the reactor's threads, so they should do the camera's work and return -
+/// a handler that blocks holds up the other cameras on that thread.
+///
+/// If the fd reports an error or hangup, or its handler throws, the fd fails: it isn't
+/// re-armed, and its failure handler is called instead.  It stays added until Remove().
+class CaptureReactor
+{
+ public:
+  /// Called when the fd is readable
+  typedef std::function<void()> Handler;
+
+  /// Called once when the fd fails, on the reactor thread.  May call Remove().
+  /// \param reason - what went wrong
+  typedef std::function<void(const std::string& reason)> FailureHandler;
+
+  /// Ctor - starts the threads
+  /// \param num_threads - threads waiting on the epoll instance
+  explicit CaptureReactor(size_t num_threads = 1);
+
+  /// Dtor - stops the threads.  Remove() everything first.
+  ~CaptureReactor();
+
+  CaptureReactor(const CaptureReactor&)            = delete;
+  CaptureReactor& operator=(const CaptureReactor&) = delete;
+
+  /// Reactor shared by the process, with a thread per 2 cores (1 to 4 threads)
+  static std::shared_ptr<CaptureReactor> Shared();
+
+  /// Starts watching an fd
+  /// \param fd - file descriptor to wait on, e.g. a V4L2 device
+  /// \param handler - called on a reactor thread when it's readable
+  /// \param on_failure - called if the fd fails, optional
+  void Add(int fd, Handler handler, FailureHandler on_failure = {});
+
+  /// Stops watching an fd, waiting for its handler to finish if it's running on another
+  /// thread.  Safe to call from the fd's own handler.
+  /// \param fd - file descriptor from Add()
+  void Remove(int fd);
+
+  /// Number of fds being watched
+  size_t size() const;
+
+  /// Number of threads
+  size_t threads() const
+  {
+    return threads_.size();
+  }
+
+  /// Handler calls so far
+  uint64_t handled() const
+  {
+    return handled_;
+  }
+
+  /// Fds that have failed so far
+  uint64_t failures() const
+  {
+    return failures_;
+  }
+
+ protected:
+  /// A watched fd
+  struct Entry
+  {
+    int fd;                     ///< File descriptor
+    uint64_t id;                ///< Registration id, in the epoll data
+    Handler handler;            ///< Called when readable
+    FailureHandler on_failure;  ///< Called when it fails
+    bool running;               ///< Handler is running
+    bool removed;               ///< Remove() was called - don't re-arm
+    bool failed;                ///< Errored or its handler threw - don't re-arm
+    std::thread::id thread;     ///< Thread running the handler
+  };
+
+  /// Thread function - waits for ready fds and runs their handlers
+  void WorkerThread();
+
+  int epoll_fd_;                      ///< epoll instance
+  int wake_fd_;                       ///< eventfd that stops the threads
+  std::vector<std::thread> threads_;  ///< Worker threads
+  std::atomic<uint64_t> handled_;     ///< Handler calls
+  std::atomic<uint64_t> failures_;    ///< Fds that failed
+
+  mutable std::mutex mutex_;                            ///< Protects entries_
+  std::condition_variable cv_;                          ///< Signalled when a handler returns
+  std::map<uint64_t, std::shared_ptr<Entry>> entries_;  ///< Watched fds by id
+  uint64_t next_id_;                                    ///< Id for the next Add()
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_CAPTURE_REACTOR_HPP_
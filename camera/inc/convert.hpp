@@ -4,10 +4,11 @@
 #define LIGHTBOX_CAMERA_CONVERT_HPP_
 
 #include <algorithm>
+#include <cstdint>
+#include "camera_frame.hpp"
 
 namespace zebral
 {
-class CameraFrame;
 
 #pragma pack(push, 1)
 struct fmt_YUY2
@@ -75,6 +76,10 @@ void YUY2ToBGRRow(const uint8_t* src, uint8_t* dst, int width);
 /// Convert a row of NV12
 void NV12ToBGRRow(const uint8_t* src_ptr_y, const uint8_t* src_ptr_uv, uint8_t* dst_ptr, int width);
 
+/// Convert a row of I420 (separate Y, U and V planes)
+void I420ToBGRRow(const uint8_t* src_ptr_y, const uint8_t* src_ptr_u, const uint8_t* src_ptr_v,
+                  uint8_t* dst_ptr, int width);
+
 /// Converts a row of BGRA
 void BGRAToBGRRow(const uint8_t* src, uint8_t* dst, int width);
 
@@ -82,10 +87,31 @@ void BGRAToBGRRow(const uint8_t* src, uint8_t* dst, int width);
 void YUY2ToBGRFrame(const uint8_t* src, CameraFrame& frame, int stride);
 /// Converts a frame of NV12 into an existing CameraFrame
 void NV12ToBGRFrame(const uint8_t* src, CameraFrame& frame, int stride);
+/// Converts a frame of I420 into an existing CameraFrame
+void I420ToBGRFrame(const uint8_t* src, CameraFrame& frame, int stride);
 /// Converts BGRA to BGR in an existing frame
 void BGRAToBGRFrame(const uint8_t* src, CameraFrame& frame, int stride);
 void JPEGToBGRFrame(const uint8_t* src, size_t length, CameraFrame& frame, int stride);
 
+/// View converters - these work on any rectangle of a frame or an external buffer.
+/// Source and destination views must be the same size in pixels.
+///
+/// Converts a view of YUY2 (width in pixels, not bytes) into a BGR view
+void YUY2ToBGRFrame(const FrameView& src, const MutableFrameView& dst);
+/// Converts NV12 from separate Y and UV plane views into a BGR view.
+/// The UV view is half width/height of the Y view, with 2 channels.
+void NV12ToBGRFrame(const FrameView& src_y, const FrameView& src_uv, const MutableFrameView& dst);
+/// Converts I420 from separate Y, U and V plane views into a BGR view.
+/// The U and V views are half width/height of the Y view.
+void I420ToBGRFrame(const FrameView& src_y, const FrameView& src_u, const FrameView& src_v,
+                    const MutableFrameView& dst);
+/// Converts a planar (NV12 or I420) CameraFrame into a BGR view
+void PlanarYUVToBGRFrame(const CameraFrame& src, const MutableFrameView& dst);
+/// Converts a BGRA view into a BGR view
+void BGRAToBGRFrame(const FrameView& src, const MutableFrameView& dst);
+/// Copies a view into another of the same pixel layout
+void GreyToFrame(const FrameView& src, const MutableFrameView& dst);
+
 /// Creates a frame and converts YUY2 into it
 CameraFrame YUY2ToBGRFrame(const uint8_t* src, int width, int height, int stride);
 /// Creates a frame and converts NV12 into it
@@ -94,6 +120,24 @@ CameraFrame NV12ToBGRFrame(const uint8_t* src, int width, int height, int stride
 CameraFrame BGRAToBGRFrame(const uint8_t* src, int width, int height, int stride);
 CameraFrame JPEGToBGRFrame(const uint8_t* src, size_t length, int width, int height, int stride);
 
+/// Decodes a raw camera buffer into a frame using the converter from the pixel format table.
+/// The frame must already be sized for the decoded format.
+/// \param src - raw buffer from the camera
+/// \param length - length of the raw buffer in bytes (used by compressed formats)
+/// \param format - traits of the raw buffer's pixel format
+/// \param frame - frame to decode into
+/// \param stride - bytes per row of the first plane of src, or 0 if unpadded.
+/// \returns bool - false if we don't have a converter for the format
+bool DecodeToFrame(const uint8_t* src, size_t length, const PixelFormatInfo& format,
+                   CameraFrame& frame, int stride = 0);
+
+/// Decodes a raw frame (tagged with its pixel format, e.g. from DecodeType::NONE or
+/// DEFERRED) into its decoded format from the pixel format table, resizing out as needed.
+/// \param raw - raw frame
+/// \param out - frame to decode into
+/// \returns bool - false if we don't have a converter for the format
+bool DecodeFrame(const CameraFrame& raw, CameraFrame& out);
+
 void GreyRow(const uint8_t* src, uint8_t* dst, int stride);
 void GreyToFrame(const uint8_t* src, CameraFrame& out, int stride);
 CameraFrame Grey16ToFrame(const uint8_t* src, int width, int height, int stride);
@@ -0,0 +1,80 @@
+/// \file executor.hpp
+/// Executors for running frame callbacks off of the capture thread
+#ifndef LIGHTBOX_CAMERA_EXECUTOR_HPP_
+#define LIGHTBOX_CAMERA_EXECUTOR_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zebral
+{
+/// Runs tasks - inline, or on other threads.
+class Executor
+{
+ public:
+  virtual ~Executor() = default;
+
+  /// Runs or queues a task
+  /// \param task - task to run
+  virtual void Post(std::function<void()> task) = 0;
+
+  /// True if Post() runs tasks on the calling thread
+  virtual bool IsInline() const
+  {
+    return false;
+  }
+
+  /// Executor that runs tasks on the calling thread
+  static std::shared_ptr<Executor> Inline();
+
+  /// Pool shared by the process, with a thread per core.
+  /// Tasks from one source may run concurrently on it.
+  static std::shared_ptr<Executor> SharedPool();
+};
+
+/// Runs tasks immediately on the calling thread
+class InlineExecutor : public Executor
+{
+ public:
+  void Post(std::function<void()> task) override
+  {
+    task();
+  }
+
+  bool IsInline() const override
+  {
+    return true;
+  }
+};
+
+/// Runs tasks on its own threads.  With one thread, tasks run in the order posted.
+class ThreadPoolExecutor : public Executor
+{
+ public:
+  /// Ctor - starts the threads
+  /// \param num_threads - number of threads (1 for a dedicated thread)
+  explicit ThreadPoolExecutor(size_t num_threads = 1);
+
+  /// Dtor - finishes queued tasks, then stops the threads
+  ~ThreadPoolExecutor() override;
+
+  void Post(std::function<void()> task) override;
+
+ protected:
+  /// Thread function - runs queued tasks
+  void WorkerThread();
+
+  std::mutex mutex_;                         ///< Protects the queue
+  std::condition_variable cv_;               ///< Signalled when a task is queued
+  std::deque<std::function<void()>> tasks_;  ///< Queued tasks
+  bool exiting_;                             ///< Set to stop the threads
+  std::vector<std::thread> threads_;         ///< Worker threads
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_EXECUTOR_HPP_
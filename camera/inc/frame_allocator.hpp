@@ -0,0 +1,137 @@
+/// \file frame_allocator.hpp
+/// Allocator for CameraFrame storage, optionally backed by huge pages
+#ifndef LIGHTBOX_CAMERA_FRAME_ALLOCATOR_HPP_
+#define LIGHTBOX_CAMERA_FRAME_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace zebral
+{
+class FrameAccount;
+
+/// What memory frames should be stored in.
+///
+/// With several large (4K / 12MP) streams, the converter and copy loops spend a lot of time
+/// on TLB misses with 4KB pages.  HUGE_PAGES asks for 2MB pages for large frames: explicit
+/// huge pages (MAP_HUGETLB) if any are reserved, otherwise transparent huge pages (2MB
+/// aligned and madvise(MADV_HUGEPAGE)).  If neither is available, or on other platforms,
+/// it falls back to normal allocation.
+enum class FrameMemory
+{
+  DEFAULT,    ///< Normal heap allocation
+  HUGE_PAGES  ///< 2MB pages for allocations of at least kHugePageSize
+};
+
+/// Size of a huge page, and the smallest allocation we'll use them for
+static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+/// Counters for how frame allocations were satisfied, for checking the system setup
+struct FrameMemoryStats
+{
+  uint64_t explicit_huge;     ///< Allocations from reserved huge pages (MAP_HUGETLB)
+  uint64_t transparent_huge;  ///< Allocations advised for transparent huge pages
+  uint64_t fallback;          ///< Huge page requests that got normal pages
+};
+
+/// Sets the memory used by frames created from now on (frames keep what they were created with).
+/// \param memory - memory type for new frames
+void SetDefaultFrameMemory(FrameMemory memory);
+
+/// Retrieves the memory used by new frames
+/// \returns FrameMemory - memory type for new frames
+FrameMemory GetDefaultFrameMemory();
+
+/// Retrieves the huge page allocation counters
+/// \returns FrameMemoryStats - counts since startup
+FrameMemoryStats GetFrameMemoryStats();
+
+/// Allocates frame memory. Huge page allocations are 2MB aligned.
+/// Throws std::bad_alloc on failure.
+/// \param bytes - bytes to allocate
+/// \param memory - type of memory
+/// \param account - if not null, the bytes are charged to this account in the FrameBudget
+/// \returns void* - allocated memory
+void* AllocateFrameMemory(size_t bytes, FrameMemory memory, FrameAccount* account = nullptr);
+
+/// Frees memory from AllocateFrameMemory. bytes, memory and account must match the allocation.
+/// \param ptr - memory to free
+/// \param bytes - bytes allocated
+/// \param memory - type of memory
+/// \param account - account the bytes were charged to, or null
+void FreeFrameMemory(void* ptr, size_t bytes, FrameMemory memory,
+                     FrameAccount* account = nullptr);
+
+/// Standard allocator for frame storage.
+/// It's stateful - each allocator remembers its memory type and the FrameAccount (if any)
+/// its allocations are charged to.  Memory is always freed the way it was allocated.
+///
+/// Copy-assigning a frame keeps the destination's allocator, so copying a camera's frame
+/// into a consumer's frame charges the consumer's account.  Copy construction and moves take
+/// the source's allocator along.
+template <class T>
+class FrameAllocator
+{
+ public:
+  using value_type                             = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap            = std::true_type;
+
+  /// Allocator using the current default memory type, not charged to an account
+  FrameAllocator() noexcept : memory_(GetDefaultFrameMemory()) {}
+
+  /// Allocator using a specific memory type, optionally charged to an account
+  explicit FrameAllocator(FrameMemory memory,
+                          std::shared_ptr<FrameAccount> account = nullptr) noexcept
+      : memory_(memory),
+        account_(std::move(account))
+  {
+  }
+
+  /// Rebinding copy ctor
+  template <class U>
+  FrameAllocator(const FrameAllocator<U>& other) noexcept
+      : memory_(other.memory()),
+        account_(other.account())
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(AllocateFrameMemory(n * sizeof(T), memory_, account_.get()));
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept
+  {
+    FreeFrameMemory(ptr, n * sizeof(T), memory_, account_.get());
+  }
+
+  /// Memory type of this allocator
+  FrameMemory memory() const noexcept
+  {
+    return memory_;
+  }
+
+  /// Account allocations are charged to, may be null
+  const std::shared_ptr<FrameAccount>& account() const noexcept
+  {
+    return account_;
+  }
+
+  template <class U>
+  bool operator==(const FrameAllocator<U>& other) const noexcept
+  {
+    return (memory_ == other.memory()) && (account_ == other.account());
+  }
+
+ private:
+  FrameMemory memory_;                     ///< Memory type to allocate
+  std::shared_ptr<FrameAccount> account_;  ///< Account to charge, or null
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_ALLOCATOR_HPP_
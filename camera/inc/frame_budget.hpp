@@ -0,0 +1,211 @@
+/// \file frame_budget.hpp
+/// Process-wide accounting and limits for frame buffer memory
+#ifndef LIGHTBOX_CAMERA_FRAME_BUDGET_HPP_
+#define LIGHTBOX_CAMERA_FRAME_BUDGET_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "camera_frame.hpp"
+
+namespace zebral
+{
+/// What to do when a new frame would put us over the frame budget
+enum class BudgetPolicy
+{
+  DROP_OLDEST,  ///< Drop the oldest queued frames (from registered FrameHolders) to make room
+  REFUSE_NEW,   ///< Don't deliver the new frame
+  BLOCK         ///< Block the capture thread until there's room (or the block timeout)
+};
+
+/// Frame memory charged to one owner - a camera, or a consumer of its frames.
+/// Frames are charged through their FrameAllocator, so every allocation and free is counted.
+class FrameAccount
+{
+ public:
+  /// Ctor - use FrameBudget::GetAccount() rather than making these directly.
+  /// \param name - name of the account
+  explicit FrameAccount(const std::string& name);
+
+  /// Name of the account
+  const std::string& name() const
+  {
+    return name_;
+  }
+
+  /// Bytes currently allocated to the account
+  size_t bytes() const
+  {
+    return bytes_;
+  }
+
+  /// Highest bytes allocated to the account at once
+  size_t peak_bytes() const
+  {
+    return peak_bytes_;
+  }
+
+  /// Frames the account's holders dropped to stay in budget
+  uint64_t dropped() const
+  {
+    return dropped_;
+  }
+
+  /// Frames refused because the budget was full
+  uint64_t refused() const
+  {
+    return refused_;
+  }
+
+  /// Charges an allocation to the account (called by the allocator)
+  void Charge(size_t bytes);
+
+  /// Releases an allocation from the account (called by the allocator)
+  void Release(size_t bytes);
+
+  /// Counts a frame dropped by one of the account's holders
+  void CountDropped()
+  {
+    ++dropped_;
+  }
+
+  /// Counts a frame refused for the account
+  void CountRefused()
+  {
+    ++refused_;
+  }
+
+ private:
+  std::string name_;                ///< Account name
+  std::atomic<size_t> bytes_;       ///< Current bytes
+  std::atomic<size_t> peak_bytes_;  ///< Peak bytes
+  std::atomic<uint64_t> dropped_;   ///< Frames dropped by holders
+  std::atomic<uint64_t> refused_;   ///< Frames refused
+};
+
+/// Something that queues frames and can give up its oldest one to stay in budget.
+/// Register these with FrameBudget::RegisterHolder() for the DROP_OLDEST policy.
+class FrameHolder
+{
+ public:
+  virtual ~FrameHolder() = default;
+
+  /// Timestamp of the oldest frame held, or empty if none can be dropped
+  virtual std::optional<TimeStamp> OldestFrameTime() = 0;
+
+  /// Drops the oldest frame held
+  /// \returns size_t - bytes freed
+  virtual size_t DropOldestFrame() = 0;
+};
+
+/// Usage of one account
+struct FrameAccountUsage
+{
+  std::string name;   ///< Account name
+  size_t bytes;       ///< Current bytes
+  size_t peak_bytes;  ///< Peak bytes
+  uint64_t dropped;   ///< Frames dropped by the account's holders
+  uint64_t refused;   ///< Frames refused
+};
+
+/// Snapshot of the frame budget
+struct FrameBudgetUsage
+{
+  size_t limit;                             ///< Budget in bytes, 0 for unlimited
+  BudgetPolicy policy;                      ///< What happens when the budget is full
+  size_t bytes;                             ///< Bytes in all accounts
+  size_t peak_bytes;                        ///< Peak bytes in all accounts
+  std::vector<FrameAccountUsage> accounts;  ///< Usage of each live account
+};
+
+/// Process-wide frame memory budget.
+///
+/// Cameras charge their buffers to an account named after the camera, and frames handed out
+/// to consumers are charged to the consumer's account.  When a budget is set and a new frame
+/// would go over it, cameras apply the policy before delivering the frame.
+class FrameBudget
+{
+ public:
+  /// The budget
+  static FrameBudget& Instance();
+
+  /// Retrieves an account by name, creating it if needed.
+  /// Accounts live as long as someone (usually a frame allocator) holds them.
+  /// \param name - account name
+  /// \returns std::shared_ptr<FrameAccount> - account
+  std::shared_ptr<FrameAccount> GetAccount(const std::string& name);
+
+  /// Sets the budget
+  /// \param bytes - maximum frame bytes for the process, 0 for unlimited.
+  void SetLimit(size_t bytes);
+
+  /// Sets what happens when the budget is full
+  /// \param policy - policy to apply
+  /// \param block_timeout - how long BLOCK waits before refusing the frame
+  void SetPolicy(BudgetPolicy policy,
+                 std::chrono::milliseconds block_timeout = std::chrono::milliseconds(1000));
+
+  /// Registers a frame holder for DROP_OLDEST.  It's forgotten once it's destroyed.
+  /// \param holder - holder of frames
+  void RegisterHolder(std::weak_ptr<FrameHolder> holder);
+
+  /// Checks if there is room for a new frame, applying the policy if there isn't.
+  /// Called by cameras before delivering a frame.
+  /// \param bytes - size of the new frame
+  /// \param account - account the frame is for (counts refusals)
+  /// \returns true if the frame may be delivered, false if it was refused.
+  bool Admit(size_t bytes, FrameAccount& account);
+
+  /// Bytes charged to all accounts
+  size_t GetBytes() const
+  {
+    return bytes_;
+  }
+
+  /// Snapshot of the budget and all live accounts
+  FrameBudgetUsage GetUsage();
+
+ protected:
+  friend class FrameAccount;
+
+  FrameBudget();
+
+  /// Account has charged bytes
+  void OnCharge(size_t bytes);
+
+  /// Account has released bytes
+  void OnRelease(size_t bytes);
+
+  /// Drops the oldest frames from holders until the new frame fits.
+  /// \returns true if it fits now
+  bool DropOldest(size_t bytes);
+
+  /// True if a frame of this size fits
+  bool Fits(size_t bytes) const
+  {
+    size_t limit = limit_;
+    return (0 == limit) || (bytes_ + bytes <= limit);
+  }
+
+  std::atomic<size_t> limit_;                ///< Budget, 0 is unlimited
+  std::atomic<BudgetPolicy> policy_;         ///< Policy when full
+  std::atomic<size_t> bytes_;                ///< Bytes in all accounts
+  std::atomic<size_t> peak_bytes_;           ///< Peak of bytes_
+  std::atomic<int> waiters_;                 ///< Threads blocked in Admit()
+  std::chrono::milliseconds block_timeout_;  ///< Max time to block in Admit()
+  std::mutex mutex_;                         ///< Protects the maps, and for cv_
+  std::condition_variable cv_;               ///< Signalled on release if blocked
+
+  std::map<std::string, std::weak_ptr<FrameAccount>> accounts_;  ///< Accounts by name
+  std::vector<std::weak_ptr<FrameHolder>> holders_;              ///< Holders for DROP_OLDEST
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_BUDGET_HPP_
@@ -0,0 +1,71 @@
+/// \file frame_loan.hpp
+/// Zero-copy access to a frame still in the driver's capture buffer
+#ifndef LIGHTBOX_CAMERA_FRAME_LOAN_HPP_
+#define LIGHTBOX_CAMERA_FRAME_LOAN_HPP_
+
+#include <functional>
+#include <memory>
+
+#include "camera_frame.hpp"
+#include "camera_info.hpp"
+
+namespace zebral
+{
+/// Gives a lent buffer back to its owner when destroyed
+class LoanLease
+{
+ public:
+  /// Ctor
+  /// \param release - returns the buffer, e.g. requeues it with the driver.  Called once,
+  ///                  from whichever thread lets go of the lease last.
+  explicit LoanLease(std::function<void()> release) : release_(std::move(release)) {}
+
+  /// Dtor - releases the buffer.  Errors are logged, not thrown.
+  ~LoanLease();
+
+  LoanLease(const LoanLease&)            = delete;
+  LoanLease& operator=(const LoanLease&) = delete;
+
+ protected:
+  std::function<void()> release_;  ///< Returns the buffer
+};
+
+/// A raw frame lent straight from the driver's buffer, without copying it - see
+/// Camera::SetLoanCallback().
+///
+/// The data is read-only and only valid while the loan is held.  The buffer goes back to the
+/// driver when the last copy of the loan is destroyed (or Release()d), and while it's out,
+/// the driver has one fewer buffer to capture into - so hand it to whatever consumes it and
+/// let go promptly.
+struct FrameLoan
+{
+  const uint8_t* data = nullptr;               ///< Start of the driver's buffer
+  size_t size         = 0;                     ///< Bytes the driver filled
+  PixelFormat format  = PixelFormat::UNKNOWN;  ///< Format of the buffer
+  FrameView view;                              ///< First plane's pixels, empty if compressed
+  TimeStamp timestamp;                         ///< Driver timestamp
+  FrameTiming timing;                          ///< Dequeued, and published when it was lent
+  uint64_t hw_sequence = 0;                    ///< Driver's sequence number
+  int dmabuf_fd        = -1;                   ///< Buffer as a dmabuf, see SetDmabufExport()
+  std::shared_ptr<const LoanLease> lease;      ///< Returns the buffer when the last copy goes
+
+  /// True if the loan holds a buffer
+  explicit operator bool() const
+  {
+    return lease != nullptr;
+  }
+
+  /// Gives the buffer back now, rather than when the loan is destroyed
+  void Release()
+  {
+    *this = FrameLoan();
+  }
+};
+
+/// Loan callback
+/// \param info - camera the frame is from
+/// \param loan - the lent frame. Keep (or move) it to hold on to the buffer past the call.
+typedef std::function<void(const CameraInfo& info, FrameLoan loan)> FrameLoanCallback;
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_LOAN_HPP_
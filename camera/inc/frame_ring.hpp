@@ -0,0 +1,178 @@
+/// \file frame_ring.hpp
+/// Lock-free ring of published frames, shared between a capture thread and readers
+#ifndef LIGHTBOX_CAMERA_FRAME_RING_HPP_
+#define LIGHTBOX_CAMERA_FRAME_RING_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "camera_frame.hpp"
+
+namespace zebral
+{
+/// Decoded versions of a raw frame in the ring, made on first use and shared by all readers.
+/// Cleared when the ring reuses the raw frame; decoded frames still held by readers stay valid.
+class FrameDecodeCache
+{
+ public:
+  /// Sets the allocator for decoded frames
+  void SetAllocator(const FrameAllocator<uint8_t>& allocator);
+
+  /// Retrieves the raw frame in a format, decoding it the first time.
+  /// Throws ZBA_UNSUPPORTED_FMT if we can't decode to the format.
+  /// \param raw - raw frame the cache belongs to
+  /// \param format - format wanted, PixelFormat::UNKNOWN for the raw format's decoded format
+  /// \returns std::shared_ptr<const CameraFrame> - frame in that format
+  std::shared_ptr<const CameraFrame> Get(const std::shared_ptr<const CameraFrame>& raw,
+                                         PixelFormat format = PixelFormat::UNKNOWN);
+
+  /// Forgets decoded frames (the raw frame is being reused)
+  void Clear();
+
+ protected:
+  /// A decoded frame
+  struct Entry
+  {
+    PixelFormat format;                  ///< Format of the frame
+    bool valid;                          ///< False once cleared, until decoded again
+    std::shared_ptr<CameraFrame> frame;  ///< Decoded frame, reused when readers let go
+  };
+
+  std::mutex mutex_;                   ///< Held while decoding, so each format decodes once
+  std::vector<Entry> entries_;         ///< Decoded frames
+  FrameAllocator<uint8_t> allocator_;  ///< Allocator for decoded frames
+};
+
+/// A published frame and its sequence number.
+/// The frame is shared, not copied - it stays valid (and isn't reused) while the handle is held.
+/// With DecodeType::DEFERRED the frame is raw; Decoded() converts it on first use.
+struct FrameHandle
+{
+  uint64_t sequence = 0;                         ///< Sequence number, 1 for the first frame
+  std::shared_ptr<const CameraFrame> frame;      ///< The frame, null if none
+  std::shared_ptr<FrameDecodeCache> cache = {};  ///< Decoded versions of frame, if from a ring
+
+  /// True if the handle has a frame
+  explicit operator bool() const
+  {
+    return frame != nullptr;
+  }
+
+  /// Retrieves the frame decoded, converting (and caching) it if it's raw.
+  /// \param format - format wanted, PixelFormat::UNKNOWN for the usual decoded format
+  /// \returns std::shared_ptr<const CameraFrame> - decoded frame, or the frame itself if it
+  ///          doesn't need decoding.
+  std::shared_ptr<const CameraFrame> Decoded(PixelFormat format = PixelFormat::UNKNOWN) const;
+};
+
+/// Ring of the most recently published frames, with sequence numbers.
+///
+/// One producer (the capture thread) fills frames from a pool and publishes them; any number
+/// of readers can get the latest frame or the next one after a sequence number.  Neither side
+/// takes a lock: slots are atomic (sequence, pool index) pairs, readers pin the pool frame and
+/// re-check the slot, and the producer only reuses pool frames that are out of the ring and
+/// not pinned by a reader.  Readers waiting for a new frame block on a condition variable,
+/// which the producer only signals if someone is waiting.
+class FrameRing
+{
+ public:
+  /// Most frames we'll keep in the pool (in the ring + held by readers)
+  static constexpr size_t kMaxPoolFrames = 32;
+
+  /// Default number of frames kept in the ring
+  static constexpr size_t kDefaultCapacity = 4;
+
+  /// Ctor
+  /// \param capacity - number of recent frames readers can get by sequence number
+  explicit FrameRing(size_t capacity = kDefaultCapacity);
+
+  /// Sets the allocator for pool frames (e.g. to charge a camera's FrameAccount).
+  /// Call before anything is published.
+  /// \param allocator - allocator for pool frame data
+  void SetAllocator(const FrameAllocator<uint8_t>& allocator);
+
+  /// Producer only. Gets a pool frame that nobody else is using to fill in.
+  /// \returns std::shared_ptr<CameraFrame> - frame to fill, null if the pool is exhausted
+  ///          because readers are holding on to all of the frames.
+  std::shared_ptr<CameraFrame> AcquireFrame();
+
+  /// Producer only. Publishes the frame from the last AcquireFrame().
+  /// \returns uint64_t - sequence number of the frame
+  uint64_t Publish();
+
+  /// Producer only. Handle to the frame from the last Publish().
+  FrameHandle LastPublished() const;
+
+  /// Sequence number of the latest frame, 0 if none
+  uint64_t LatestSequence() const
+  {
+    return head_;
+  }
+
+  /// Retrieves the latest frame
+  /// \returns FrameHandle - latest frame, empty if none
+  FrameHandle Latest() const;
+
+  /// Retrieves the first frame after a sequence number, waiting for it if needed.
+  /// If the readers fell behind and the next frame has been overwritten, this returns the
+  /// oldest frame still in the ring.
+  /// \param sequence - sequence number already seen (0 for any frame)
+  /// \param timeout - how long to wait
+  /// \returns FrameHandle - frame, or empty on timeout
+  FrameHandle Next(uint64_t sequence, std::chrono::milliseconds timeout);
+
+  /// Frames that couldn't be published because the pool was exhausted
+  uint64_t Exhausted() const
+  {
+    return exhausted_;
+  }
+
+ protected:
+  /// Retrieves a frame by sequence number if it's still in the ring
+  FrameHandle Get(uint64_t sequence) const;
+
+  /// A pool frame, and how many handles to it readers hold
+  struct PoolFrame
+  {
+    explicit PoolFrame(const FrameAllocator<uint8_t>& allocator) : frame(allocator), pins(0) {}
+
+    CameraFrame frame;      ///< Frame data
+    std::atomic<int> pins;  ///< Readers' handles not yet released
+  };
+
+  /// Wraps a pool frame the caller has already pinned in a handle that unpins it
+  FrameHandle MakeHandle(uint64_t sequence, size_t index) const;
+
+  /// Packs a sequence number and pool index into a slot value
+  static uint64_t Pack(uint64_t sequence, size_t index)
+  {
+    return (sequence << 8) | index;
+  }
+
+  size_t capacity_;                           ///< Slots in the ring
+  std::vector<std::atomic<uint64_t>> slots_;  ///< (sequence << 8 | pool index), 0 if empty
+
+  /// Pool of frames, created as needed. Entries are never replaced once set.
+  std::array<std::shared_ptr<PoolFrame>, kMaxPoolFrames> pool_;
+
+  /// Decoded versions of each pool frame
+  std::array<std::shared_ptr<FrameDecodeCache>, kMaxPoolFrames> caches_;
+
+  std::vector<size_t> slot_frames_;    ///< Producer's copy of the pool index in each slot
+  size_t pool_size_;                   ///< Pool frames created (producer only)
+  size_t acquired_;                    ///< Pool index from AcquireFrame()
+  FrameAllocator<uint8_t> allocator_;  ///< Allocator for pool frames
+  std::atomic<uint64_t> head_;         ///< Latest sequence published
+  std::atomic<uint64_t> exhausted_;    ///< Frames dropped for lack of pool frames
+  std::atomic<int> waiters_;           ///< Readers blocked in Next()
+  std::mutex mutex_;                   ///< Lock for cv_ only
+  std::condition_variable cv_;         ///< Signalled on publish if there are waiters
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_RING_HPP_
@@ -0,0 +1,207 @@
+/// \file frame_share.hpp
+/// Sharing lent frames with other processes as dmabufs over a Unix socket (Linux)
+#ifndef LIGHTBOX_CAMERA_FRAME_SHARE_HPP_
+#define LIGHTBOX_CAMERA_FRAME_SHARE_HPP_
+
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "frame_loan.hpp"
+
+namespace zebral
+{
+/// Sent with each shared frame's file descriptor
+struct SharedFrameInfo
+{
+  uint64_t id          = 0;  ///< Publisher's id for the frame, to release it
+  uint64_t hw_sequence = 0;  ///< Driver's sequence number
+  int64_t timestamp_ns = 0;  ///< Driver timestamp - CLOCK_MONOTONIC, the same in every process
+  uint64_t size        = 0;  ///< Bytes of frame data
+  uint32_t format      = 0;  ///< PixelFormat (FourCC)
+  int32_t width        = 0;  ///< Width in pixels, 0 if compressed
+  int32_t height       = 0;  ///< Height in pixels, 0 if compressed
+  uint32_t stride      = 0;  ///< Bytes between rows, 0 if compressed
+};
+
+/// Publishes lent frames to other processes without copying them: each frame's dmabuf fd
+/// is passed (SCM_RIGHTS) with its SharedFrameInfo to every connected FrameShareClient.
+/// The loan - and so the driver's buffer - is held until every client it went to releases
+/// it or disconnects.
+///
+///   camera->SetBufferCount(6);
+///   camera->SetDmabufExport(true);
+///   camera->SetFormat(mode, Camera::DecodeType::NONE);
+///   FrameSharePublisher publisher("/run/zebral/cam0.sock");
+///   camera->SetLoanCallback(publisher.LoanCallback(), 4);
+///
+/// A client holding max_pending frames is skipped until it releases one, so a stalled
+/// reader can't starve the driver.
+class FrameSharePublisher
+{
+ public:
+  /// Ctor - listens on a Unix socket
+  /// \param path - socket path. An existing socket there is replaced; anything else there
+  ///               is an error.
+  /// \param max_pending - most frames a client may hold at once
+  explicit FrameSharePublisher(const std::string& path, size_t max_pending = 2);
+
+  /// Dtor - disconnects clients, releases their frames, and removes the socket if it's
+  /// still the one we bound
+  ~FrameSharePublisher();
+
+  FrameSharePublisher(const FrameSharePublisher&)            = delete;
+  FrameSharePublisher& operator=(const FrameSharePublisher&) = delete;
+
+  /// Sends a frame to the clients.  Frames without a dmabuf_fd, or with no clients ready
+  /// for them, are released straight away.
+  /// \param loan - frame to share
+  void Publish(FrameLoan loan);
+
+  /// Loan callback that publishes frames, for Camera::SetLoanCallback().
+  /// It can safely outlive the publisher - once the publisher is destroyed, frames given to
+  /// it are released straight away.
+  FrameLoanCallback LoanCallback();
+
+  /// Clients connected
+  size_t clients() const;
+
+  /// Frames sent to at least one client
+  uint64_t published() const
+  {
+    return published_;
+  }
+
+  /// Frames released without being sent - no dmabuf, or no clients with room
+  uint64_t skipped() const
+  {
+    return skipped_;
+  }
+
+ protected:
+  /// A connected client
+  struct Client
+  {
+    int fd;                   ///< Connection
+    std::set<uint64_t> held;  ///< Frames it hasn't released
+  };
+
+  /// A frame held for clients
+  struct Frame
+  {
+    FrameLoan loan;  ///< The lent buffer
+    size_t holders;  ///< Clients that haven't released it
+  };
+
+  /// Shared with loan callbacks, so they can tell the publisher is gone
+  struct Link
+  {
+    std::mutex mutex;                ///< Held while publishing, and while detaching
+    FrameSharePublisher* publisher;  ///< The publisher, null once destroyed
+  };
+
+  /// Accepts clients and handles their releases and disconnects
+  void Run();
+
+  /// Releases a client's hold on a frame (lock held)
+  void Release(uint64_t id);
+
+  /// Drops a client and its holds (lock held)
+  void Disconnect(std::map<int, Client>::iterator client);
+
+  /// Removes the socket file, if it's still the one we bound
+  void RemoveSocket();
+
+  std::string path_;           ///< Socket path
+  size_t max_pending_;         ///< Most frames a client may hold
+  dev_t socket_dev_;           ///< Device of the socket we bound, to only remove our own
+  ino_t socket_ino_;           ///< Inode of the socket we bound
+  int listen_fd_;              ///< Listening socket
+  int wake_fd_;                ///< eventfd to stop Run()
+  std::atomic<bool> exiting_;  ///< Set to stop Run()
+  std::thread thread_;         ///< Runs Run()
+
+  std::shared_ptr<Link> link_;  ///< Reaches us from loan callbacks
+
+  mutable std::mutex mutex_;          ///< Protects clients_, frames_ and next_id_
+  std::map<int, Client> clients_;     ///< Clients by fd
+  std::map<uint64_t, Frame> frames_;  ///< Frames held by clients, by id
+  uint64_t next_id_;                  ///< Id of the next frame
+
+  std::atomic<uint64_t> published_;  ///< Frames sent
+  std::atomic<uint64_t> skipped_;    ///< Frames not sent
+};
+
+/// A frame received from a FrameSharePublisher - the dmabuf and its info.
+/// Destroying it closes the fd and releases the frame, so the publisher can requeue the
+/// driver's buffer.  Move-only.
+class SharedFrame
+{
+ public:
+  /// Ctor, from FrameShareClient::Receive()
+  SharedFrame(const SharedFrameInfo& info, int fd, std::shared_ptr<const int> socket);
+
+  /// Dtor - unmaps, closes the fd and releases the frame
+  ~SharedFrame();
+
+  SharedFrame(SharedFrame&& other);
+  SharedFrame& operator=(SharedFrame&& other);
+  SharedFrame(const SharedFrame&)            = delete;
+  SharedFrame& operator=(const SharedFrame&) = delete;
+
+  /// Frame info from the publisher
+  const SharedFrameInfo& info() const
+  {
+    return info_;
+  }
+
+  /// The dmabuf, e.g. to import into an encoder or GPU.  Owned by the SharedFrame.
+  int fd() const
+  {
+    return fd_;
+  }
+
+  /// Maps the frame for reading, the first time it's called (bracketing CPU access with
+  /// DMA_BUF_IOCTL_SYNC).  Throws on failure.
+  /// \returns const uint8_t* - frame data, info().size bytes, valid until this is destroyed
+  const uint8_t* Map();
+
+ protected:
+  /// Unmaps, closes and releases
+  void Reset();
+
+  SharedFrameInfo info_;               ///< Frame info
+  int fd_;                             ///< dmabuf, -1 once released
+  std::shared_ptr<const int> socket_;  ///< Client connection, for the release
+  void* map_;                          ///< Mapped data, null if not mapped
+};
+
+/// Connects to a FrameSharePublisher and receives its frames
+class FrameShareClient
+{
+ public:
+  /// Ctor - connects.  Throws if nothing is listening at the path.
+  /// \param path - publisher's socket path
+  explicit FrameShareClient(const std::string& path);
+
+  /// Waits for the next frame.  Release frames promptly - the publisher stops sending
+  /// while a client holds max_pending of them.
+  /// \param timeout - how long to wait
+  /// \returns std::optional<SharedFrame> - the frame, or empty on timeout.  Throws if the
+  ///          publisher went away.
+  std::optional<SharedFrame> Receive(std::chrono::milliseconds timeout);
+
+ protected:
+  std::shared_ptr<const int> socket_;  ///< Connection, closed when the last user lets go
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_SHARE_HPP_
@@ -0,0 +1,155 @@
+/// \file frame_subscriber.hpp
+/// Frame subscribers - consumers with their own queue, drop policy and dispatch thread
+#ifndef LIGHTBOX_CAMERA_FRAME_SUBSCRIBER_HPP_
+#define LIGHTBOX_CAMERA_FRAME_SUBSCRIBER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_frame.hpp"
+#include "camera_info.hpp"
+#include "camera_stats.hpp"
+#include "frame_budget.hpp"
+#include "frame_throttle.hpp"
+
+namespace zebral
+{
+/// Frame callback for hosts
+/// \param info - information about the camera
+/// \param image - CameraFrame containing image.
+typedef std::function<void(const CameraInfo& info, const CameraFrame& image)> FrameCallback;
+
+/// What a subscriber does with a new frame when its queue is full
+enum class SubscriberPolicy
+{
+  LATEST_ONLY,  ///< Only keep the latest frame - the queued one is replaced
+  DROP_OLDEST,  ///< Drop the oldest queued frame
+  BLOCK         ///< Wait for room, up to block_timeout, then drop the new frame.
+                ///< This stalls the camera, and so its other subscribers, while waiting.
+};
+
+/// Options for Camera::Subscribe()
+struct SubscriberOptions
+{
+  SubscriberPolicy policy = SubscriberPolicy::DROP_OLDEST;  ///< Policy when full
+  size_t queue_size       = 4;                              ///< Max frames queued
+  std::chrono::milliseconds block_timeout{1000};            ///< Max wait for BLOCK
+  ThrottleSettings throttle{};                              ///< Which frames to take
+};
+
+/// A consumer of a camera's frames.
+///
+/// The camera queues a shared reference to each frame (no pixels are copied) and returns;
+/// the subscriber's own thread calls its callback.  A slow subscriber only ever fills its own
+/// queue, so it doesn't add latency to other subscribers (unless it uses the BLOCK policy).
+/// Queued frames keep their ring frames pinned, so they're charged to the subscriber's
+/// FrameAccount until the callback is done with them, and may be dropped by the FrameBudget.
+///
+/// Create these with Camera::Subscribe().
+class FrameSubscriber : public FrameHolder, public std::enable_shared_from_this<FrameSubscriber>
+{
+ public:
+  /// Ctor - call Start() once it's owned by a shared_ptr
+  /// \param name - subscriber name, for logging
+  /// \param info - camera info passed to the callback
+  /// \param callback - called for each frame on the subscriber's thread
+  /// \param options - queue size and policy
+  /// \param account - account queued frames are charged to
+  FrameSubscriber(const std::string& name,
+                  const CameraInfo& info,
+                  FrameCallback callback,
+                  const SubscriberOptions& options,
+                  std::shared_ptr<FrameAccount> account);
+
+  /// Dtor
+  ~FrameSubscriber() override;
+
+  /// Starts the dispatch thread, which holds a reference until Stop() is called.
+  void Start();
+
+  /// Stops the dispatch thread, dropping any queued frames.
+  /// Safe to call from the subscriber's own callback.
+  void Stop();
+
+  /// Queues a frame for the subscriber, applying the policy if the queue is full.
+  /// Called on the camera's capture thread.
+  /// \param frame - frame to queue - shared, not copied
+  /// \returns true if the frame was queued
+  bool Push(std::shared_ptr<const CameraFrame> frame);
+
+  /// Subscriber name
+  const std::string& name() const
+  {
+    return name_;
+  }
+
+  /// Frames passed to the callback
+  uint64_t delivered() const
+  {
+    return delivered_;
+  }
+
+  /// Frames dropped by the policy or the FrameBudget
+  uint64_t dropped() const
+  {
+    return dropped_;
+  }
+
+  /// Frames skipped by the subscriber's throttle
+  uint64_t throttled() const
+  {
+    return throttle_.skipped();
+  }
+
+  /// Frames currently queued
+  size_t queued() const;
+
+  /// Latency from the frames' driver timestamps to the start of the callback
+  TimingStats latency() const
+  {
+    return latency_.Snapshot();
+  }
+
+  /// FrameHolder - timestamp of the oldest queued frame
+  std::optional<TimeStamp> OldestFrameTime() override;
+
+  /// FrameHolder - drops the oldest queued frame
+  size_t DropOldestFrame() override;
+
+ protected:
+  /// Dispatch thread - calls the callback for each queued frame
+  void DispatchThread();
+
+  /// Pops the oldest frame off the queue (lock held)
+  /// \returns size_t - bytes released from the account
+  size_t DropFront();
+
+  std::string name_;                       ///< Subscriber name
+  CameraInfo info_;                        ///< Camera info for the callback
+  FrameCallback callback_;                 ///< Frame callback
+  SubscriberOptions options_;              ///< Queue size and policy
+  FrameThrottle throttle_;                 ///< Skips frames we don't want
+  std::shared_ptr<FrameAccount> account_;  ///< Account for queued frames
+  std::atomic<uint64_t> delivered_;        ///< Frames delivered
+  std::atomic<uint64_t> dropped_;          ///< Frames dropped
+  TimingHistogram latency_;                ///< Driver timestamp to callback start
+  bool exiting_;                           ///< Set to stop the dispatch thread
+  mutable std::mutex mutex_;               ///< Protects the queue
+  std::condition_variable frame_cv_;       ///< Signalled when a frame is queued
+  std::condition_variable space_cv_;       ///< Signalled when a frame leaves the queue
+  std::thread thread_;                     ///< Dispatch thread
+
+  /// Frames waiting for the callback, each charged to account_
+  std::deque<std::shared_ptr<const CameraFrame>> queue_;
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_SUBSCRIBER_HPP_
@@ -0,0 +1,79 @@
+/// \file frame_throttle.hpp
+/// Frame-rate decimation and target FPS throttling
+#ifndef LIGHTBOX_CAMERA_FRAME_THROTTLE_HPP_
+#define LIGHTBOX_CAMERA_FRAME_THROTTLE_HPP_
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+
+#include "camera_frame.hpp"
+
+namespace zebral
+{
+/// Which frames to deliver
+struct ThrottleSettings
+{
+  unsigned int every_nth = 1;  ///< Deliver every Nth frame (1 for all)
+  double max_fps         = 0;  ///< Cap the rate at this many frames per second, 0 for no cap
+};
+
+/// Decides which frames to keep, from their (hardware) timestamps.
+///
+/// Decimation keeps every Nth frame.  The FPS cap keeps a schedule of when frames are due,
+/// so the average rate matches the target even when it doesn't divide the camera's rate,
+/// and timestamp jitter doesn't make it skip extra frames.
+class FrameThrottle
+{
+ public:
+  /// Ctor - by default, every frame is accepted
+  /// \param settings - which frames to keep
+  explicit FrameThrottle(const ThrottleSettings& settings = {});
+
+  /// Changes the settings and starts over
+  /// \param settings - which frames to keep
+  void SetSettings(const ThrottleSettings& settings);
+
+  /// Current settings
+  ThrottleSettings GetSettings() const;
+
+  /// True if the settings keep every frame
+  bool IsPassThrough() const
+  {
+    return pass_through_;
+  }
+
+  /// Starts over - the next frame will be accepted
+  void Reset();
+
+  /// Checks if a frame should be kept
+  /// \param timestamp - frame's timestamp (from the hardware if possible)
+  /// \returns true to keep the frame, false to skip it
+  bool Accept(TimeStamp timestamp);
+
+  /// Frames skipped
+  uint64_t skipped() const
+  {
+    return skipped_;
+  }
+
+  /// Clears the skipped count
+  void ResetSkipped()
+  {
+    skipped_ = 0;
+  }
+
+ protected:
+  /// Fraction of the frame interval a frame may be early and still be on time
+  static constexpr double kJitterTolerance = 0.25;
+
+  mutable std::mutex mutex_;           ///< Protects the settings and schedule
+  ThrottleSettings settings_;          ///< Which frames to keep
+  std::atomic<bool> pass_through_;     ///< True if every frame is kept
+  uint64_t count_;                     ///< Frames seen since the last reset
+  std::optional<TimeStamp> next_due_;  ///< When the next frame is due, for max_fps
+  std::atomic<uint64_t> skipped_;      ///< Frames skipped
+};
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_FRAME_THROTTLE_HPP_
@@ -11,6 +11,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include "async.hpp"
 #include "errors.hpp"
 #include "log.hpp"
 
@@ -83,7 +84,7 @@ class Param
     // I don't expect will want to register on top of others...
     // {TODO} decide if this is allowed, add a return code, or
     // a normal throw.
-    ZBA_ASSERT(subscribers_.count(cb) > 0, "Already registered");
+    ZBA_ASSERT(subscribers_.count(cb) == 0, "Already registered");
     subscribers_.insert(cb);
   }
 
@@ -425,6 +426,17 @@ class ParamMenu : public ParamVal<int>
 /// Dumps a shared_ptr<Param> to an ostream. Works for inherited param types.
 std::ostream& operator<<(std::ostream& os, const std::shared_ptr<Param>& param);
 
+/// Awaitable for the next change to a parameter, for coroutines running on an EventLoop.
+/// \param loop - loop the awaiting coroutine runs on
+/// \param param - parameter to watch
+/// \param timeout - how long to wait, 0 for no timeout
+/// \param stop - cancels the wait
+/// \returns AsyncOp<bool> - co_await for true if it changed, false on timeout or cancellation.
+AsyncOp<bool> NextParamChange(EventLoop& loop,
+                              std::shared_ptr<Param> param,
+                              std::chrono::milliseconds timeout = std::chrono::milliseconds(5000),
+                              std::stop_token stop = {});
+
 }  // namespace zebral
 
 #endif  // LIGHTBOX_CAMERA_PARAM_HPP_
\ No newline at end of file
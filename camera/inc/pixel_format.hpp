@@ -0,0 +1,144 @@
+/// \file pixel_format.hpp
+/// Compile-time pixel format traits, looked up by FourCC
+#ifndef LIGHTBOX_CAMERA_PIXEL_FORMAT_HPP_
+#define LIGHTBOX_CAMERA_PIXEL_FORMAT_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace zebral
+{
+/// FourCC for statics (for switch/case and the like)
+constexpr uint32_t FOURCCTOUINT32(char const format[5])
+{
+  return (format[0]) | (format[1] << 8) | (format[2] << 16) | (format[3] << 24);
+}
+
+/// Pixel formats, by FourCC.
+/// This can hold FourCCs that aren't listed - those just have no traits in the table.
+/// Note that Windows and Linux use different codes for some of the same layouts.
+enum class PixelFormat : uint32_t
+{
+  UNKNOWN = 0,
+  YUYV    = FOURCCTOUINT32("YUYV"),  ///< Packed 4:2:2 YUV (Linux)
+  YUY2    = FOURCCTOUINT32("YUY2"),  ///< Packed 4:2:2 YUV (Windows)
+  NV12    = FOURCCTOUINT32("NV12"),  ///< Y plane, then interleaved UV plane, 4:2:0
+  YU12    = FOURCCTOUINT32("YU12"),  ///< Y, U, V planes, 4:2:0 (Linux)
+  I420    = FOURCCTOUINT32("I420"),  ///< Y, U, V planes, 4:2:0 (Windows)
+  MJPG    = FOURCCTOUINT32("MJPG"),  ///< Motion JPEG
+  GREY    = FOURCCTOUINT32("GREY"),  ///< 8-bit greyscale / IR (Linux)
+  L8      = FOURCCTOUINT32("L8  "),  ///< 8-bit greyscale / IR (Windows)
+  Z16     = FOURCCTOUINT32("Z16 "),  ///< 16-bit depth (Linux)
+  D16     = FOURCCTOUINT32("D16 "),  ///< 16-bit depth (Windows)
+  RGB     = FOURCCTOUINT32("RGB "),  ///< Packed 8-bit RGB
+  BGR     = FOURCCTOUINT32("BGR "),  ///< Packed 8-bit BGR (what we decode to)
+  RGBA    = FOURCCTOUINT32("RGBA"),  ///< Packed 8-bit RGBA
+  BGRA    = FOURCCTOUINT32("BGRA"),  ///< Packed 8-bit BGRA
+  RGBT    = FOURCCTOUINT32("RGBT"),  ///< Packed 8-bit RGB + transparency
+  BGRT    = FOURCCTOUINT32("BGRT"),  ///< Packed 8-bit BGR + transparency
+};
+
+/// Which of our converters handles a format
+enum class PixelConverter
+{
+  NONE,         ///< We can't convert it
+  COPY,         ///< Already usable as-is, just copy it
+  YUY2_TO_BGR,  ///< YUY2ToBGRFrame
+  NV12_TO_BGR,  ///< NV12ToBGRFrame
+  I420_TO_BGR,  ///< I420ToBGRFrame
+  BGRA_TO_BGR,  ///< BGRAToBGRFrame
+  JPEG_TO_BGR   ///< JPEGToBGRFrame
+};
+
+/// Layout of one plane of an image, relative to the full image size.
+/// e.g. NV12 is {{1, 1, 1}, {2, 2, 2}} - a full size Y plane, then a half width,
+/// half height plane of interleaved U/V.
+struct PlaneFormat
+{
+  int channels;       ///< Interleaved channels in the plane
+  int x_subsampling;  ///< Horizontal subsampling (1 = full width, 2 = half width)
+  int y_subsampling;  ///< Vertical subsampling (1 = full height, 2 = half height)
+};
+
+/// Maximum number of planes in a pixel format
+static constexpr int kMaxPlanes = 4;
+
+/// Traits of a pixel format
+struct PixelFormatInfo
+{
+  PixelFormat format;         ///< The format (FourCC)
+  int channels;               ///< Channels once decoded (what FormatInfo reports)
+  int bytes_per_component;    ///< Bytes per sample
+  int bits_per_component;     ///< Significant bits per sample
+  int chroma_x_subsampling;   ///< Horizontal chroma subsampling (1 if none)
+  int chroma_y_subsampling;   ///< Vertical chroma subsampling (1 if none)
+  bool packed;                ///< True if the components are interleaved in one plane
+  bool compressed;            ///< True if the buffer is compressed (size varies per frame)
+  PixelConverter converter;   ///< Which converter decodes it
+  PixelFormat decoded;        ///< Format after internal decoding
+  bool capture;               ///< True if we capture this format from cameras
+  int num_planes;             ///< Number of planes in the raw buffer
+  std::array<PlaneFormat, kMaxPlanes> planes;  ///< Layout of the raw buffer's planes
+
+  /// Bytes per row of a plane in an unpadded raw buffer
+  /// \param width - width of the image in pixels
+  /// \param plane - plane index
+  /// \returns size_t - bytes per row of the plane
+  constexpr size_t row_bytes(int width, int plane = 0) const
+  {
+    const auto& p = planes[plane];
+    return static_cast<size_t>((width + p.x_subsampling - 1) / p.x_subsampling) * p.channels *
+           bytes_per_component;
+  }
+};
+
+/// The pixel format table. Entry 0 is the UNKNOWN format, returned for anything not listed.
+inline constexpr std::array<PixelFormatInfo, 17> kPixelFormats = {{
+    // clang-format off
+  // format               ch B  bits sx sy packed compr  converter                     decoded              capture planes
+  {PixelFormat::UNKNOWN,  0, 0, 0,   1, 1, true,  false, PixelConverter::NONE,        PixelFormat::UNKNOWN, false, 0, {}},
+  {PixelFormat::YUYV,     3, 1, 8,   2, 1, true,  false, PixelConverter::YUY2_TO_BGR, PixelFormat::BGR,     true,  1, {{{2, 1, 1}}}},
+  {PixelFormat::YUY2,     3, 1, 8,   2, 1, true,  false, PixelConverter::YUY2_TO_BGR, PixelFormat::BGR,     true,  1, {{{2, 1, 1}}}},
+  {PixelFormat::NV12,     3, 1, 8,   2, 2, false, false, PixelConverter::NV12_TO_BGR, PixelFormat::BGR,     true,  2, {{{1, 1, 1}, {2, 2, 2}}}},
+  {PixelFormat::YU12,     3, 1, 8,   2, 2, false, false, PixelConverter::I420_TO_BGR, PixelFormat::BGR,     true,  3, {{{1, 1, 1}, {1, 2, 2}, {1, 2, 2}}}},
+  {PixelFormat::I420,     3, 1, 8,   2, 2, false, false, PixelConverter::I420_TO_BGR, PixelFormat::BGR,     true,  3, {{{1, 1, 1}, {1, 2, 2}, {1, 2, 2}}}},
+  // Having problems with MJPG on windows, we simply don't get frames - so not captured yet.
+  {PixelFormat::MJPG,     3, 1, 8,   1, 1, true,  true,  PixelConverter::JPEG_TO_BGR, PixelFormat::BGR,     false, 1, {{{1, 1, 1}}}},
+  {PixelFormat::GREY,     1, 1, 8,   1, 1, true,  false, PixelConverter::COPY,        PixelFormat::GREY,    true,  1, {{{1, 1, 1}}}},
+  {PixelFormat::L8,       1, 1, 8,   1, 1, true,  false, PixelConverter::COPY,        PixelFormat::L8,      true,  1, {{{1, 1, 1}}}},
+  {PixelFormat::Z16,      1, 2, 16,  1, 1, true,  false, PixelConverter::COPY,        PixelFormat::Z16,     true,  1, {{{1, 1, 1}}}},
+  {PixelFormat::D16,      1, 2, 16,  1, 1, true,  false, PixelConverter::COPY,        PixelFormat::D16,     true,  1, {{{1, 1, 1}}}},
+  {PixelFormat::RGB,      3, 1, 8,   1, 1, true,  false, PixelConverter::NONE,        PixelFormat::RGB,     false, 1, {{{3, 1, 1}}}},
+  {PixelFormat::BGR,      3, 1, 8,   1, 1, true,  false, PixelConverter::COPY,        PixelFormat::BGR,     false, 1, {{{3, 1, 1}}}},
+  {PixelFormat::RGBA,     4, 1, 8,   1, 1, true,  false, PixelConverter::NONE,        PixelFormat::RGBA,    false, 1, {{{4, 1, 1}}}},
+  {PixelFormat::BGRA,     4, 1, 8,   1, 1, true,  false, PixelConverter::BGRA_TO_BGR, PixelFormat::BGR,     false, 1, {{{4, 1, 1}}}},
+  {PixelFormat::RGBT,     4, 1, 8,   1, 1, true,  false, PixelConverter::NONE,        PixelFormat::RGBT,    false, 1, {{{4, 1, 1}}}},
+  {PixelFormat::BGRT,     4, 1, 8,   1, 1, true,  false, PixelConverter::BGRA_TO_BGR, PixelFormat::BGR,     false, 1, {{{4, 1, 1}}}},
+    // clang-format on
+}};
+
+/// Looks up the traits of a pixel format.
+/// \param format - format to look up
+/// \returns const PixelFormatInfo& - traits, or the UNKNOWN entry if not in the table.
+constexpr const PixelFormatInfo& GetPixelFormatInfo(PixelFormat format)
+{
+  for (const auto& info : kPixelFormats)
+  {
+    if (info.format == format)
+    {
+      return info;
+    }
+  }
+  return kPixelFormats[0];
+}
+
+/// Converts a FourCC string (space padded or not) to a PixelFormat.
+/// Strings longer than 4 characters (e.g. GUIDs) are UNKNOWN.
+PixelFormat PixelFormatFromString(const std::string& fourcc);
+
+/// Converts a PixelFormat back to its (space padded) FourCC string
+std::string PixelFormatToString(PixelFormat format);
+
+}  // namespace zebral
+#endif  // LIGHTBOX_CAMERA_PIXEL_FORMAT_HPP_
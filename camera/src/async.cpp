@@ -0,0 +1,184 @@
+/// \file async.cpp
+/// Implementation of the coroutine event loop
+#include "async.hpp"
+
+#include "log.hpp"
+
+namespace zebral
+{
+/// Coroutine that runs a spawned task, then destroys itself
+struct EventLoop::Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object()
+    {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    std::suspend_always initial_suspend() noexcept
+    {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept
+    {
+      return {};
+    }
+
+    void return_void() {}
+
+    void unhandled_exception()
+    {
+      std::terminate();
+    }
+  };
+
+  std::coroutine_handle<promise_type> handle;  ///< Coroutine, started by Spawn()
+};
+
+EventLoop::EventLoop()
+    : next_timer_(0),
+      next_task_(0),
+      stopping_(false)
+{
+}
+
+EventLoop::~EventLoop()
+{
+  // Destroying a suspended task destroys the coroutines it's awaiting, and their pending
+  // operations cancel their timers - so don't hold the lock while doing it.
+  std::map<uint64_t, std::coroutine_handle<>> spawned;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spawned.swap(spawned_);
+  }
+  for (auto& [id, handle] : spawned)
+  {
+    handle.destroy();
+  }
+}
+
+void EventLoop::Post(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.emplace_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+EventLoop::TimerId EventLoop::PostAt(Clock::time_point when, std::function<void()> task)
+{
+  TimerId timer{when, 0};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer.id = next_timer_++;
+    timers_.emplace(std::make_pair(when, timer.id), std::move(task));
+  }
+  cv_.notify_one();
+  return timer;
+}
+
+void EventLoop::CancelTimer(const TimerId& timer)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  timers_.erase(std::make_pair(timer.when, timer.id));
+}
+
+EventLoop::Detached EventLoop::Drive(EventLoop* loop, Task<void> task, uint64_t id)
+{
+  try
+  {
+    co_await task;
+  }
+  catch (const std::exception& e)
+  {
+    ZBA_ERR("Spawned task threw: {}", e.what());
+  }
+  loop->OnTaskDone(id);
+}
+
+void EventLoop::Spawn(Task<void> task)
+{
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = next_task_++;
+  }
+  auto driver = Drive(this, std::move(task), id);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spawned_.emplace(id, driver.handle);
+  }
+  Post([handle = driver.handle] { handle.resume(); });
+}
+
+void EventLoop::OnTaskDone(uint64_t id)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  spawned_.erase(id);
+}
+
+void EventLoop::Run()
+{
+  RunLoop(false);
+}
+
+void EventLoop::RunUntilComplete()
+{
+  RunLoop(true);
+}
+
+void EventLoop::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+}
+
+void EventLoop::RunLoop(bool until_complete)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_ && !(until_complete && (spawned_.empty())))
+  {
+    // Move timers that are due onto the run queue
+    auto now = Clock::now();
+    while (!timers_.empty() && (timers_.begin()->first.first <= now))
+    {
+      tasks_.emplace_back(std::move(timers_.begin()->second));
+      timers_.erase(timers_.begin());
+    }
+
+    if (tasks_.empty())
+    {
+      if (timers_.empty())
+      {
+        cv_.wait(lock);
+      }
+      else
+      {
+        cv_.wait_until(lock, timers_.begin()->first.first);
+      }
+      continue;
+    }
+
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    try
+    {
+      task();
+    }
+    catch (const std::exception& e)
+    {
+      ZBA_ERR("Event loop task threw: {}", e.what());
+    }
+    lock.lock();
+  }
+  stopping_ = false;
+}
+
+}  // namespace zebral
@@ -1,44 +1,88 @@
 /// \file buffer_memmap.cpp
-/// Implementation of memory mapped buffers for v4l2
+/// Implementation of memory mapped and user pointer buffers for v4l2
 #if __linux__
 
 #include "buffer_memmap.hpp"
 
 #include <linux/videodev2.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
 #include "errors.hpp"
+#include "frame_budget.hpp"
 #include "log.hpp"
 #include "platform.hpp"
 
 namespace zebral
 {
-BufferGroup::BufferGroup(DeviceV4L2Ptr& device, size_t numBuffers) : device_(device)
+BufferGroup::BufferGroup(DeviceV4L2Ptr& device, size_t numBuffers)
+    : device_(device),
+      memory_(V4L2_MEMORY_MMAP),
+      streaming_(true)
+{
+  // Memory map them
+  size_t count = Request(numBuffers);
+  for (size_t i = 0; i < count; ++i)
+  {
+    buffers_.emplace_back(device_, i);
+  }
+}
+
+BufferGroup::BufferGroup(DeviceV4L2Ptr& device, const std::vector<UserBuffer>& userBuffers,
+                         size_t numBuffers, size_t bufferSize,
+                         const FrameAllocator<uint8_t>& allocator)
+    : device_(device),
+      memory_(V4L2_MEMORY_USERPTR),
+      streaming_(true)
+{
+  // Only as many as we have memory for, if it's the caller's.
+  size_t count = Request(userBuffers.empty() ? numBuffers : userBuffers.size());
+  if (!userBuffers.empty()) count = std::min(count, userBuffers.size());
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (userBuffers.empty())
+    {
+      buffers_.emplace_back(device_, i, nullptr, bufferSize, allocator);
+    }
+    else
+    {
+      buffers_.emplace_back(device_, i, userBuffers[i].data, userBuffers[i].size, allocator);
+    }
+  }
+}
+
+size_t BufferGroup::Request(size_t numBuffers)
 {
   // Request buffers
   struct v4l2_requestbuffers reqbuf;
   std::memset(&reqbuf, 0, sizeof(reqbuf));
   reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  reqbuf.memory = V4L2_MEMORY_MMAP;
+  reqbuf.memory = memory_;
   reqbuf.count  = numBuffers;
 
   if (-1 == device_->ioctl(VIDIOC_REQBUFS, &reqbuf))
   {
+    if ((EINVAL == errno) && (memory_ == V4L2_MEMORY_USERPTR))
+    {
+      ZBA_THROW("Driver doesn't support user pointer buffers.", Result::ZBA_CAMERA_ERROR);
+    }
     ZBA_THROW("Error allocating buffers.", Result::ZBA_CAMERA_ERROR);
   }
 
-  if (reqbuf.count < numBuffers)
+  // Drivers may adjust the count to their own limits - use what they gave us.
+  if (reqbuf.count == 0)
   {
     ZBA_THROW("Error allocating buffers.", Result::ZBA_CAMERA_ERROR);
   }
-
-  // Memory map them
-  for (size_t i = 0; i < numBuffers; ++i)
+  if (reqbuf.count != numBuffers)
   {
-    buffers_.emplace_back(device_, i);
+    ZBA_LOG("Requested {} buffers, driver allocated {}", numBuffers, reqbuf.count);
   }
+  return reqbuf.count;
 }
 
 BufferGroup::~BufferGroup()
@@ -49,7 +93,7 @@ BufferGroup::~BufferGroup()
   struct v4l2_requestbuffers reqbuf;
   memset(&reqbuf, 0, sizeof(reqbuf));
   reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  reqbuf.memory = V4L2_MEMORY_MMAP;
+  reqbuf.memory = memory_;
   reqbuf.count  = 0;
 
   if (-1 == device_->ioctl(VIDIOC_REQBUFS, &reqbuf))
@@ -75,14 +119,80 @@ void BufferGroup::QueueAll()
   }
 }
 
-BufferMemmap::BufferMemmap() : index_(0), length_(0), data_(nullptr), timestamp_{0, 0} {}
+void BufferGroup::ExportAll()
+{
+  if (memory_ != V4L2_MEMORY_MMAP)
+  {
+    ZBA_THROW("Only driver buffers can be exported", Result::ZBA_INVALID_PARAMETER);
+  }
+  for (auto& curBuffer : buffers_)
+  {
+    curBuffer.Export();
+  }
+}
+
+BufferMemmap* BufferGroup::Dequeue()
+{
+  // The driver fills buffers in the order they were queued, and tells us which it filled.
+  v4l2_buffer buffer;
+  memset(&buffer, 0, sizeof(buffer));
+  buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buffer.memory = memory_;
+  if (-1 == device_->ioctl(VIDIOC_DQBUF, &buffer))
+  {
+    if (EAGAIN == errno) return nullptr;
+    ZBA_THROW_ERRNO("Error dequeuing buffer", Result::ZBA_CAMERA_ERROR);
+  }
+
+  auto& dequeued       = Get(buffer.index);
+  dequeued.timestamp_  = buffer.timestamp;
+  dequeued.flags_      = buffer.flags;
+  dequeued.sequence_   = buffer.sequence;
+  dequeued.bytes_used_ = buffer.bytesused;
+  return &dequeued;
+}
+
+void BufferGroup::Return(BufferMemmap& buffer)
+{
+  // Checked and queued under the lock, so Stop() can't slip in between.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (streaming_) buffer.Queue();
+}
+
+void BufferGroup::Stop()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  streaming_ = false;
+}
+
+BufferMemmap::BufferMemmap()
+    : index_(0),
+      memory_(V4L2_MEMORY_MMAP),
+      length_(0),
+      data_(nullptr),
+      timestamp_{0, 0},
+      flags_(0),
+      sequence_(0),
+      bytes_used_(0),
+      dmabuf_fd_(-1),
+      storage_(nullptr),
+      storage_size_(0)
+{
+}
 
 BufferMemmap::BufferMemmap(DeviceV4L2Ptr& device, int idx)
     : device_(device),
       index_(idx),
+      memory_(V4L2_MEMORY_MMAP),
       length_(0),
       data_(nullptr),
-      timestamp_{0, 0}
+      timestamp_{0, 0},
+      flags_(0),
+      sequence_(0),
+      bytes_used_(0),
+      dmabuf_fd_(-1),
+      storage_(nullptr),
+      storage_size_(0)
 {
   // allocate new
   struct v4l2_buffer buffer;
@@ -105,23 +215,90 @@ BufferMemmap::BufferMemmap(DeviceV4L2Ptr& device, int idx)
   }
 }
 
-BufferMemmap::BufferMemmap(BufferMemmap&& buf) : index_(0), length_(0), data_(nullptr)
+BufferMemmap::BufferMemmap(DeviceV4L2Ptr& device, int idx, void* data, size_t length,
+                           const FrameAllocator<uint8_t>& allocator)
+    : device_(device),
+      index_(idx),
+      memory_(V4L2_MEMORY_USERPTR),
+      length_(length),
+      data_(data),
+      timestamp_{0, 0},
+      flags_(0),
+      sequence_(0),
+      bytes_used_(0),
+      dmabuf_fd_(-1),
+      storage_(nullptr),
+      storage_size_(0),
+      account_(allocator.account())
+{
+  if (!data_)
+  {
+    // Drivers want user pointers page aligned, which the heap doesn't promise.
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    storage_size_     = (length_ + page - 1) / page * page;
+    storage_ = mmap(nullptr, storage_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+    if (MAP_FAILED == storage_)
+    {
+      storage_      = nullptr;
+      storage_size_ = 0;
+      ZBA_THROW_ERRNO("Error allocating user pointer buffer", Result::ZBA_CAMERA_ERROR);
+    }
+    if (account_) account_->Charge(storage_size_);
+    data_ = storage_;
+  }
+}
+
+BufferMemmap::BufferMemmap(BufferMemmap&& buf)
+    : index_(0),
+      memory_(V4L2_MEMORY_MMAP),
+      length_(0),
+      data_(nullptr),
+      timestamp_{0, 0},
+      flags_(0),
+      sequence_(0),
+      bytes_used_(0),
+      dmabuf_fd_(-1),
+      storage_(nullptr),
+      storage_size_(0)
 {
   std::swap(device_, buf.device_);
   std::swap(index_, buf.index_);
+  std::swap(memory_, buf.memory_);
   std::swap(length_, buf.length_);
   std::swap(data_, buf.data_);
   std::swap(timestamp_, buf.timestamp_);
+  std::swap(flags_, buf.flags_);
+  std::swap(sequence_, buf.sequence_);
+  std::swap(bytes_used_, buf.bytes_used_);
+  std::swap(dmabuf_fd_, buf.dmabuf_fd_);
+  std::swap(storage_, buf.storage_);
+  std::swap(storage_size_, buf.storage_size_);
+  std::swap(account_, buf.account_);
 }
 
 BufferMemmap::~BufferMemmap()
 {
-  if (data_)
+  if (dmabuf_fd_ != -1)
+  {
+    close(dmabuf_fd_);
+    dmabuf_fd_ = -1;
+  }
+
+  // User pointer memory is unmapped with storage_, or belongs to the caller.
+  if (data_ && (memory_ == V4L2_MEMORY_MMAP))
   {
     munmap(data_, length_);
     data_   = nullptr;
     length_ = 0;
   }
+  if (storage_)
+  {
+    munmap(storage_, storage_size_);
+    if (account_) account_->Release(storage_size_);
+    storage_      = nullptr;
+    storage_size_ = 0;
+  }
 }
 
 void BufferMemmap::Queue()
@@ -129,30 +306,36 @@ void BufferMemmap::Queue()
   v4l2_buffer buffer;
   memset(&buffer, 0, sizeof(buffer));
   buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  buffer.memory = V4L2_MEMORY_MMAP;
+  buffer.memory = memory_;
   buffer.index  = index_;
+  if (memory_ == V4L2_MEMORY_USERPTR)
+  {
+    buffer.m.userptr = reinterpret_cast<unsigned long>(data_);
+    buffer.length    = length_;
+  }
   if (-1 == device_->ioctl(VIDIOC_QBUF, &buffer))
   {
     ZBA_THROW("Error queuing buffer", Result::ZBA_CAMERA_ERROR);
   }
 }
 
-bool BufferMemmap::Dequeue()
+int BufferMemmap::Export()
 {
-  v4l2_buffer buffer;
-  memset(&buffer, 0, sizeof(buffer));
-  buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  buffer.memory = V4L2_MEMORY_MMAP;
-  buffer.index  = index_;
-  if (-1 == device_->ioctl(VIDIOC_DQBUF, &buffer))
+  if (dmabuf_fd_ != -1) return dmabuf_fd_;
+
+  v4l2_exportbuffer expbuf;
+  memset(&expbuf, 0, sizeof(expbuf));
+  expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  expbuf.index = index_;
+  expbuf.flags = O_RDONLY | O_CLOEXEC;
+  if (-1 == device_->ioctl(VIDIOC_EXPBUF, &expbuf))
   {
-    if (EAGAIN == errno) return false;
-    ZBA_THROW_ERRNO("Error dequeuing buffer", Result::ZBA_CAMERA_ERROR);
+    ZBA_THROW_ERRNO("Error exporting buffer", Result::ZBA_CAMERA_ERROR);
   }
-  timestamp_ = buffer.timestamp;
-  return true;
+  dmabuf_fd_ = expbuf.fd;
+  return dmabuf_fd_;
 }
 
 }  // namespace zebral
 
-#endif  // __linux__
\ No newline at end of file
+#endif  // __linux__
@@ -1,6 +1,10 @@
 /// \file camera.cpp
 /// Implementation of camera base class.
 #include "camera.hpp"
+
+#include <algorithm>
+
+#include "convert.hpp"
 #include "errors.hpp"
 #include "log.hpp"
 
@@ -11,19 +15,107 @@ TimeStamp TimeStampNow()
   return zebral::Clock::now();
 }
 
+std::chrono::system_clock::time_point TimeStampToSystem(TimeStamp timestamp)
+{
+  auto age = std::chrono::duration_cast<std::chrono::system_clock::duration>(TimeStampNow() -
+                                                                             timestamp);
+  return std::chrono::system_clock::now() - age;
+}
+
 Camera::Camera(const CameraInfo& info)
     : info_(info),
+      crop_mode_(CropMode::NONE),
       callback_(nullptr),
       exiting_(false),
       running_(false),
-      decode_(DecodeType::INTERNAL)
+      paused_(false),
+      decode_(DecodeType::INTERNAL),
+      callback_executor_(Executor::Inline()),
+      pending_callbacks_(0),
+      callback_skipped_(0),
+      frames_captured_(0),
+      frames_delivered_(0),
+      frames_dropped_(0),
+      frames_paused_(0),
+      capture_errors_(0),
+      capture_timeouts_(0),
+      driver_dropped_(0),
+      last_delivery_ns_(0),
+      delivery_interval_ns_(0),
+      buffer_count_(kDefaultBufferCount),
+      allocated_buffers_(0),
+      buffer_memory_(BufferMemory::MMAP),
+      dmabuf_export_(false),
+      max_loans_(1),
+      loans_out_(std::make_shared<std::atomic<size_t>>(0)),
+      frames_lent_(0),
+      loans_refused_(0),
+      has_frame_waiters_(false)
+{
+  // Charge our buffers, and the copies we hand out, to the frame budget.
+  std::string account_name =
+      info_.path.empty() ? info_.name : info_.name + " [" + info_.path + "]";
+  frame_account_  = FrameBudget::Instance().GetAccount(account_name);
+  reader_account_ = FrameBudget::Instance().GetAccount(account_name + "/readers");
+  cur_frame_.set_frame_account(frame_account_);
+  ring_.SetAllocator(FrameAllocator<uint8_t>(GetDefaultFrameMemory(), frame_account_));
+  for (auto& depth : queue_depth_)
+  {
+    depth = 0;
+  }
+}
+
+namespace
+{
+/// Set while a thread is running a camera's callback, so Stop() doesn't wait on itself.
+thread_local bool in_callback = false;
+
+/// Sets in_callback for as long as it's in scope, however the callback exits
+struct InCallbackScope
+{
+  InCallbackScope()
+  {
+    in_callback = true;
+  }
+  ~InCallbackScope()
+  {
+    in_callback = false;
+  }
+};
+
+/// Size in a stepwise range for a request, rounded down to a step
+/// \param requested - size asked for, 0 for the largest
+int SizeInRange(int requested, int smallest, int largest, int step)
 {
+  if (requested <= 0) return largest;
+  int size = std::clamp(requested, smallest, largest);
+  step     = std::max(step, 1);
+  return smallest + (size - smallest) / step * step;
+}
+}  // namespace
+
+Camera::~Camera()
+{
+  WaitForCallbacks();
+  std::shared_ptr<const SubscriberList> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(subscriber_mutex_);
+    subscribers = std::move(subscribers_);
+  }
+  if (subscribers)
+  {
+    for (auto& subscriber : *subscribers)
+    {
+      subscriber->Stop();
+    }
+  }
 }
 
 void Camera::Start(FrameCallback cb)
 {
   Stop();
   callback_ = cb;
+  throttle_.Reset();
   OnStart();
   running_ = true;
 }
@@ -34,6 +126,295 @@ void Camera::Stop()
   OnStop();
   exiting_ = false;
   running_ = false;
+  paused_  = false;
+  WaitForCallbacks();
+}
+
+void Camera::Pause()
+{
+  paused_ = true;
+}
+
+void Camera::Resume()
+{
+  if (!paused_) return;
+  // Start the throttle and frame rate over, rather than counting the pause as a long frame.
+  throttle_.Reset();
+  last_delivery_ns_ = 0;
+  paused_           = false;
+}
+
+void Camera::SetCallbackExecutor(std::shared_ptr<Executor> executor)
+{
+  if (!executor)
+  {
+    ZBA_THROW("Null callback executor", Result::ZBA_INVALID_PARAMETER);
+  }
+  WaitForCallbacks();
+  callback_executor_ = executor;
+}
+
+void Camera::SetCaptureReactor(std::shared_ptr<CaptureReactor> reactor)
+{
+  capture_reactor_ = std::move(reactor);
+}
+
+CallbackStats Camera::GetCallbackStats() const
+{
+  auto timing = callback_timing_.Snapshot();
+  return {timing.count, callback_skipped_, timing.total, timing.max, timing.last};
+}
+
+CameraStats Camera::GetStats() const
+{
+  CameraStats stats;
+  stats.captured  = frames_captured_;
+  stats.delivered = frames_delivered_;
+  stats.throttled = throttle_.skipped();
+  stats.dropped   = frames_dropped_;
+  stats.paused    = frames_paused_;
+  stats.errors    = capture_errors_;
+  stats.timeouts  = capture_timeouts_;
+
+  // Queue depths up to the buffer count - or further, if the driver gave us extra.
+  stats.buffers        = GetBufferCount();
+  stats.driver_dropped = driver_dropped_;
+  size_t depths        = 0;
+  for (size_t i = 0; i < kMaxBufferCount; ++i)
+  {
+    stats.queue_depth.push_back(queue_depth_[i]);
+    if (stats.queue_depth.back() != 0) depths = i + 1;
+  }
+  stats.queue_depth.resize(std::max(depths, stats.buffers));
+  stats.lent          = frames_lent_;
+  stats.loans_refused = loans_refused_;
+  stats.loans_out     = *loans_out_;
+
+  // Rate from the smoothed interval - or from the time since the last frame if that's
+  // longer, so it falls off when frames stop.
+  int64_t interval = delivery_interval_ns_;
+  int64_t last     = last_delivery_ns_;
+  if ((interval > 0) && (last > 0))
+  {
+    int64_t now =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(TimeStampNow().time_since_epoch())
+            .count();
+    stats.fps = 1e9 / static_cast<double>(std::max(interval, now - last));
+  }
+
+  stats.decode            = decode_timing_.Snapshot();
+  stats.callback          = callback_timing_.Snapshot();
+  stats.publish           = publish_latency_.Snapshot();
+  stats.driver_to_user    = driver_latency_.Snapshot();
+  stats.capture_to_user   = capture_latency_.Snapshot();
+  stats.pending_callbacks = pending_callbacks_;
+  stats.callbacks_skipped = callback_skipped_;
+
+  std::shared_ptr<const SubscriberList> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(subscriber_mutex_);
+    subscribers = subscribers_;
+  }
+  if (subscribers)
+  {
+    for (const auto& subscriber : *subscribers)
+    {
+      stats.subscribers.push_back({subscriber->name(), subscriber->delivered(),
+                                   subscriber->dropped(), subscriber->throttled(),
+                                   subscriber->queued(), subscriber->latency()});
+    }
+  }
+  return stats;
+}
+
+void Camera::ResetStats()
+{
+  frames_captured_      = 0;
+  frames_delivered_     = 0;
+  frames_dropped_       = 0;
+  frames_paused_        = 0;
+  capture_errors_       = 0;
+  capture_timeouts_     = 0;
+  driver_dropped_       = 0;
+  frames_lent_          = 0;
+  loans_refused_        = 0;
+  callback_skipped_     = 0;
+  last_delivery_ns_     = 0;
+  delivery_interval_ns_ = 0;
+  decode_timing_.Reset();
+  callback_timing_.Reset();
+  publish_latency_.Reset();
+  driver_latency_.Reset();
+  capture_latency_.Reset();
+  throttle_.ResetSkipped();
+  for (auto& depth : queue_depth_)
+  {
+    depth = 0;
+  }
+}
+
+void Camera::SetBufferCount(size_t count)
+{
+  if ((count == 0) || (count > kMaxBufferCount))
+  {
+    ZBA_THROW("Invalid buffer count: " + std::to_string(count), Result::ZBA_INVALID_RANGE);
+  }
+  buffer_count_ = count;
+}
+
+size_t Camera::GetBufferCount() const
+{
+  return user_buffers_.empty() ? buffer_count_ : user_buffers_.size();
+}
+
+void Camera::SetBufferMemory(BufferMemory memory, const std::vector<UserBuffer>& buffers)
+{
+  if ((memory == BufferMemory::MMAP) && !buffers.empty())
+  {
+    ZBA_THROW("User buffers need BufferMemory::USERPTR", Result::ZBA_INVALID_PARAMETER);
+  }
+  if (buffers.size() > kMaxBufferCount)
+  {
+    ZBA_THROW("Too many user buffers: " + std::to_string(buffers.size()),
+              Result::ZBA_INVALID_RANGE);
+  }
+  for (const auto& buffer : buffers)
+  {
+    if (!buffer.data || (buffer.size == 0))
+    {
+      ZBA_THROW("Empty user buffer", Result::ZBA_INVALID_PARAMETER);
+    }
+  }
+  buffer_memory_ = memory;
+  user_buffers_  = buffers;
+}
+
+BufferMemory Camera::GetBufferMemory() const
+{
+  return buffer_memory_;
+}
+
+void Camera::SetDmabufExport(bool enable)
+{
+  dmabuf_export_ = enable;
+}
+
+void Camera::SetLoanCallback(FrameLoanCallback cb, size_t max_loans)
+{
+  if ((max_loans == 0) || (max_loans > kMaxBufferCount))
+  {
+    ZBA_THROW("Invalid loan count: " + std::to_string(max_loans), Result::ZBA_INVALID_RANGE);
+  }
+  loan_callback_ = cb;
+  max_loans_     = max_loans;
+}
+
+bool Camera::LendBuffer(FrameLoan loan, std::function<void()> release)
+{
+  if (!loan_callback_ || (decode_ != DecodeType::NONE) || !current_mode_) return false;
+
+  // Reserve a loan, keeping a buffer for the driver.  Leases give them back from any thread.
+  // The driver may have allocated fewer buffers than we asked for.
+  const size_t buffers = allocated_buffers_ ? allocated_buffers_.load() : GetBufferCount();
+  const size_t limit   = std::min(max_loans_, buffers - 1);
+  size_t out         = *loans_out_;
+  do
+  {
+    if (out >= limit)
+    {
+      ++loans_refused_;
+      return false;
+    }
+  } while (!loans_out_->compare_exchange_weak(out, out + 1));
+
+  const auto& traits = current_mode_->traits();
+  loan.format        = traits.format;
+  if (!traits.compressed && (traits.format != PixelFormat::UNKNOWN))
+  {
+    loan.view = FrameView(loan.data, current_mode_->width, current_mode_->height, 0,
+                          traits.planes[0].channels, traits.bytes_per_component, false, false,
+                          loan.timestamp);
+    if (crop_mode_ == CropMode::SOFTWARE)
+    {
+      loan.view = loan.view.roi(crop_applied_.x, crop_applied_.y, crop_applied_.width,
+                                crop_applied_.height);
+    }
+  }
+  loan.timing.published = TimeStampNow();
+  publish_latency_.Record(loan.timing.published - loan.timing.dequeued);
+  loan.lease = std::make_shared<LoanLease>([loans_out = loans_out_, release] {
+    // Give the reservation back even if requeueing the buffer throws.
+    struct Unreserve
+    {
+      std::atomic<size_t>& out;
+      ~Unreserve()
+      {
+        --out;
+      }
+    } unreserve{*loans_out};
+    release();
+  });
+  ++frames_lent_;
+  CountDelivery();
+
+  try
+  {
+    loan_callback_(info_, std::move(loan));
+  }
+  catch (const std::exception& e)
+  {
+    ZBA_ERR("Loan callback threw: {}", e.what());
+  }
+  return true;
+}
+
+void Camera::CountBufferQueue(size_t ready)
+{
+  if (ready == 0) return;
+  queue_depth_[std::min(ready, kMaxBufferCount) - 1].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Camera::SetThrottle(const ThrottleSettings& settings)
+{
+  throttle_.SetSettings(settings);
+}
+
+ThrottleSettings Camera::GetThrottle() const
+{
+  return throttle_.GetSettings();
+}
+
+uint64_t Camera::GetThrottledFrames() const
+{
+  return throttle_.skipped();
+}
+
+void Camera::RunCallback(const CameraFrame& frame)
+{
+  InCallbackScope scope;
+  auto start = TimeStampNow();
+  driver_latency_.Record(start - frame.get_timestamp());
+  capture_latency_.Record(start - frame.get_timing().dequeued);
+  try
+  {
+    callback_(info_, frame);
+  }
+  catch (const std::exception& e)
+  {
+    ZBA_ERR("Frame callback threw: {}", e.what());
+  }
+  catch (...)
+  {
+    ZBA_ERR("Frame callback threw an unknown exception");
+  }
+  callback_timing_.Record(TimeStampNow() - start);
+}
+
+void Camera::WaitForCallbacks()
+{
+  if (in_callback) return;
+  std::unique_lock<std::mutex> lock(callback_mutex_);
+  callback_cv_.wait(lock, [&] { return pending_callbacks_ == 0; });
 }
 
 bool Camera::IsRunning()
@@ -43,56 +424,232 @@ bool Camera::IsRunning()
 
 void Camera::OnFrameReceived(const CameraFrame& frame)
 {
-  // Update last frame and notify anyone waiting
+  // Make sure consumers have room for another copy of the frame before delivering it.
+  if (!FrameBudget::Instance().Admit(frame.data_size(), *frame_account_))
+  {
+    ++frames_dropped_;
+    return;
+  }
+
+  // Publish to the ring - readers are never waited on, and this is the only copy.
+  auto published = ring_.AcquireFrame();
+  if (!published)
+  {
+    ZBA_ERR("Readers are holding every frame in the pool, dropping frame.");
+    frame_account_->CountRefused();
+    ++frames_dropped_;
+    return;
+  }
+  // Frames that don't match the crop (e.g. from before a mode change) go out whole.
+  if ((crop_mode_ == CropMode::SOFTWARE) &&
+      (crop_applied_.x + crop_applied_.width <= frame.width()) &&
+      (crop_applied_.y + crop_applied_.height <= frame.height()))
+  {
+    CropFrame(frame, *published);
+  }
+  else
+  {
+    *published = frame;
+  }
+
+  // Stamp the publish stage. Frames from platforms that don't report stages count from here.
+  FrameTiming timing = frame.get_timing();
+  timing.published   = TimeStampNow();
+  if (timing.dequeued == TimeStamp{}) timing.dequeued = timing.published;
+  published->set_timing(timing);
+  publish_latency_.Record(timing.published - timing.dequeued);
+  ring_.Publish();
+  auto handle = ring_.LastPublished();
+  CountDelivery();
+
+  // Resume coroutines waiting on NextFrame()
+  if (has_frame_waiters_)
+  {
+    std::vector<std::shared_ptr<AsyncState<FrameHandle>>> waiters;
+    {
+      std::lock_guard<std::mutex> lock(frame_waiter_mutex_);
+      waiters.swap(frame_waiters_);
+      has_frame_waiters_ = false;
+    }
+    for (auto& waiter : waiters)
+    {
+      waiter->Complete(handle);
+    }
+  }
+
+  // Queue for subscribers - each gets a reference to the same frame, so none of them costs
+  // the capture thread a copy, and they can't hold up each other.
+  std::shared_ptr<const SubscriberList> subscribers;
   {
-    std::lock_guard<std::mutex> lock(frame_mutex_);
-    last_frame_     = frame;
-    last_timestamp_ = frame.get_timestamp();
-    cv_.notify_all();
+    std::lock_guard<std::mutex> lock(subscriber_mutex_);
+    subscribers = subscribers_;
+  }
+  std::shared_ptr<const CameraFrame> decoded;
+  if (subscribers && !subscribers->empty())
+  {
+    decoded = DecodedFrame(handle);
+    for (auto& subscriber : *subscribers)
+    {
+      subscriber->Push(decoded);
+    }
   }
 
   // Call callback if provided
   if (callback_)
   {
-    callback_(info_, frame);
+    if (callback_executor_->IsInline())
+    {
+      RunCallback(decoded ? *decoded : *DecodedFrame(handle));
+    }
+    else if (pending_callbacks_ >= kMaxPendingCallbacks)
+    {
+      ++callback_skipped_;
+    }
+    else
+    {
+      // The handle keeps the frame out of the ring pool until the callback is done,
+      // and deferred decoding happens on the executor rather than the capture thread.
+      ++pending_callbacks_;
+      callback_executor_->Post([this, handle] {
+        // However this exits, Stop() must see the callback finish.
+        struct Done
+        {
+          Camera& camera;
+          ~Done()
+          {
+            std::lock_guard<std::mutex> lock(camera.callback_mutex_);
+            --camera.pending_callbacks_;
+            camera.callback_cv_.notify_all();
+          }
+        } done{*this};
+        try
+        {
+          RunCallback(*DecodedFrame(handle));
+        }
+        catch (const std::exception& e)
+        {
+          ZBA_ERR("Frame decode for callback failed: {}", e.what());
+        }
+        catch (...)
+        {
+          ZBA_ERR("Frame decode for callback failed with an unknown exception");
+        }
+      });
+    }
   }
 }
 
 std::optional<CameraFrame> Camera::GetNewFrame(size_t timeout_ms)
 {
-  TimeStamp ts = TimeStampNow();
-  CameraFrame frame;
-
-  std::unique_lock<std::mutex> lock(frame_mutex_);
-  // Wait for a frame to come in - if we get one, stop waiting and return it.
-  cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] {
-    if (ts < last_timestamp_)
-    {
-      frame = last_frame_;
-      ts    = last_timestamp_;
-      return true;
-    }
-    return false;
-  });
-
-  if (!frame.empty())
+  // Wait for a frame newer than the latest one when we were called.
+  auto handle = ring_.Next(ring_.LatestSequence(), std::chrono::milliseconds(timeout_ms));
+  if (!handle || handle.frame->empty())
   {
-    return frame;
+    // Timed out
+    ZBA_LOG("Timeout or Empty Frame!");
+    return {};
   }
 
-  // Timed out
-  ZBA_LOG("Timeout or Empty Frame!");
-  return {};
+  CameraFrame frame(FrameAllocator<uint8_t>(GetDefaultFrameMemory(), reader_account_));
+  frame = *DecodedFrame(handle);
+  return frame;
 }
 
 std::optional<CameraFrame> Camera::GetLastFrame()
 {
-  std::lock_guard<std::mutex> lock(frame_mutex_);
-  if (last_frame_.empty())
+  auto handle = ring_.Latest();
+  if (!handle || handle.frame->empty())
   {
     return {};
   }
-  return last_frame_;
+  CameraFrame frame(FrameAllocator<uint8_t>(GetDefaultFrameMemory(), reader_account_));
+  frame = *DecodedFrame(handle);
+  return frame;
+}
+
+void Camera::CountDelivery()
+{
+  ++frames_delivered_;
+
+  int64_t now =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(TimeStampNow().time_since_epoch())
+          .count();
+
+  int64_t last = last_delivery_ns_.exchange(now);
+  if (last == 0) return;
+
+  // Smooth over the last several frames. Only the capture thread writes the interval.
+  int64_t interval      = delivery_interval_ns_;
+  int64_t elapsed       = now - last;
+  delivery_interval_ns_ = (interval == 0) ? elapsed : interval + (elapsed - interval) / 8;
+}
+
+std::shared_ptr<const CameraFrame> Camera::DecodedFrame(const FrameHandle& handle) const
+{
+  // Decoded once per frame by whoever reads it first, then shared.
+  return (decode_ == DecodeType::DEFERRED) ? handle.Decoded() : handle.frame;
+}
+
+FrameHandle Camera::GetLatestFrameHandle() const
+{
+  return ring_.Latest();
+}
+
+FrameHandle Camera::GetFrameAfter(uint64_t sequence, size_t timeout_ms)
+{
+  return ring_.Next(sequence, std::chrono::milliseconds(timeout_ms));
+}
+
+AsyncOp<FrameHandle> Camera::NextFrame(EventLoop& loop,
+                                       std::chrono::milliseconds timeout,
+                                       std::stop_token stop)
+{
+  auto start = [this](const std::shared_ptr<AsyncState<FrameHandle>>& state) {
+    std::lock_guard<std::mutex> lock(frame_waiter_mutex_);
+    // Forget waits that timed out or were cancelled
+    std::erase_if(frame_waiters_, [](const auto& waiter) { return waiter->done(); });
+    frame_waiters_.push_back(state);
+    has_frame_waiters_ = true;
+  };
+  return AsyncOp<FrameHandle>(loop, start, timeout, std::move(stop));
+}
+
+std::shared_ptr<FrameSubscriber> Camera::Subscribe(const std::string& name,
+                                                   FrameCallback cb,
+                                                   const SubscriberOptions& options)
+{
+  auto account = FrameBudget::Instance().GetAccount(frame_account_->name() + "/" + name);
+  auto subscriber =
+      std::make_shared<FrameSubscriber>(name, GetCameraInfo(), cb, options, account);
+  subscriber->Start();
+  FrameBudget::Instance().RegisterHolder(subscriber);
+
+  std::lock_guard<std::mutex> lock(subscriber_mutex_);
+  auto subscribers = std::make_shared<SubscriberList>();
+  if (subscribers_) *subscribers = *subscribers_;
+  subscribers->push_back(subscriber);
+  subscribers_ = std::move(subscribers);
+  return subscriber;
+}
+
+void Camera::Unsubscribe(const std::shared_ptr<FrameSubscriber>& subscriber)
+{
+  {
+    std::lock_guard<std::mutex> lock(subscriber_mutex_);
+    if (!subscribers_) return;
+    auto subscribers = std::make_shared<SubscriberList>();
+    for (auto& cur : *subscribers_)
+    {
+      if (cur != subscriber) subscribers->push_back(cur);
+    }
+    subscribers_ = std::move(subscribers);
+  }
+  subscriber->Stop();
+}
+
+std::shared_ptr<FrameAccount> Camera::GetFrameAccount() const
+{
+  return frame_account_;
 }
 
 CameraInfo Camera::GetCameraInfo()
@@ -114,12 +671,47 @@ void Camera::SetFormat(const FormatInfo& info, DecodeType decode)
   {
     if (info.Matches(checkFormat))
     {
-      decode_       = decode;
-      auto setFmt   = OnSetFormat(checkFormat);
-      current_mode_ = std::make_unique<FormatInfo>(setFmt);
-      // {TODO} support signed/floats here.
-      cur_frame_.reset(setFmt.width, setFmt.height, setFmt.channels, setFmt.bytespppc, false,
-                       false);
+      // Modes with a range of sizes or rates are asked for at the size and rate requested.
+      if (checkFormat.HasSizeRange() && !info.HasSizeRange())
+      {
+        checkFormat.width      = SizeInRange(info.width, checkFormat.min_width, checkFormat.width,
+                                             checkFormat.step_width);
+        checkFormat.height     = SizeInRange(info.height, checkFormat.min_height,
+                                             checkFormat.height, checkFormat.step_height);
+        checkFormat.min_width  = 0;
+        checkFormat.min_height = 0;
+      }
+      if (checkFormat.HasFpsRange() && (info.fps > 0) && !info.HasFpsRange())
+      {
+        checkFormat.fps     = std::clamp(info.fps, checkFormat.min_fps, checkFormat.fps);
+        checkFormat.min_fps = 0;
+      }
+
+      decode_             = decode;
+      crop_applied_       = CropRect();
+      crop_mode_          = CropMode::NONE;
+      auto setFmt         = OnSetFormat(checkFormat);
+      setFmt.pixel_format = PixelFormatFromString(setFmt.format);
+      current_mode_       = std::make_unique<FormatInfo>(setFmt);
+
+      // Size the frame for what we'll deliver - raw, or decoded by us / the system.
+      const auto& traits = setFmt.traits();
+      if (traits.format == PixelFormat::UNKNOWN)
+      {
+        // {TODO} support signed/floats here.
+        cur_frame_.reset(setFmt.width, setFmt.height, setFmt.channels, setFmt.bytespppc, false,
+                         false);
+      }
+      else
+      {
+        bool raw = (decode_ == DecodeType::NONE) || DeferDecode();
+        cur_frame_.reset(setFmt.width, setFmt.height, raw ? traits.format : traits.decoded);
+      }
+      requested_mode_ = info;
+      if (!crop_.empty() && (crop_mode_ == CropMode::NONE))
+      {
+        SetSoftwareCrop();
+      }
       ZBA_LOG("Mode for camera {} set. Decode: {}", info_.name, static_cast<int>(decode_));
       ZBA_LOGSS(*current_mode_.get());
       return;
@@ -130,6 +722,107 @@ void Camera::SetFormat(const FormatInfo& info, DecodeType decode)
   ZBA_THROW("Format not found!", Result::ZBA_UNSUPPORTED_FMT);
 }
 
+void Camera::SwitchFormat(const FormatInfo& info, DecodeType decode)
+{
+  if (!running_)
+  {
+    SetFormat(info, decode);
+    return;
+  }
+
+  // Check what we can before stopping, so a bad request doesn't interrupt the stream.
+  if (std::none_of(info_.formats.begin(), info_.formats.end(),
+                   [&](const FormatInfo& format) { return info.Matches(format); }))
+  {
+    ZBA_THROW("Format not found!", Result::ZBA_UNSUPPORTED_FMT);
+  }
+  if (HasLoansOut())
+  {
+    ZBA_THROW("Can't switch formats with buffers on loan", Result::ZBA_CAMERA_ERROR);
+  }
+
+  // Only the platform's streaming is restarted - the capture thread is stopped while the
+  // mode and cur_frame_ change, so no frame straddles the switch.
+  exiting_ = true;
+  OnStop();
+  exiting_ = false;
+  try
+  {
+    SetFormat(info, decode);
+    OnStart();
+  }
+  catch (...)
+  {
+    running_ = false;
+    paused_  = false;
+    throw;
+  }
+}
+
+void Camera::SetCrop(const CropRect& rect)
+{
+  if ((rect.x < 0) || (rect.y < 0) || (rect.width < 0) || (rect.height < 0))
+  {
+    ZBA_THROW("Invalid crop rectangle", Result::ZBA_INVALID_RANGE);
+  }
+  crop_ = rect;
+  if (current_mode_)
+  {
+    SwitchFormat(requested_mode_, decode_);
+  }
+}
+
+void Camera::SetSoftwareCrop()
+{
+  const auto& traits = GetPixelFormatInfo(cur_frame_.pixel_format());
+  if (traits.compressed)
+  {
+    ZBA_ERR("Can't crop compressed {} frames", current_mode_->format);
+    return;
+  }
+
+  // Keep whole chroma samples, e.g. pairs of pixels for YUYV.
+  const int x_align = std::max(traits.chroma_x_subsampling, 1);
+  const int y_align = std::max(traits.chroma_y_subsampling, 1);
+  const int left    = std::min(crop_.x, cur_frame_.width()) / x_align * x_align;
+  const int top     = std::min(crop_.y, cur_frame_.height()) / y_align * y_align;
+  const int right   = std::min(crop_.x + crop_.width, cur_frame_.width()) / x_align * x_align;
+  const int bottom  = std::min(crop_.y + crop_.height, cur_frame_.height()) / y_align * y_align;
+  if ((right <= left) || (bottom <= top))
+  {
+    ZBA_ERR("Crop is outside the {}x{} frame", cur_frame_.width(), cur_frame_.height());
+    return;
+  }
+  crop_applied_ = {left, top, right - left, bottom - top};
+  crop_mode_    = CropMode::SOFTWARE;
+}
+
+void Camera::CropFrame(const CameraFrame& frame, CameraFrame& cropped) const
+{
+  const CropRect& crop = crop_applied_;
+  if (frame.pixel_format() != PixelFormat::UNKNOWN)
+  {
+    cropped.reset(crop.width, crop.height, frame.pixel_format(), frame.get_timestamp());
+  }
+  else
+  {
+    cropped.reset(crop.width, crop.height, frame.channels(), frame.bytes_per_channel(),
+                  frame.is_signed(), frame.is_floating(), frame.get_timestamp());
+  }
+
+  // Subsampled planes take the same share of the crop as of the frame.
+  for (int i = 0; i < cropped.plane_count(); ++i)
+  {
+    auto src = frame.plane_view(i);
+    auto dst = cropped.plane_view(i);
+    GreyToFrame(src.roi(crop.x * src.width() / frame.width(),
+                        crop.y * src.height() / frame.height(), dst.width(), dst.height()),
+                dst);
+  }
+  cropped.set_timing(frame.get_timing());
+  cropped.set_hw_sequence(frame.get_hw_sequence());
+}
+
 /// Retrieves the camera mode. empty if not yet set.
 std::optional<FormatInfo> Camera::GetFormat()
 {
@@ -138,26 +831,18 @@ std::optional<FormatInfo> Camera::GetFormat()
 }
 
 bool Camera::IsFormatSupported(const std::string& fourcc)
+{
+  return IsFormatSupported(PixelFormatFromString(fourcc));
+}
+
+bool Camera::IsFormatSupported(PixelFormat format)
 {
   /// {TODO} These are ones we have reference (SLOW) converters for
   /// so far.  Need to get cameras with other modes....
   /// Like, especially Bayer modes, although most I've used with those
   /// had their own SDKs....
-  /// Right now, the only other thing I have is MJPG.
-  if (fourcc == "NV12") return true;
-
-    // Having problems with this on windows, we simply don't get frames.
-    // if (fourcc == "MJPG") return true;
-#if _WIN32
-  if (fourcc == "L8  ") return true;
-  if (fourcc == "D16 ") return true;
-  if (fourcc == "YUY2") return true;
-#else
-  if (fourcc == "GREY") return true;
-  if (fourcc == "Z16 ") return true;
-  if (fourcc == "YUYV") return true;
-#endif
-  return false;
+  /// Right now, the only other thing I have is MJPG - see the capture flag in the table.
+  return GetPixelFormatInfo(format).capture;
 }
 
 void Camera::AddAllModeEntry(const FormatInfo& format)
@@ -177,56 +862,36 @@ void Camera::CopyRawBuffer(const void* srcPtr, int srcStride)
     ZBA_THROW("Must set mode before copying buffers!", Result::ZBA_ERROR);
   }
 
-  // For encoded buffers, just call it a single channel.
-  // adjust width/height/bpppc to allocate the right size.
-  int height     = current_mode_->height;
-  int width      = current_mode_->width;
-  int channels   = 1;
-  int bpppc      = 1;
-  bool is_signed = false;
-  bool is_float  = false;
-
-  if ((current_mode_->format == "YUY2") || (current_mode_->format == "YUYV"))
-  {
-    width = current_mode_->width * 2;
-  }
-  else if (current_mode_->format == "NV12")
-  {
-    height = static_cast<int>(current_mode_->height * 1.5);
-  }
-  else if ((current_mode_->format == "D16 ") || (current_mode_->format == "Z16 "))
-  {
-    bpppc = 2;
-  }
-  else if ((current_mode_->format == "L8  ") || (current_mode_->format == "GREY"))
-  {
-    // all the same
-  }
-  else
+  const auto& traits = current_mode_->traits();
+  if ((traits.format == PixelFormat::UNKNOWN) || (traits.compressed))
   {
+    // Compressed buffers vary in size, so we can't copy them without a length.
     ZBA_ERR("Don't currently have a converter for {}", current_mode_->format);
+    return;
   }
 
-  if ((cur_frame_.height() != height) || (cur_frame_.width() != width) ||
-      (cur_frame_.bytes_per_channel() != bpppc) || (cur_frame_.channels() != 1))
-  {
-    ZBA_LOG("Resetting buffer to {}x{} {}", width, height, bpppc);
-    cur_frame_.reset(width, height, 1, bpppc, is_signed, is_float);
-  }
-
-  const uint8_t* src = reinterpret_cast<const uint8_t*>(srcPtr);
-  uint8_t* dst       = cur_frame_.data();
-  int copy_stride    = width * channels * bpppc;
-  if (0 == srcStride)
+  if ((cur_frame_.pixel_format() != traits.format) ||
+      (cur_frame_.width() != current_mode_->width) ||
+      (cur_frame_.height() != current_mode_->height))
   {
-    srcStride = copy_stride;
+    ZBA_LOG("Resetting buffer to {}x{} {}", current_mode_->width, current_mode_->height,
+            current_mode_->format);
+    cur_frame_.reset(current_mode_->width, current_mode_->height, traits.format);
   }
 
-  for (int y = 0; y < height; ++y)
+  // Planes follow each other in the source; subsampled planes have proportionally smaller
+  // strides (e.g. NV12 chroma has the same stride as luma, I420 has half).
+  const size_t row_bytes = traits.row_bytes(current_mode_->width);
+  const size_t stride    = (0 == srcStride) ? row_bytes : static_cast<size_t>(srcStride);
+  const uint8_t* src     = reinterpret_cast<const uint8_t*>(srcPtr);
+  for (int i = 0; i < cur_frame_.plane_count(); ++i)
   {
-    memcpy(dst, src, copy_stride);
-    dst += copy_stride;
-    src += srcStride;
+    auto dst          = cur_frame_.plane_view(i);
+    size_t src_stride = (i == 0) ? stride : (stride * dst.row_bytes() + row_bytes - 1) / row_bytes;
+    GreyToFrame(FrameView(src, dst.width(), dst.height(), src_stride, dst.channels(),
+                          dst.bytes_per_channel()),
+                dst);
+    src += src_stride * dst.height();
   }
 }
 
@@ -234,7 +899,12 @@ void Camera::CopyRawBuffer(const void* srcPtr, int srcStride)
 std::ostream& operator<<(std::ostream& os, const CameraFrame& camFrame)
 {
   os << "Frame: " << camFrame.width() << ", " << camFrame.height() << " " << camFrame.channels()
-     << " " << camFrame.bytes_per_channel() << std::endl;
+     << " " << camFrame.bytes_per_channel();
+  if (camFrame.is_planar())
+  {
+    os << " (" << camFrame.plane_count() << " planes)";
+  }
+  os << std::endl;
   return os;
 }
 std::vector<std::string> Camera::GetParameterNames() const
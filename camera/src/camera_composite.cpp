@@ -0,0 +1,67 @@
+/// \file camera_composite.cpp
+/// Implementation of composite devices
+#include "camera_composite.hpp"
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+CompositeCamera::CompositeCamera(const CompositeInfo& info,
+                                 const std::vector<std::shared_ptr<Camera>>& nodes)
+    : info_(info),
+      nodes_(nodes)
+{
+  if ((nodes_.size() < 2) || (nodes_.size() != info_.nodes.size()))
+  {
+    ZBA_THROW("Composite camera requires a camera for each of its nodes",
+              Result::ZBA_INVALID_PARAMETER);
+  }
+}
+
+CompositeCamera::~CompositeCamera()
+{
+  Stop();
+}
+
+void CompositeCamera::Start(FrameSetCallback callback, const GroupOptions& options)
+{
+  Stop();
+
+  GroupOptions group_options = options;
+  group_options.match        = GroupMatch::SEQUENCE;
+  if (options.name == GroupOptions().name) group_options.name = "composite";
+  group_ = std::make_unique<CameraGroup>(nodes_, callback, group_options);
+
+  // Start the streams back to back, so their first frames are close enough to line up.
+  try
+  {
+    for (auto& node : nodes_)
+    {
+      node->Start();
+    }
+  }
+  catch (const Error&)
+  {
+    Stop();
+    throw;
+  }
+  ZBA_LOG("Composite {} started with {} nodes", info_.name, nodes_.size());
+}
+
+void CompositeCamera::Stop()
+{
+  for (auto& node : nodes_)
+  {
+    node->Stop();
+  }
+  group_.reset();
+}
+
+std::optional<GroupStats> CompositeCamera::GetStats() const
+{
+  if (!group_) return {};
+  return group_->GetStats();
+}
+
+}  // namespace zebral
@@ -0,0 +1,262 @@
+/// \file camera_group.cpp
+/// Implementation of timestamp-matched multi-camera capture
+#include "camera_group.hpp"
+
+#include <algorithm>
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+CameraGroup::CameraGroup(const std::vector<std::shared_ptr<Camera>>& cameras,
+                         FrameSetCallback callback,
+                         const GroupOptions& options)
+    : cameras_(cameras),
+      callback_(callback),
+      options_(options),
+      sets_(0),
+      dropped_(0),
+      overrun_(0),
+      synced_(false),
+      next_emit_(0)
+{
+  if (cameras_.size() < 2)
+  {
+    ZBA_THROW("Camera group requires at least 2 cameras", Result::ZBA_INVALID_PARAMETER);
+  }
+  if (!callback_)
+  {
+    ZBA_THROW("Camera group requires a callback", Result::ZBA_INVALID_PARAMETER);
+  }
+  if ((options_.window == 0) || (options_.tolerance.count() < 0))
+  {
+    ZBA_THROW("Invalid camera group options", Result::ZBA_INVALID_RANGE);
+  }
+
+  // Buffered frames are charged to the group, and the rings are allocated up front.
+  account_ = FrameBudget::Instance().GetAccount(options_.name);
+  const CameraFrame empty(FrameAllocator<uint8_t>(GetDefaultFrameMemory(), account_));
+  slots_.resize(cameras_.size());
+  for (auto& slot : slots_)
+  {
+    slot.frames.assign(options_.window, empty);
+  }
+
+  // Each camera's thread fills its own sets, so the frames' storage is reused across sets.
+  FrameSet set;
+  set.frames.assign(cameras_.size(), empty);
+  pending_.assign(cameras_.size(), std::vector<FrameSet>(1, set));
+
+  // Our own subscribers' queues only need to cover a burst - the window holds the rest.
+  SubscriberOptions sub_options;
+  sub_options.policy     = SubscriberPolicy::DROP_OLDEST;
+  sub_options.queue_size = options_.window;
+  for (size_t i = 0; i < cameras_.size(); ++i)
+  {
+    if (!cameras_[i])
+    {
+      ZBA_THROW("Null camera in group", Result::ZBA_INVALID_PARAMETER);
+    }
+    subscribers_.push_back(cameras_[i]->Subscribe(
+        options_.name,
+        [this, i](const CameraInfo&, const CameraFrame& frame) { OnFrame(i, frame); },
+        sub_options));
+  }
+}
+
+CameraGroup::~CameraGroup()
+{
+  for (size_t i = 0; i < subscribers_.size(); ++i)
+  {
+    cameras_[i]->Unsubscribe(subscribers_[i]);
+  }
+}
+
+GroupStats CameraGroup::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  GroupStats stats;
+  stats.sets    = sets_;
+  stats.dropped = dropped_;
+  stats.overrun = overrun_;
+  stats.skew    = skew_.Snapshot();
+  for (const auto& slot : slots_)
+  {
+    stats.camera_dropped.push_back(slot.dropped);
+  }
+  return stats;
+}
+
+void CameraGroup::Flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& slot : slots_)
+  {
+    slot.head  = 0;
+    slot.count = 0;
+  }
+  synced_ = false;
+}
+
+void CameraGroup::OnFrame(size_t index, const CameraFrame& frame)
+{
+  auto& sets   = pending_[index];
+  size_t count = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Add to the camera's ring, overwriting the oldest frame if it's full.
+    auto& slot = slots_[index];
+    if (slot.count == slot.frames.size())
+    {
+      slot.pop();
+      ++slot.dropped;
+      ++overrun_;
+    }
+    slot.frames[(slot.head + slot.count) % slot.frames.size()] = frame;
+    ++slot.count;
+
+    for (;;)
+    {
+      if (count == sets.size())
+      {
+        // Rarely more than one set completes at once - its storage is reused from then on.
+        sets.push_back(sets.front());
+      }
+      if (!Match(sets[count])) break;
+      ++count;
+    }
+  }
+
+  if (count > 0)
+  {
+    Emit(sets, count);
+  }
+}
+
+void CameraGroup::Emit(const std::vector<FrameSet>& sets, size_t count)
+{
+  // Sets are numbered under the ring lock - wait for the ones before ours to be emitted.
+  const uint64_t first = sets[0].sequence;
+  {
+    std::unique_lock<std::mutex> lock(emit_mutex_);
+    emit_cv_.wait(lock, [this, first] { return next_emit_ == first; });
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    try
+    {
+      callback_(sets[i]);
+    }
+    catch (const std::exception& e)
+    {
+      ZBA_ERR("Camera group {} callback threw: {}", options_.name, e.what());
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(emit_mutex_);
+    next_emit_ = first + count;
+  }
+  emit_cv_.notify_all();
+}
+
+bool CameraGroup::Match(FrameSet& set)
+{
+  for (;;)
+  {
+    // Need a frame from every camera
+    for (auto& slot : slots_)
+    {
+      if (slot.count == 0) return false;
+    }
+
+    if (synced_)
+    {
+      // Matching sequence numbers pair up; older ones lost their partners.
+      int64_t newest = slots_[0].key();
+      for (auto& slot : slots_)
+      {
+        newest = std::max(newest, slot.key());
+      }
+      bool complete = true;
+      for (auto& slot : slots_)
+      {
+        if (slot.key() < newest)
+        {
+          slot.pop();
+          ++slot.dropped;
+          ++dropped_;
+          complete = false;
+        }
+      }
+      if (complete)
+      {
+        TakeSet(set);
+        return true;
+      }
+      continue;
+    }
+
+    TimeStamp oldest = TimeStamp::max();
+    TimeStamp newest = TimeStamp::min();
+    for (auto& slot : slots_)
+    {
+      oldest = std::min(oldest, slot.front().get_timestamp());
+      newest = std::max(newest, slot.front().get_timestamp());
+    }
+
+    if (newest - oldest <= options_.tolerance)
+    {
+      // Remember how each stream's counter relates to the first's.
+      if (options_.match == GroupMatch::SEQUENCE)
+      {
+        int64_t base = static_cast<int64_t>(slots_[0].front().get_hw_sequence());
+        for (auto& slot : slots_)
+        {
+          slot.offset = static_cast<int64_t>(slot.front().get_hw_sequence()) - base;
+        }
+        synced_ = true;
+      }
+      TakeSet(set);
+      return true;
+    }
+
+    // Frames too old to match the newest never will - later frames are only newer.
+    for (auto& slot : slots_)
+    {
+      if (newest - slot.front().get_timestamp() > options_.tolerance)
+      {
+        slot.pop();
+        ++slot.dropped;
+        ++dropped_;
+      }
+    }
+  }
+}
+
+void CameraGroup::TakeSet(FrameSet& set)
+{
+  TimeStamp oldest = TimeStamp::max();
+  TimeStamp newest = TimeStamp::min();
+  for (auto& slot : slots_)
+  {
+    oldest = std::min(oldest, slot.front().get_timestamp());
+    newest = std::max(newest, slot.front().get_timestamp());
+  }
+
+  set.sequence  = sets_++;
+  set.timestamp = oldest;
+  set.skew      = newest - oldest;
+  // Copy rather than move, so the ring keeps its buffers.
+  for (size_t i = 0; i < slots_.size(); ++i)
+  {
+    set.frames[i] = slots_[i].front();
+    slots_[i].pop();
+  }
+  skew_.Record(set.skew);
+}
+
+}  // namespace zebral
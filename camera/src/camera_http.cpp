@@ -36,14 +36,22 @@ bool CameraHttp::OnBufferReceived(uint8_t* data, size_t length,
   if ((!data) || (length == 0))
   {
     ZBA_ERR("Got empty frame?");
+    ++capture_errors_;
     return true;
   }
 
   (void)headers;
   /// {TODO} Need to process the headers to verify jpeg and get hardware timestamp
   /// BUT, before that, we need to add a way to sync times between camera and system.
+  FrameTiming timing{};
+  timing.dequeued = TimeStampNow();
+  if (!AcceptFrame(timing.dequeued)) return !exiting_;
+
   JPEGToBGRFrame(data, length, cur_frame_, cur_frame_.width() * 3);
-  cur_frame_.set_timestamp(TimeStampNow());
+  timing.converted = TimeStampNow();
+  decode_timing_.Record(timing.converted - timing.dequeued);
+  cur_frame_.set_timestamp(timing.dequeued);
+  cur_frame_.set_timing(timing);
   OnFrameReceived(cur_frame_);
   return !exiting_;
 }
@@ -72,6 +80,7 @@ void CameraHttp::ReadThread()
     if (responseCode != 200)
     {
       ZBA_ERR("Failed to connect to camera: {}.", responseCode);
+      ++capture_errors_;
       break;
     }
   }
@@ -28,10 +28,33 @@ std::ostream& operator<<(std::ostream& os, const CameraInfo& camInfo)
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const CompositeInfo& compInfo)
+{
+  os << "Composite: " << compInfo.name << " bus:<" << compInfo.bus << "> vid:pid: (" << std::hex
+     << compInfo.vid << ":" << compInfo.pid << std::dec << ")" << std::endl;
+  for (const auto& node : compInfo.nodes)
+  {
+    os << "    node " << node.index << ": [" << node.path << "] " << node.name << std::endl;
+  }
+  return os;
+}
+
 std::ostream& operator<<(std::ostream& os, const FormatInfo& fmtInfo)
 {
-  os << "(" << fmtInfo.width << ", " << fmtInfo.height << ") " << fmtInfo.format;
-  if (fmtInfo.fps > std::numeric_limits<float>::epsilon())
+  if (fmtInfo.HasSizeRange())
+  {
+    os << "(" << fmtInfo.min_width << "-" << fmtInfo.width << ", " << fmtInfo.min_height << "-"
+       << fmtInfo.height << ") " << fmtInfo.format;
+  }
+  else
+  {
+    os << "(" << fmtInfo.width << ", " << fmtInfo.height << ") " << fmtInfo.format;
+  }
+  if (fmtInfo.HasFpsRange())
+  {
+    os << " @" << fmtInfo.min_fps << "-" << fmtInfo.fps << "fps";
+  }
+  else if (fmtInfo.fps > std::numeric_limits<float>::epsilon())
   {
     os << " @" << fmtInfo.fps << "fps";
   }
@@ -50,11 +73,26 @@ bool FormatInfo::operator<(const FormatInfo& f) const
   else if (height > f.height)
     return true;
 
+  if (min_width < f.min_width)
+    return false;
+  else if (min_width > f.min_width)
+    return true;
+
+  if (min_height < f.min_height)
+    return false;
+  else if (min_height > f.min_height)
+    return true;
+
   if (fps < f.fps)
     return false;
   else if (fps > f.fps)
     return true;
 
+  if (min_fps < f.min_fps)
+    return false;
+  else if (min_fps > f.min_fps)
+    return true;
+
   if (channels < f.channels)
     return false;
   else if (channels > f.channels)
@@ -75,106 +113,77 @@ bool FormatInfo::operator<(const FormatInfo& f) const
 
 bool FormatInfo::Matches(const FormatInfo& f) const
 {
-  if ((width != f.width) && (width) && (f.width)) return false;
-  if ((height != f.height) && (height) && (f.height)) return false;
+  // Sizes in a range match anywhere in it - SetFormat() rounds them to a step.
+  auto smallest = [](int size, int min_size) { return (min_size > 0) ? min_size : size; };
+  if ((width) && (f.width) &&
+      ((smallest(width, min_width) > f.width) || (smallest(f.width, f.min_width) > width)))
+    return false;
+  if ((height) && (f.height) &&
+      ((smallest(height, min_height) > f.height) || (smallest(f.height, f.min_height) > height)))
+    return false;
   if ((channels != f.channels) && (channels) && (f.channels)) return false;
-  if ((format != f.format) && (!format.empty()) && (!f.format.empty())) return false;
-  // 0.1 because 29.97 and 30, but calculated value.
-  if ((std::abs(fps - f.fps) >= 0.1) && (fps > std::numeric_limits<float>::epsilon()) &&
+  if ((format != f.format) && (!format.empty()) && (!f.format.empty()))
+  {
+    // Padded and unpadded FourCCs are the same format.
+    if (PixelFormatFromString(format) != PixelFormatFromString(f.format)) return false;
+  }
+  // 0.1 because 29.97 and 30, but calculated value.  Ranges match if they overlap.
+  if ((fps > std::numeric_limits<float>::epsilon()) &&
       (f.fps > std::numeric_limits<float>::epsilon()))
-    return false;
+  {
+    float slowest   = HasFpsRange() ? min_fps : fps;
+    float f_slowest = f.HasFpsRange() ? f.min_fps : f.fps;
+    if ((slowest - f.fps >= 0.1) || (f_slowest - fps >= 0.1)) return false;
+  }
   return true;
 }
 
 uint32_t FourCCToUInt32(const std::string& fmt_format)
 {
-  if (fmt_format.empty()) return 0;
+  return static_cast<uint32_t>(PixelFormatFromString(fmt_format));
+}
+
+PixelFormat PixelFormatFromString(const std::string& fourcc)
+{
+  if (fourcc.empty()) return PixelFormat::UNKNOWN;
 
   // {TODO} OK, sometimes these are GUIDs... we'll want to add support for those later.
-  if (fmt_format.length() > 4)
+  if (fourcc.length() > 4)
   {
-    ZBA_LOG("Invalid frame format string: {}", fmt_format);
-    return 0;
+    ZBA_LOG("Invalid frame format string: {}", fourcc);
+    return PixelFormat::UNKNOWN;
   }
 
   // Linux space-pads, but Windows doesn't.
-  auto tmpFmt = fmt_format;
-  while (tmpFmt.length() < 4)
+  uint32_t code = 0;
+  for (size_t i = 0; i < 4; ++i)
   {
-    tmpFmt.append(" ");
+    uint32_t c = (i < fourcc.length()) ? static_cast<uint8_t>(fourcc[i]) : ' ';
+    code |= c << (i * 8);
   }
-  return *reinterpret_cast<const uint32_t*>(tmpFmt.data());
+  return static_cast<PixelFormat>(code);
 }
 
-int ChannelsFromFourCC(const std::string& fmt_format)
+std::string PixelFormatToString(PixelFormat format)
 {
-  switch (FourCCToUInt32(fmt_format))
+  if (format == PixelFormat::UNKNOWN) return "";
+  uint32_t code = static_cast<uint32_t>(format);
+  std::string fourcc(4, ' ');
+  for (size_t i = 0; i < 4; ++i)
   {
-#if _WIN32
-    case FOURCCTOUINT32("YUY2"):
-#else
-    case FOURCCTOUINT32("YUYV"):
-#endif
-      return 3;
-    case FOURCCTOUINT32("MJPG"):
-      return 3;
-    case FOURCCTOUINT32("NV12"):
-      return 3;
-    case FOURCCTOUINT32("RGB "):
-    case FOURCCTOUINT32("BGR "):
-      return 3;
-    case FOURCCTOUINT32("RGBA"):
-    case FOURCCTOUINT32("BGRA"):
-    case FOURCCTOUINT32("RGBT"):
-    case FOURCCTOUINT32("BGRT"):
-      return 4;
-    case FOURCCTOUINT32("D16 "):  // Windows Depth
-    case FOURCCTOUINT32("L8  "):  // Windows IR
-    case FOURCCTOUINT32("Z16 "):  // Linux Depth
-    case FOURCCTOUINT32("GREY"):  // Linux IR
-      return 1;
-    case 0:
-      return 0;
-    default:
-      // ZBA_LOG("Unsupported format");
-      return 0;
+    fourcc[i] = static_cast<char>((code >> (i * 8)) & 0xff);
   }
+  return fourcc;
+}
+
+int ChannelsFromFourCC(const std::string& fmt_format)
+{
+  return GetPixelFormatInfo(PixelFormatFromString(fmt_format)).channels;
 }
 
 int BytesPPPCFromFourCC(const std::string& fmt_format)
 {
-  switch (FourCCToUInt32(fmt_format))
-  {
-#if _WIN32
-    case FOURCCTOUINT32("YUY2"):
-#else
-    case FOURCCTOUINT32("YUYV"):
-#endif
-      return 1;
-    case FOURCCTOUINT32("NV12"):
-      return 1;
-    case FOURCCTOUINT32("RGB "):
-    case FOURCCTOUINT32("BGR "):
-      return 1;
-    case FOURCCTOUINT32("MJPG"):
-      return 1;
-    case FOURCCTOUINT32("RGBA"):
-    case FOURCCTOUINT32("BGRA"):
-    case FOURCCTOUINT32("RGBT"):
-    case FOURCCTOUINT32("BGRT"):
-      return 1;
-    case FOURCCTOUINT32("Z16 "):  // Linux
-    case FOURCCTOUINT32("D16 "):  // Windows
-      return 2;
-    case FOURCCTOUINT32("GREY"):  // Linux
-    case FOURCCTOUINT32("L8  "):  // Windows
-      return 1;
-    case 0:
-      return 0;
-    default:
-      // ZBA_LOG("Unsupported format");
-      return 0;
-  }
+  return GetPixelFormatInfo(PixelFormatFromString(fmt_format)).bytes_per_component;
 }
 
 }  // namespace zebral
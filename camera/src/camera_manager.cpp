@@ -2,8 +2,10 @@
 /// CameraManager for enumerating and creating cameras
 
 #include "camera_manager.hpp"
+#include <algorithm>
 #include <functional>
 #include <regex>
+#include "camera_composite.hpp"
 #include "camera_info.hpp"
 #include "camera_platform.hpp"
 #include "errors.hpp"
@@ -27,4 +29,43 @@ std::shared_ptr<Camera> CameraManager::Create(const CameraInfo& info)
   return std::shared_ptr<Camera>(new CameraPlatform(info));
 }
 
+std::vector<CompositeInfo> CameraManager::EnumerateComposites()
+{
+  return GroupComposites(Enumerate());
+}
+
+std::vector<CompositeInfo> CameraManager::GroupComposites(const std::vector<CameraInfo>& cameras)
+{
+  // Nodes of one USB device report the same bus path (and vid/pid).
+  std::vector<CompositeInfo> composites;
+  for (const auto& camera : cameras)
+  {
+    if ((camera.vid == 0) || camera.bus.empty()) continue;
+    auto iter = std::find_if(composites.begin(), composites.end(), [&](const auto& composite) {
+      return (composite.bus == camera.bus) && (composite.vid == camera.vid) &&
+             (composite.pid == camera.pid);
+    });
+    if (iter == composites.end())
+    {
+      composites.push_back({camera.name, camera.bus, camera.vid, camera.pid, {camera}});
+    }
+    else
+    {
+      iter->nodes.push_back(camera);
+    }
+  }
+  std::erase_if(composites, [](const auto& composite) { return composite.nodes.size() < 2; });
+  return composites;
+}
+
+std::shared_ptr<CompositeCamera> CameraManager::CreateComposite(const CompositeInfo& info)
+{
+  std::vector<std::shared_ptr<Camera>> nodes;
+  for (const auto& node : info.nodes)
+  {
+    nodes.push_back(Create(node));
+  }
+  return std::make_shared<CompositeCamera>(info, nodes);
+}
+
 }  // namespace zebral
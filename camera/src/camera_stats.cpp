@@ -0,0 +1,155 @@
+/// \file camera_stats.cpp
+/// Implementation of camera performance counters
+#include "camera_stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "platform.hpp"
+
+namespace zebral
+{
+namespace
+{
+/// Duration in microseconds, for printing
+double Micros(std::chrono::nanoseconds duration)
+{
+  return static_cast<double>(duration.count()) / 1000.0;
+}
+}  // namespace
+
+std::chrono::nanoseconds TimingStats::mean() const
+{
+  if (count == 0) return std::chrono::nanoseconds(0);
+  return total / static_cast<int64_t>(count);
+}
+
+std::chrono::nanoseconds TimingStats::BucketLimit(size_t bucket)
+{
+  if (bucket + 1 >= kBuckets) return std::chrono::nanoseconds::max();
+  return std::chrono::microseconds(int64_t(1) << bucket);
+}
+
+std::chrono::nanoseconds TimingStats::Percentile(double fraction) const
+{
+  if (count == 0) return std::chrono::nanoseconds(0);
+  auto target   = static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i)
+  {
+    seen += buckets[i];
+    if ((seen >= target) && (seen > 0))
+    {
+      return std::min(BucketLimit(i), max);
+    }
+  }
+  return max;
+}
+
+TimingHistogram::TimingHistogram()
+    : count_(0),
+      total_ns_(0),
+      max_ns_(0),
+      last_ns_(0)
+{
+  for (auto& bucket : buckets_)
+  {
+    bucket = 0;
+  }
+}
+
+void TimingHistogram::Record(std::chrono::nanoseconds duration)
+{
+  int64_t ns    = std::max<int64_t>(duration.count(), 0);
+  auto micros   = static_cast<uint64_t>(ns / 1000);
+  size_t bucket = std::min<size_t>(std::bit_width(micros), TimingStats::kBuckets - 1);
+
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  total_ns_.fetch_add(ns, std::memory_order_relaxed);
+  last_ns_.store(ns, std::memory_order_relaxed);
+  int64_t cur_max = max_ns_.load(std::memory_order_relaxed);
+  while ((ns > cur_max) && !max_ns_.compare_exchange_weak(cur_max, ns))
+  {
+  }
+  count_.fetch_add(1, std::memory_order_release);
+}
+
+TimingStats TimingHistogram::Snapshot() const
+{
+  TimingStats stats;
+  stats.count = count_.load(std::memory_order_acquire);
+  stats.total = std::chrono::nanoseconds(total_ns_.load(std::memory_order_relaxed));
+  stats.max   = std::chrono::nanoseconds(max_ns_.load(std::memory_order_relaxed));
+  stats.last  = std::chrono::nanoseconds(last_ns_.load(std::memory_order_relaxed));
+  for (size_t i = 0; i < TimingStats::kBuckets; ++i)
+  {
+    stats.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void TimingHistogram::Reset()
+{
+  count_    = 0;
+  total_ns_ = 0;
+  max_ns_   = 0;
+  last_ns_  = 0;
+  for (auto& bucket : buckets_)
+  {
+    bucket = 0;
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const TimingStats& stats)
+{
+  os << zba_format("n={} mean={:.1f}us p50={:.1f}us p99={:.1f}us max={:.1f}us", stats.count,
+                   Micros(stats.mean()), Micros(stats.Percentile(0.5)),
+                   Micros(stats.Percentile(0.99)), Micros(stats.max));
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const CameraStats& stats)
+{
+  os << zba_format("  fps: {:.2f}  captured: {}  delivered: {}  throttled: {}  dropped: {}",
+                   stats.fps, stats.captured, stats.delivered, stats.throttled, stats.dropped)
+     << std::endl;
+  os << zba_format("  errors: {}  timeouts: {}  paused: {}", stats.errors, stats.timeouts,
+                   stats.paused)
+     << std::endl;
+  if (!stats.queue_depth.empty())
+  {
+    os << zba_format("  buffers: {}  driver dropped: {}  queue depth:", stats.buffers,
+                     stats.driver_dropped);
+    for (auto count : stats.queue_depth)
+    {
+      os << " " << count;
+    }
+    os << std::endl;
+  }
+  if (stats.lent || stats.loans_refused || stats.loans_out)
+  {
+    os << zba_format("  lent: {}  refused: {}  on loan: {}", stats.lent, stats.loans_refused,
+                     stats.loans_out)
+       << std::endl;
+  }
+  os << "  decode:        " << stats.decode << std::endl;
+  os << "  publish:       " << stats.publish << std::endl;
+  os << "  driver->user:  " << stats.driver_to_user << std::endl;
+  os << "  capture->user: " << stats.capture_to_user << std::endl;
+  os << "  callback:      " << stats.callback
+     << zba_format("  pending: {}  skipped: {}", stats.pending_callbacks,
+                   stats.callbacks_skipped)
+     << std::endl;
+  for (const auto& subscriber : stats.subscribers)
+  {
+    os << zba_format("  subscriber {}: delivered: {}  dropped: {}  throttled: {}  queued: {}",
+                     subscriber.name, subscriber.delivered, subscriber.dropped,
+                     subscriber.throttled, subscriber.queued)
+       << std::endl;
+    os << "    latency: " << subscriber.latency << std::endl;
+  }
+  return os;
+}
+
+}  // namespace zebral
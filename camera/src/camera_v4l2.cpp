@@ -4,9 +4,14 @@
 #include "camera_platform.hpp"
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <memory>
@@ -29,18 +34,33 @@
 
 namespace zebral
 {
+namespace
+{
+/// How long the capture thread waits for a frame before counting a timeout
+constexpr int kFrameTimeoutMs = 5000;
+
+/// Frames per second from a V4L2 frame interval, rounded to 2 significant digits (e.g. 29.97)
+float IntervalToFps(const v4l2_fract& interval)
+{
+  if ((interval.numerator == 0) || (interval.denominator == 0)) return 0.0f;
+  return std::round(100.0f * static_cast<float>(interval.denominator) /
+                    static_cast<float>(interval.numerator)) /
+         100.0f;
+}
+}  // namespace
+
 /// CameraPlatform's implementation details
 class CameraPlatform::Impl
 {
  public:
   // Constructor = opens the device
   Impl(CameraPlatform* parent);
-  ~Impl() = default;
+  ~Impl();
 
   /// Callback for EnumerateModes
   /// Returning false stops the enumeration.
   typedef std::function<bool(const v4l2_fmtdesc&, const v4l2_frmsizeenum&,
-                             const FormatInfo& fmt_info)>
+                             const v4l2_frmivalenum&, const FormatInfo& fmt_info)>
       ModeCallback;
 
   /// Enumerated all modes available on current device,
@@ -50,12 +70,37 @@ class CameraPlatform::Impl
   /// Enumerate controls and set up enabled ones.
   void EnumerateControls();
 
+  /// Puts the device's crop back to its default (usually the whole sensor), if it can crop
+  void ResetCrop();
+
+  /// Crops on the device with VIDIOC_S_SELECTION, or VIDIOC_S_CROP on older drivers
+  /// \param rect - crop to set; receives the one the driver chose
+  /// \returns true if the device cropped, false if it can't
+  bool SetCrop(CropRect& rect);
+
+  /// Sets the frame interval with VIDIOC_S_PARM - the driver picks the nearest it supports.
+  /// Call while stopped, after setting the format.
+  /// \param interval - time per frame, or 0/0 to leave the rate as it is
+  /// \returns float - frame rate the driver is now set to, 0 if it can't set rates
+  float SetFrameInterval(const v4l2_fract& interval);
+
   /// Enumerates ALL the controls.
   void EnumerateAllControls();
 
   /// Thread that reads data from the camera and calls callbacks
   void CaptureThread();
 
+  /// Converts a filled buffer into the current frame, requeues it and publishes the frame
+  /// \param buffer - buffer dequeued from the driver
+  void HandleBuffer(BufferMemmap& buffer);
+
+  /// Dequeues every filled buffer and handles them - when the device is readable
+  void ServiceBuffers();
+
+  /// Records that capture failed and the stream is dead until restarted
+  /// \param reason - what went wrong
+  void OnCaptureFailed(const std::string& reason);
+
   /// Starts the camera
   void Start();
 
@@ -90,12 +135,28 @@ class CameraPlatform::Impl
   /// \param to_auto - if true, set in automatic mode
   void SetAutoMode(ParamRanged<double, double>* param, bool to_auto);
 
-  static constexpr int kNumBuffers = 1;   ///< Number of buffers to allocate
-  std::unique_ptr<BufferGroup> buffers_;  ///< Buffer group for buffers
+  /// A mode from the device's enumeration, with what VIDIOC_S_FMT needs to set it
+  struct Mode
+  {
+    FormatInfo format;     ///< Mode as enumerated
+    uint32_t pixelformat;  ///< V4L2 pixel format
+    uint32_t width;        ///< Frame width in pixels, the largest for a range of sizes
+    uint32_t height;       ///< Frame height in pixels, the largest for a range of sizes
+    v4l2_fract interval;   ///< Enumerated frame interval, 0/0 for a range of rates
+  };
+
+  std::vector<Mode> modes_;               ///< Every mode, enumerated when the device is opened
+  std::shared_ptr<BufferGroup> buffers_;  ///< Buffer group for buffers, shared with loans
   CameraPlatform& parent_;                ///< Parent camera object
   DeviceV4L2Ptr device_;                  ///< Camera device file descriptor
   bool started_;                          ///< True if started.
-  std::thread camera_thread_;
+  std::thread camera_thread_;             ///< Runs CaptureThread(), if not reactor_
+  int wake_fd_;                           ///< eventfd that wakes camera_thread_ to stop
+
+  std::shared_ptr<CaptureReactor> reactor_;  ///< Reactor servicing us, if not camera_thread_
+  std::vector<BufferMemmap*> ready_;         ///< Buffers dequeued together
+  bool have_sequence_;                       ///< last_sequence_ is set
+  uint32_t last_sequence_;                   ///< Driver sequence of the last buffer
 
   std::mutex paramControlMutex_;
   std::map<std::string, int> paramControlMap_;  ///< name -> ctrl id
@@ -108,7 +169,6 @@ class CameraPlatform::Impl
   std::map<std::string, std::shared_ptr<Param>> paramAutoParams_;  ///< name->param
 
   std::map<int, std::string> controlParamMap_;  //
-  double cameraTimeBase_;
 };
 
 bool CameraPlatform::Impl::AddParameter(v4l2_queryctrl& queryctrl, const std::string& override_name,
@@ -373,26 +433,20 @@ std::vector<CameraInfo> CameraPlatform::Enumerate()
   return cameras;
 }
 
-FormatInfo CameraPlatform::OnSetFormat(const FormatInfo& info)  // info)
+FormatInfo CameraPlatform::OnSetFormat(const FormatInfo& info)
 {
-  v4l2_fmtdesc vfmtdesc;
-  v4l2_frmsizeenum vsize;
-  FormatInfo fmt_info = info;
-
-  auto findFormat = [&](const v4l2_fmtdesc& fmtdesc, const v4l2_frmsizeenum& frmsize,
-                        const FormatInfo& checkFmt) {
-    if (info.Matches(checkFmt))
-    {
-      fmt_info = checkFmt;
-      vfmtdesc = fmtdesc;
-      vsize    = frmsize;
-      return false;
-    }
-    return true;
-  };
+  // Look the mode up in the table enumerated when the device was opened, rather than
+  // walking the driver's formats, sizes and intervals again.
+  const auto& modes = impl_->modes_;
+  auto matches      = [&](const auto& entry) { return info.Matches(entry.format); };
+  auto mode         = std::find_if(modes.begin(), modes.end(), matches);
+  if (mode == modes.end())
+  {
+    ZBA_THROW("Mode not available on device", Result::ZBA_UNSUPPORTED_FMT);
+  }
 
-  // Enumerate modes with the lambda above to find the matching format
-  impl_->EnumerateModes(findFormat);
+  // Clear any crop from the last mode before the format is set.
+  impl_->ResetCrop();
 
   // ok, now got the match requested...
   v4l2_format vfmt;
@@ -410,152 +464,427 @@ FormatInfo CameraPlatform::OnSetFormat(const FormatInfo& info)  // info)
   v4l2_pix_format& pfmt = reinterpret_cast<v4l2_pix_format&>(vfmt.fmt);
 
   vfmt.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  pfmt.pixelformat = vfmtdesc.pixelformat;
-  pfmt.width       = vsize.discrete.width;
-  pfmt.height      = vsize.discrete.height;
+  pfmt.pixelformat = mode->pixelformat;
+  pfmt.width       = mode->width;
+  pfmt.height      = mode->height;
+  if (mode->format.HasSizeRange() && (info.width > 0) && (info.height > 0))
+  {
+    pfmt.width  = info.width;
+    pfmt.height = info.height;
+  }
 
-  // Set the format
+  // Set the format - the driver adjusts the size to one it supports, and returns it.
   result = impl_->device_->ioctl(VIDIOC_S_FMT, &vfmt);
   if (-1 == result)
   {
     ZBA_THROW("Unable to set format", Result::ZBA_UNSUPPORTED_FMT);
   }
+  FormatInfo fmt_info  = mode->format;
+  fmt_info.width       = pfmt.width;
+  fmt_info.height      = pfmt.height;
+  fmt_info.min_width   = 0;
+  fmt_info.min_height  = 0;
+  fmt_info.step_width  = 0;
+  fmt_info.step_height = 0;
+
+  // Crop on the sensor if the driver can - otherwise Camera crops frames in software.
+  // Setting the format to the crop's size afterwards asks for it unscaled, and the
+  // driver returns the size it will actually deliver.
+  CropRect crop = crop_;
+  if (!crop.empty() && impl_->SetCrop(crop))
+  {
+    pfmt.width  = crop.width;
+    pfmt.height = crop.height;
+    if ((-1 == impl_->device_->ioctl(VIDIOC_S_FMT, &vfmt)) &&
+        (-1 == impl_->device_->ioctl(VIDIOC_G_FMT, &vfmt)))
+    {
+      ZBA_THROW("Unable to get cropped format", Result::ZBA_UNSUPPORTED_FMT);
+    }
+    fmt_info.width  = pfmt.width;
+    fmt_info.height = pfmt.height;
+    crop_applied_   = crop;
+    crop_mode_      = CropMode::HARDWARE;
+  }
 
+  // Set the rate - the enumerated interval, or for a range, the rate asked for - and
+  // report the one the driver actually chose.
+  v4l2_fract interval = mode->interval;
+  if ((interval.denominator == 0) && (info.fps > 0) && !info.HasFpsRange())
+  {
+    interval = {100, static_cast<uint32_t>(std::lround(info.fps * 100.0f))};
+  }
+  float fps = impl_->SetFrameInterval(interval);
+  if (fps > 0)
+  {
+    if (!info.HasFpsRange() && (info.fps > 0) && (std::abs(fps - info.fps) >= 0.1f))
+    {
+      ZBA_LOG("{} is running at {}fps rather than {}fps", info_.name, fps, info.fps);
+    }
+    fmt_info.fps     = fps;
+    fmt_info.min_fps = 0;
+  }
   return fmt_info;
 }
 
+void CameraPlatform::Impl::ResetCrop()
+{
+  v4l2_selection selection;
+  memset(&selection, 0, sizeof(selection));
+  selection.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  selection.target = V4L2_SEL_TGT_CROP_DEFAULT;
+  if (0 == device_->ioctl(VIDIOC_G_SELECTION, &selection))
+  {
+    selection.target = V4L2_SEL_TGT_CROP;
+    device_->ioctl(VIDIOC_S_SELECTION, &selection);
+    return;
+  }
+
+  v4l2_cropcap cropcap;
+  memset(&cropcap, 0, sizeof(cropcap));
+  cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (0 == device_->ioctl(VIDIOC_CROPCAP, &cropcap))
+  {
+    v4l2_crop crop;
+    memset(&crop, 0, sizeof(crop));
+    crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    crop.c    = cropcap.defrect;
+    device_->ioctl(VIDIOC_S_CROP, &crop);
+  }
+}
+
+bool CameraPlatform::Impl::SetCrop(CropRect& rect)
+{
+  const v4l2_rect requested = {rect.x, rect.y, static_cast<uint32_t>(rect.width),
+                               static_cast<uint32_t>(rect.height)};
+
+  // The driver adjusts the rectangle to what it can do, and returns it.
+  v4l2_selection selection;
+  memset(&selection, 0, sizeof(selection));
+  selection.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  selection.target = V4L2_SEL_TGT_CROP;
+  selection.r      = requested;
+  v4l2_rect applied;
+  if (0 == device_->ioctl(VIDIOC_S_SELECTION, &selection))
+  {
+    applied = selection.r;
+  }
+  else
+  {
+    // Older drivers only have the crop ioctls.
+    v4l2_crop crop;
+    memset(&crop, 0, sizeof(crop));
+    crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    crop.c    = requested;
+    if ((-1 == device_->ioctl(VIDIOC_S_CROP, &crop)) ||
+        (-1 == device_->ioctl(VIDIOC_G_CROP, &crop)))
+    {
+      ZBA_LOG("{} can't crop on the device, cropping frames instead", parent_.info_.name);
+      return false;
+    }
+    applied = crop.c;
+  }
+
+  rect = {applied.left, applied.top, static_cast<int>(applied.width),
+          static_cast<int>(applied.height)};
+  return true;
+}
+
+float CameraPlatform::Impl::SetFrameInterval(const v4l2_fract& interval)
+{
+  v4l2_streamparm parm;
+  memset(&parm, 0, sizeof(parm));
+  parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if ((-1 == device_->ioctl(VIDIOC_G_PARM, &parm)) ||
+      !(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
+  {
+    ZBA_LOG("Frame rate can't be set on {}", parent_.info_.name);
+    return 0.0f;
+  }
+
+  if (interval.denominator != 0)
+  {
+    // The driver adjusts the interval to the nearest it supports, and returns it.
+    parm.parm.capture.timeperframe = interval;
+    if (-1 == device_->ioctl(VIDIOC_S_PARM, &parm))
+    {
+      ZBA_THROW_ERRNO("Unable to set frame rate", Result::ZBA_UNSUPPORTED_FMT);
+    }
+  }
+  return IntervalToFps(parm.parm.capture.timeperframe);
+}
+
 void CameraPlatform::Impl::Start()
 {
-  buffers_ = std::make_unique<BufferGroup>(device_, kNumBuffers);
+  // The driver won't reallocate buffers while the last stream's are still mapped.
+  if (parent_.HasLoansOut())
+  {
+    ZBA_THROW("Buffers from the last stream are still on loan", Result::ZBA_CAMERA_ERROR);
+  }
+  if (parent_.buffer_memory_ == BufferMemory::USERPTR)
+  {
+    // User pointer buffers have to hold a whole image of the current format.
+    v4l2_format vfmt;
+    memset(&vfmt, 0, sizeof(vfmt));
+    vfmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (-1 == device_->ioctl(VIDIOC_G_FMT, &vfmt))
+    {
+      ZBA_THROW("Unable to get format", Result::ZBA_UNSUPPORTED_FMT);
+    }
+    size_t image_size = vfmt.fmt.pix.sizeimage;
+    for (const auto& buffer : parent_.user_buffers_)
+    {
+      if (buffer.size < image_size)
+      {
+        ZBA_THROW(zba_format("User buffer of {} bytes can't hold a {} byte image", buffer.size,
+                             image_size),
+                  Result::ZBA_INVALID_RANGE);
+      }
+    }
+    buffers_ = std::make_shared<BufferGroup>(
+        device_, parent_.user_buffers_, parent_.buffer_count_, image_size,
+        FrameAllocator<uint8_t>(GetDefaultFrameMemory(), parent_.frame_account_));
+  }
+  else
+  {
+    buffers_ = std::make_shared<BufferGroup>(device_, parent_.buffer_count_);
+  }
+  if (parent_.dmabuf_export_)
+  {
+    buffers_->ExportAll();
+  }
+  parent_.allocated_buffers_ = buffers_->size();
+
+  // Queue up buffers
+  buffers_->QueueAll();
+  ready_.reserve(buffers_->size());
+  have_sequence_ = false;
 
   // Start streaming
   if (-1 == device_->start_video_stream())
   {
     ZBA_THROW("Error starting streaming!", Result::ZBA_CAMERA_ERROR);
   }
-  camera_thread_ = std::thread(&CameraPlatform::Impl::CaptureThread, this);
-  started_       = true;
+
+  // Serviced by the reactor's threads if there is one, otherwise our own.
+  reactor_ = parent_.capture_reactor_;
+  if (reactor_)
+  {
+    reactor_->Add(
+        *device_, [this] { ServiceBuffers(); },
+        [this](const std::string& reason) { OnCaptureFailed(reason); });
+  }
+  else
+  {
+    camera_thread_ = std::thread(&CameraPlatform::Impl::CaptureThread, this);
+  }
+  started_ = true;
 }
 
 void CameraPlatform::Impl::Stop()
 {
   // Stop thread
+  if (reactor_)
+  {
+    reactor_->Remove(*device_);
+    reactor_.reset();
+  }
   if (camera_thread_.joinable())
   {
+    // Wake the thread now rather than when its wait times out, then reset the eventfd.
+    uint64_t wake = 1;
+    if (write(wake_fd_, &wake, sizeof(wake)) < 0)
+    {
+      ZBA_ERRNO("Error waking capture thread");
+    }
     camera_thread_.join();
+    if (read(wake_fd_, &wake, sizeof(wake)) < 0)
+    {
+      ZBA_ERRNO("Error resetting capture thread wake");
+    }
   }
 
   // Stop streaming
   if (started_)
   {
+    buffers_->Stop();
     if (-1 == device_->stop_video_stream())
     {
       ZBA_THROW("Error stopping streaming!", Result::ZBA_CAMERA_ERROR);
     }
-    // Unmap
+    // Unmap (once any buffers on loan are returned)
     buffers_.reset();
-    started_ = false;
+    parent_.allocated_buffers_ = 0;
+    started_                   = false;
   }
 }
 
 void CameraPlatform::Impl::CaptureThread()
 {
-  // Queue up buffers
-  buffers_->QueueAll();
-
-  size_t bufIdx = 0;
+  pollfd fds[2] = {{*device_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
   while (!parent_.exiting_)
   {
-    int result = device_->select(5.0f);
+    fds[0].revents = fds[1].revents = 0;
+    int result = ::poll(fds, 2, kFrameTimeoutMs);
 
     if (-1 == result)
     {
       if ((EINTR == errno) || (EAGAIN == errno)) continue;
+      OnCaptureFailed(zba_format("poll failed: {}", strerror(errno)));
+      break;
     }
     else if (0 == result)
     {
       ZBA_LOG("Frame timed out on {}", parent_.info_.name);
+      ++parent_.capture_timeouts_;
       continue;
     }
 
-    // Get a buffer
-    if (!buffers_->Get(bufIdx).Dequeue()) continue;
+    // Woken by Stop()
+    if (fds[1].revents & POLLIN) break;
 
-    // Get the buffer timestamp, convert to seconds and add to our time base
-    auto hwTimestamp = buffers_->Get(bufIdx).GetTimestamp();
-    double frameTimeOffset =
-        hwTimestamp.tv_sec + static_cast<double>(hwTimestamp.tv_usec) / 1000000.0;
-    double epochSec = cameraTimeBase_ + frameTimeOffset;
+    // An unplugged or broken device stays "ready" forever - stop rather than spin on it.
+    if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+    {
+      OnCaptureFailed((fds[0].revents & POLLHUP) ? "device hung up" : "device reported an error");
+      break;
+    }
+
+    try
+    {
+      ServiceBuffers();
+    }
+    catch (const std::exception& e)
+    {
+      OnCaptureFailed(e.what());
+      break;
+    }
+  }
+  ZBA_LOG("CaptureThread exiting...");
+}
+
+void CameraPlatform::Impl::OnCaptureFailed(const std::string& reason)
+{
+  ZBA_ERR("Capture failed on {}: {}", parent_.info_.name, reason);
+  ++parent_.capture_errors_;
+  parent_.running_ = false;
+}
 
-    // Now convert that back into a TimeStamp (time_point on our current clock)
-    std::chrono::duration<double, std::ratio<1>> epochSecPoint(epochSec);
-    auto since_epoch = std::chrono::duration_cast<zebral::Clock::duration>(epochSecPoint);
-    TimeStamp frame_timestamp(since_epoch);
+void CameraPlatform::Impl::ServiceBuffers()
+{
+  // Take every buffer the driver has filled - how many there are says how far behind we
+  // are - then handle them oldest first.
+  ready_.clear();
+  while (auto buffer = buffers_->Dequeue())
+  {
+    ready_.push_back(buffer);
+  }
+  if (ready_.empty())
+  {
+    ++parent_.capture_errors_;
+    return;
+  }
+  parent_.CountBufferQueue(ready_.size());
 
-    auto format_if_set = parent_.GetFormat();
-    if (format_if_set)
+  for (auto buffer : ready_)
+  {
+    // Sequence numbers the driver skipped are frames it dropped.
+    uint32_t sequence = buffer->GetSequence();
+    if (have_sequence_ && (sequence - last_sequence_ > 1))
     {
-      auto format = *format_if_set;
-      /*
-      if (parent_.decode_ == DecodeType::SYSTEM)
-      {
-        // If we've got V4L2 converting to BGRA for us {TODO}
-        BGRAToBGRAFrame(buffers_[buffer.index].data, parent_.cur_frame_, src_stride);
-      }
-      else
-      */
+      parent_.driver_dropped_ += sequence - last_sequence_ - 1;
+    }
+    have_sequence_ = true;
+    last_sequence_ = sequence;
 
-      /// {TODO} Don't have system decoding yet for Linux, soon....
-      /// Also fix decisions so we're not doing compares like this.
-      if ((parent_.decode_ == DecodeType::SYSTEM) || (parent_.decode_ == DecodeType::INTERNAL))
-      {
-        if (format.format == "GREY")
-        {
-          int src_stride = parent_.cur_frame_.width();
-          GreyToFrame(reinterpret_cast<uint8_t*>(buffers_->Get(bufIdx).Data()), parent_.cur_frame_,
-                      src_stride);
-        }
-        else if (format.format == "Z16 ")
-        {
-          int src_stride = parent_.cur_frame_.width() * 2;
-          GreyToFrame(reinterpret_cast<uint8_t*>(buffers_->Get(bufIdx).Data()), parent_.cur_frame_,
-                      src_stride);
-        }
-        else if (format.format == "YUYV")
-        {
-          int src_stride = (parent_.cur_frame_.width() * 2);
-          YUY2ToBGRFrame(reinterpret_cast<uint8_t*>(buffers_->Get(bufIdx).Data()),
-                         parent_.cur_frame_, src_stride);
-        }
-        else if (format.format == "NV12")
-        {
-          int src_stride = (parent_.cur_frame_.width());
-          NV12ToBGRFrame(reinterpret_cast<uint8_t*>(buffers_->Get(bufIdx).Data()),
-                         parent_.cur_frame_, src_stride);
-        }
-      }
-      else
+    HandleBuffer(*buffer);
+  }
+}
+
+void CameraPlatform::Impl::HandleBuffer(BufferMemmap& buffer)
+{
+  FrameTiming timing{};
+  timing.dequeued = TimeStampNow();
+
+  // The driver stamps buffers with CLOCK_MONOTONIC, the same clock as our TimeStamps,
+  // so it's used as-is (in whole nanoseconds).  Drivers that don't get the dequeue time.
+  TimeStamp frame_timestamp = timing.dequeued;
+  if (buffer.HasMonotonicTimestamp())
+  {
+    auto hwTimestamp = buffer.GetTimestamp();
+    frame_timestamp  = TimeStamp(std::chrono::duration_cast<zebral::Clock::duration>(
+        std::chrono::seconds(hwTimestamp.tv_sec) +
+        std::chrono::microseconds(hwTimestamp.tv_usec)));
+  }
+
+  // Throttled - hand the buffer straight back without converting it.
+  if (!parent_.AcceptFrame(frame_timestamp))
+  {
+    buffer.Queue();
+    return;
+  }
+
+  // Raw frames can be lent to a consumer as-is; the buffer is requeued when it lets go.
+  FrameLoan loan;
+  loan.data        = reinterpret_cast<const uint8_t*>(buffer.Data());
+  loan.size        = buffer.BytesUsed();
+  loan.timestamp   = frame_timestamp;
+  loan.timing      = timing;
+  loan.hw_sequence = buffer.GetSequence();
+  loan.dmabuf_fd   = buffer.DmabufFd();
+  if (parent_.LendBuffer(loan, [group = buffers_, &buffer] { group->Return(buffer); }))
+  {
+    return;
+  }
+
+  // Mode is set before the thread starts, so no need to copy it for each frame.
+  if (parent_.current_mode_)
+  {
+    const auto& traits = parent_.current_mode_->traits();
+    /*
+    if (parent_.decode_ == DecodeType::SYSTEM)
+    {
+      // If we've got V4L2 converting to BGRA for us {TODO}
+      BGRAToBGRAFrame(buffers_[buffer.index].data, parent_.cur_frame_, src_stride);
+    }
+    else
+    */
+
+    /// {TODO} Don't have system decoding yet for Linux, soon....
+    /// DEFERRED copies the raw buffer and leaves decoding to whoever reads the frame.
+    if ((parent_.decode_ != DecodeType::NONE) && !parent_.DeferDecode())
+    {
+      if (!DecodeToFrame(reinterpret_cast<const uint8_t*>(buffer.Data()), buffer.Length(),
+                         traits, parent_.cur_frame_))
       {
-        parent_.CopyRawBuffer(buffers_->Get(bufIdx).Data());
+        ZBA_ERR("Don't currently have a converter for {}", parent_.current_mode_->format);
+        ++parent_.capture_errors_;
       }
     }
+    else
+    {
+      parent_.CopyRawBuffer(buffer.Data());
+    }
+    timing.converted = TimeStampNow();
+    parent_.decode_timing_.Record(timing.converted - timing.dequeued);
+  }
 
-    parent_.cur_frame_.set_timestamp(frame_timestamp);
-    parent_.OnFrameReceived(parent_.cur_frame_);
-
-    // Requeue buffer
-    buffers_->Get(bufIdx).Queue();
+  // The frame has been decoded / copied out of the buffer, so give it back to the driver
+  // before callbacks run - otherwise a slow callback holds the buffer and frames drop.
+  buffer.Queue();
 
-    // Go to next buffer
-    bufIdx = (bufIdx + 1) % kNumBuffers;
-  }
-  ZBA_LOG("CaptureThread exiting...");
+  parent_.cur_frame_.set_timestamp(frame_timestamp);
+  parent_.cur_frame_.set_timing(timing);
+  parent_.cur_frame_.set_hw_sequence(buffer.GetSequence());
+  parent_.OnFrameReceived(parent_.cur_frame_);
 }
 
 CameraPlatform::Impl::Impl(CameraPlatform* parent)
     : parent_(*parent),
       device_(std::make_shared<DeviceV4L2>(parent_.info_.path)),
-      started_(false)
+      started_(false),
+      wake_fd_(-1),
+      have_sequence_(false),
+      last_sequence_(0)
 {
   if (device_->bad())
   {
@@ -575,32 +904,33 @@ CameraPlatform::Impl::Impl(CameraPlatform* parent)
               Result::ZBA_CAMERA_OPEN_FAILED);
   }
 
-  auto saveFormat = [this](const v4l2_fmtdesc&, const v4l2_frmsizeenum&,
-                           const FormatInfo& fmt_info) {
-    if (parent_.IsFormatSupported(fmt_info.format))
+  auto saveFormat = [this](const v4l2_fmtdesc& fmtdesc, const v4l2_frmsizeenum&,
+                           const v4l2_frmivalenum& frmival, const FormatInfo& fmt_info) {
+    if (parent_.IsFormatSupported(fmt_info.pixel_format))
     {
       parent_.info_.AddFormat(fmt_info);
     }
     parent_.AddAllModeEntry(fmt_info);
+    v4l2_fract interval{0, 0};
+    if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) interval = frmival.discrete;
+    modes_.push_back({fmt_info, fmtdesc.pixelformat, static_cast<uint32_t>(fmt_info.width),
+                      static_cast<uint32_t>(fmt_info.height), interval});
     return true;
   };
 
-  // Get offset of clock
-  struct timeval timeSinceEpoch;
-  struct timespec timeSinceBoot;
-  gettimeofday(&timeSinceEpoch, NULL);
-  clock_gettime(CLOCK_MONOTONIC, &timeSinceBoot);
-
-  double secondsSinceEpoch =
-      timeSinceEpoch.tv_sec + static_cast<double>(timeSinceEpoch.tv_usec) / 1000000.0;
-
-  double secondsSinceBoot =
-      timeSinceBoot.tv_sec + static_cast<double>(timeSinceBoot.tv_nsec) / 1000000000.0;
-
-  cameraTimeBase_ = secondsSinceEpoch - secondsSinceBoot;
-
   EnumerateModes(saveFormat);
   EnumerateControls();
+
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (-1 == wake_fd_)
+  {
+    ZBA_THROW_ERRNO("Unable to create capture thread wake", Result::ZBA_SYS_ERROR);
+  }
+}
+
+CameraPlatform::Impl::~Impl()
+{
+  if (wake_fd_ != -1) close(wake_fd_);
 }
 
 void CameraPlatform::Impl::EnumerateModes(ModeCallback cb)
@@ -631,15 +961,12 @@ void CameraPlatform::Impl::EnumerateModes(ModeCallback cb)
         break;
       }
       std::string format_str(reinterpret_cast<char*>(&frameSize.pixel_format), 4);
-      float fps = 0.0f;
-      /// {TODO} investigate stepwise sizes. For now, ignore them.
-      /// None of my cameras seem to produce them.
-      if (V4L2_FRMSIZE_TYPE_DISCRETE != frameSize.type)
-      {
-        continue;
-      }
-      int width  = frameSize.discrete.width;
-      int height = frameSize.discrete.height;
+      // Stepwise and continuous sizes are reported once, as a range, rather than expanded
+      // into every size - with the rates available at the largest.
+      const bool discrete = (V4L2_FRMSIZE_TYPE_DISCRETE == frameSize.type);
+
+      int width  = discrete ? frameSize.discrete.width : frameSize.stepwise.max_width;
+      int height = discrete ? frameSize.discrete.height : frameSize.stepwise.max_height;
 
       v4l2_frmivalenum frmival;
       /// For each FPS
@@ -655,21 +982,33 @@ void CameraPlatform::Impl::EnumerateModes(ModeCallback cb)
           break;
         }
 
-        if ((frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) && (frmival.discrete.denominator > 0))
+        FormatInfo fmt_info(width, height, 0.0f, format_str);
+        if (!discrete)
+        {
+          fmt_info.min_width   = frameSize.stepwise.min_width;
+          fmt_info.min_height  = frameSize.stepwise.min_height;
+          fmt_info.step_width  = frameSize.stepwise.step_width;
+          fmt_info.step_height = frameSize.stepwise.step_height;
+        }
+        if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+        {
+          fmt_info.fps = IntervalToFps(frmival.discrete);
+        }
+        else
         {
-          // Round to 2 significant digits, e.g. 29.97
-          fps = std::round(100.0f / (static_cast<float>(frmival.discrete.numerator) /
-                                     static_cast<float>(frmival.discrete.denominator))) /
-                100.0f;
+          // Stepwise and continuous intervals are reported once, as a range of rates -
+          // the shortest interval is the fastest.
+          fmt_info.fps     = IntervalToFps(frmival.stepwise.min);
+          fmt_info.min_fps = IntervalToFps(frmival.stepwise.max);
         }
 
-        FormatInfo fmt_info(width, height, fps, format_str);
         if (cb)
         {
           // call callback
-          bool result = cb(formatDesc, frameSize, fmt_info);
+          bool result = cb(formatDesc, frameSize, frmival, fmt_info);
           if (!result) return;
         }
+        if (frmival.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
       }
     }
   }
@@ -103,7 +103,6 @@ class CameraPlatform::Impl
   VideoDeviceController videoDevCtrl_;  ///< VideoDeviceController for the device
   std::mutex paramControlMutex_;        ///< Lock for map
   std::map<std::string, MediaDeviceControl> paramControlMap_;  ///< maps param names to controls
-  FILETIME cameraTimeBase_;
 };
 
 // CameraWin main class
@@ -313,22 +312,6 @@ CameraPlatform::Impl::Impl(CameraPlatform* parent)
   auto devices     = Windows::Media::Capture::Frames::MediaFrameSourceGroup::FindAllAsync().get();
   bool initialized = false;
 
-  // Find the base time to work with for capture stamps relative to our clock and save it
-  // for calculating hardware timestamps
-  LARGE_INTEGER counter1, counter2;
-  FILETIME baseSystemTime;
-  GetSystemTimePreciseAsFileTime(&baseSystemTime);
-  QueryPerformanceCounter(&counter1);
-  QueryPerformanceCounter(&counter2);
-
-  uint64_t cameraTimeOffset = counter1.QuadPart - (counter2.QuadPart - counter1.QuadPart);
-  ULARGE_INTEGER ul;
-  ul.HighPart = baseSystemTime.dwHighDateTime;
-  ul.LowPart  = baseSystemTime.dwLowDateTime;
-  ul.QuadPart -= cameraTimeOffset;
-  cameraTimeBase_.dwHighDateTime = ul.HighPart;
-  cameraTimeBase_.dwLowDateTime  = ul.LowPart;
-
   for (auto curDevice : devices)
   {
     std::string deviceId = winrt::to_string(curDevice.Id());
@@ -434,24 +417,29 @@ void CameraPlatform::Impl::OnFrame(
 {
   if (auto frame = reader.TryAcquireLatestFrame())
   {
-    auto mfref = frame.VideoMediaFrame().FrameReference();
-    // Get the timestamp for the hardware start of frame
-    ULARGE_INTEGER hw_timestamp;
-    hw_timestamp.HighPart = cameraTimeBase_.dwHighDateTime;
-    hw_timestamp.LowPart  = cameraTimeBase_.dwLowDateTime;
-    hw_timestamp.QuadPart += mfref.SystemRelativeTime().Value().count();
-    FILETIME hw_filetime;
-    hw_filetime.dwHighDateTime = hw_timestamp.HighPart;
-    hw_filetime.dwLowDateTime  = hw_timestamp.LowPart;
-    TimeStamp hw_frame_time    = FILETIME_to_system_clock(hw_filetime);
+    FrameTiming timing{};
+    timing.dequeued = TimeStampNow();
+
+    // The hardware start of frame is relative to the performance counter, which is what
+    // our (steady) TimeStamp clock counts, so it's used as-is.
+    auto mfref              = frame.VideoMediaFrame().FrameReference();
+    TimeStamp hw_frame_time = timing.dequeued;
+    if (auto relative_time = mfref.SystemRelativeTime())
+    {
+      hw_frame_time = TimeStamp(
+          std::chrono::duration_cast<zebral::Clock::duration>(relative_time.Value()));
+    }
+
+    // Throttled - release the frame without converting it.
+    if (!parent_.AcceptFrame(hw_frame_time)) return;
 
     // Now get the image
-    auto bitmap        = frame.VideoMediaFrame().SoftwareBitmap();
-    auto format_if_set = parent_.GetFormat();
+    auto bitmap = frame.VideoMediaFrame().SoftwareBitmap();
 
-    if (format_if_set)
+    // Mode is set before capture starts, so no need to copy it for each frame.
+    if (parent_.current_mode_)
     {
-      auto format            = *format_if_set;
+      const auto& traits     = parent_.current_mode_->traits();
       BitmapBuffer bmpBuffer = bitmap.LockBuffer(BitmapBufferAccessMode::Read);
 
       auto plane_desc = bmpBuffer.GetPlaneDescription(0);
@@ -471,7 +459,8 @@ void CameraPlatform::Impl::OnFrame(
         // Now we're hardcoded to Rgb24, yay. ooh... nope. Get null frame refs.
         BGRAToBGRFrame(dataPtr, parent_.cur_frame_, src_stride);
       }
-      else if (parent_.decode_ == DecodeType::INTERNAL)
+      else if ((parent_.decode_ == DecodeType::INTERNAL) ||
+               ((parent_.decode_ == DecodeType::DEFERRED) && !parent_.DeferDecode()))
       {
         // For now we'll try decoding it...
         // We'll also want a raw option.
@@ -480,38 +469,16 @@ void CameraPlatform::Impl::OnFrame(
         auto interop     = ref.as<IMemoryBufferByteAccess>();
         check_hresult(interop->GetBuffer(&dataPtr, &dataLen));
 
-        auto srcPtr = dataPtr;
         // my system stats
         // (800, 448) is about 0.026s in debug mode, 0.0018s in release mode (no parallel, pure
         // cpp)
-        if (format.format == "YUY2")
-        {
-          // ZBA_TIMER(timer, "YUY2ToBGRFrame");
-          YUY2ToBGRFrame(srcPtr, parent_.cur_frame_, src_stride);
-        }
-        else if (format.format == "NV12")
-        {
-          // ZBA_TIMER(timer, "NV12ToBGRFrame");
-          NV12ToBGRFrame(srcPtr, parent_.cur_frame_, src_stride);
-        }
-        else if (format.format == "D16 ")
-        {
-          GreyToFrame(srcPtr, parent_.cur_frame_, src_stride);
-        }
-        else if (format.format == "L8  ")
-        {
-          GreyToFrame(srcPtr, parent_.cur_frame_, src_stride);
-        }
-        else if (format.format == "MJPG")
-        {
-          JPEGToBGRFrame(srcPtr, dataLen, parent_.cur_frame_, src_stride);
-        }
-        else
+        if (!DecodeToFrame(dataPtr, dataLen, traits, parent_.cur_frame_, src_stride))
         {
-          ZBA_ERR("Don't currently have a converter for {}", format.format);
+          ZBA_ERR("Don't currently have a converter for {}", parent_.current_mode_->format);
+          ++parent_.capture_errors_;
         }
       }
-      else if (parent_.decode_ == DecodeType::NONE)
+      else if ((parent_.decode_ == DecodeType::NONE) || parent_.DeferDecode())
       {
         uint8_t* dataPtr = nullptr;
         uint32_t dataLen = 0;
@@ -522,7 +489,10 @@ void CameraPlatform::Impl::OnFrame(
 
       ref.Close();
       bmpBuffer.Close();
+      timing.converted = TimeStampNow();
+      parent_.decode_timing_.Record(timing.converted - timing.dequeued);
       parent_.cur_frame_.set_timestamp(hw_frame_time);
+      parent_.cur_frame_.set_timing(timing);
       parent_.OnFrameReceived(parent_.cur_frame_);
     }
     else
@@ -0,0 +1,217 @@
+/// \file capture_reactor.cpp
+/// Implementation of the epoll capture reactor
+#if __linux__
+
+#include "capture_reactor.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+namespace
+{
+/// epoll data for the wake eventfd - registration ids start at 1
+constexpr uint64_t kWakeId = 0;
+}  // namespace
+
+CaptureReactor::CaptureReactor(size_t num_threads)
+    : epoll_fd_(-1),
+      wake_fd_(-1),
+      handled_(0),
+      failures_(0),
+      next_id_(kWakeId + 1)
+{
+  if (num_threads == 0)
+  {
+    ZBA_THROW("Capture reactor needs a thread", Result::ZBA_INVALID_RANGE);
+  }
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_  = eventfd(0, EFD_CLOEXEC);
+  if ((epoll_fd_ == -1) || (wake_fd_ == -1))
+  {
+    int err = errno;
+    if (epoll_fd_ != -1) close(epoll_fd_);
+    if (wake_fd_ != -1) close(wake_fd_);
+    throw Error("Unable to create capture reactor", Result::ZBA_SYS_ERROR, __FILE__, __LINE__,
+                err);
+  }
+
+  // The wake fd stays readable once written, so it wakes every thread.
+  epoll_event event{};
+  event.events   = EPOLLIN;
+  event.data.u64 = kWakeId;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+  for (size_t i = 0; i < num_threads; ++i)
+  {
+    threads_.emplace_back(&CaptureReactor::WorkerThread, this);
+  }
+}
+
+CaptureReactor::~CaptureReactor()
+{
+  uint64_t wake = 1;
+  if (write(wake_fd_, &wake, sizeof(wake)) < 0)
+  {
+    ZBA_ERRNO("Error waking capture reactor");
+  }
+  for (auto& thread : threads_)
+  {
+    if (thread.joinable()) thread.join();
+  }
+  if (!entries_.empty())
+  {
+    ZBA_ERR("Capture reactor destroyed with {} fds still added", entries_.size());
+  }
+  close(epoll_fd_);
+  close(wake_fd_);
+}
+
+std::shared_ptr<CaptureReactor> CaptureReactor::Shared()
+{
+  static std::shared_ptr<CaptureReactor> reactor = std::make_shared<CaptureReactor>(
+      std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4));
+  return reactor;
+}
+
+void CaptureReactor::Add(int fd, Handler handler, FailureHandler on_failure)
+{
+  if (!handler)
+  {
+    ZBA_THROW("Null reactor handler", Result::ZBA_INVALID_PARAMETER);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry     = std::make_shared<Entry>();
+  entry->fd      = fd;
+  entry->id      = next_id_++;
+  entry->handler    = std::move(handler);
+  entry->on_failure = std::move(on_failure);
+  entry->running    = false;
+  entry->removed    = false;
+  entry->failed     = false;
+
+  // One-shot, so only one thread gets the fd until its handler re-arms it.
+  epoll_event event{};
+  event.events   = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = entry->id;
+  if (-1 == epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event))
+  {
+    ZBA_THROW_ERRNO("Unable to add fd to capture reactor", Result::ZBA_SYS_ERROR);
+  }
+  entries_.emplace(entry->id, entry);
+}
+
+void CaptureReactor::Remove(int fd)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = std::find_if(entries_.begin(), entries_.end(),
+                         [fd](const auto& entry) { return entry.second->fd == fd; });
+  if (it == entries_.end()) return;
+
+  auto entry     = it->second;
+  entry->removed = true;
+  entries_.erase(it);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+
+  // Events already taken for it are ignored, but a running handler has to finish.
+  if (entry->thread != std::this_thread::get_id())
+  {
+    cv_.wait(lock, [&] { return !entry->running; });
+  }
+}
+
+size_t CaptureReactor::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void CaptureReactor::WorkerThread()
+{
+  for (;;)
+  {
+    epoll_event event;
+    int count = epoll_wait(epoll_fd_, &event, 1, -1);
+    if (count < 0)
+    {
+      if (EINTR == errno) continue;
+      ZBA_ERRNO("Capture reactor wait failed");
+      return;
+    }
+    if (count == 0) continue;
+    if (event.data.u64 == kWakeId) return;
+
+    std::shared_ptr<Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(event.data.u64);
+      if (it == entries_.end()) continue;
+      entry          = it->second;
+      entry->running = true;
+      entry->thread  = std::this_thread::get_id();
+    }
+
+    // A device that errored or hung up won't recover by being waited on again.
+    std::string failure;
+    if (event.events & (EPOLLERR | EPOLLHUP))
+    {
+      failure = (event.events & EPOLLERR) ? "fd reported an error" : "fd hung up";
+    }
+    else
+    {
+      try
+      {
+        entry->handler();
+      }
+      catch (const std::exception& e)
+      {
+        failure = zba_format("handler threw: {}", e.what());
+      }
+      ++handled_;
+    }
+
+    if (!failure.empty())
+    {
+      ZBA_ERR("Capture reactor fd {} failed: {}", entry->fd, failure);
+      ++failures_;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry->failed = true;
+      }
+      if (entry->on_failure)
+      {
+        try
+        {
+          entry->on_failure(failure);
+        }
+        catch (const std::exception& e)
+        {
+          ZBA_ERR("Capture reactor failure handler threw: {}", e.what());
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->running = false;
+    entry->thread  = std::thread::id();
+    if (!entry->removed && !entry->failed)
+    {
+      epoll_event rearm{};
+      rearm.events   = EPOLLIN | EPOLLONESHOT;
+      rearm.data.u64 = entry->id;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, entry->fd, &rearm);
+    }
+    cv_.notify_all();
+  }
+}
+
+}  // namespace zebral
+
+#endif  // __linux__
@@ -97,6 +97,29 @@ void NV12ToBGRRow(const uint8_t* src_ptr_y, const uint8_t* src_ptr_uv, uint8_t*
     YUV2RGB(nv12_y->y, nv12_uv->u, nv12_uv->v, bgr8->r, bgr8->g, bgr8->b);
   }
 }
+void I420ToBGRRow(const uint8_t* src_ptr_y, const uint8_t* src_ptr_u, const uint8_t* src_ptr_v,
+                  uint8_t* dst_ptr, int width)
+{
+  fmt_BGR8* bgr8 = reinterpret_cast<fmt_BGR8*>(dst_ptr);
+
+  for (int x = 0; x < width - 1; x += 2)
+  {
+    YUV2RGB(src_ptr_y[0], *src_ptr_u, *src_ptr_v, bgr8->r, bgr8->g, bgr8->b);
+    ++bgr8;
+    YUV2RGB(src_ptr_y[1], *src_ptr_u, *src_ptr_v, bgr8->r, bgr8->g, bgr8->b);
+    ++bgr8;
+    src_ptr_y += 2;
+    // inc u/v on alternating pixels
+    ++src_ptr_u;
+    ++src_ptr_v;
+  }
+
+  if (width & 1)
+  {
+    YUV2RGB(*src_ptr_y, *src_ptr_u, *src_ptr_v, bgr8->r, bgr8->g, bgr8->b);
+  }
+}
+
 void BGRAToBGRRow(const uint8_t* src, uint8_t* dst, int width)
 {
   const fmt_BGRA* bgra = reinterpret_cast<const fmt_BGRA*>(src);
@@ -112,49 +135,146 @@ void BGRAToBGRRow(const uint8_t* src, uint8_t* dst, int width)
   }
 }
 
-void YUY2ToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+/// Throws if the source and destination views aren't the same size
+static void CheckViewSizes(int src_width, int src_height, const MutableFrameView& dst)
 {
-  auto src_ptr   = src;
-  auto dst_ptr   = out.data();
-  int dst_stride = out.channels() * out.bytes_per_channel() * out.width();
+  if ((src_width != dst.width()) || (src_height != dst.height()))
+  {
+    ZBA_THROW("Source and destination views must be the same size", Result::ZBA_INVALID_RANGE);
+  }
+}
 
-  for (int y = 0; y < out.height(); ++y)
+/// Throws unless the view is width x height with the given channels of 8-bit samples
+static void CheckViewLayout(const FrameView& view, int width, int height, int channels,
+                            const char* name)
+{
+  if ((view.width() != width) || (view.height() != height))
+  {
+    ZBA_THROW(std::string(name) + " view has the wrong size", Result::ZBA_INVALID_RANGE);
+  }
+  if ((view.channels() != channels) || (view.bytes_per_channel() != 1))
   {
-    YUY2ToBGRRow(src_ptr, dst_ptr, out.width());
-    src_ptr += stride;
-    dst_ptr += dst_stride;
+    ZBA_THROW(std::string(name) + " view has the wrong pixel layout", Result::ZBA_INVALID_RANGE);
   }
 }
 
-void NV12ToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+/// Throws unless the destination is 8-bit BGR the same size as the source
+static void CheckBGRDestination(int src_width, int src_height, const MutableFrameView& dst)
 {
-  auto src_ptr_y  = src;
-  auto src_ptr_uv = src + stride * out.height();
+  CheckViewSizes(src_width, src_height, dst);
+  if ((dst.channels() != 3) || (dst.bytes_per_channel() != 1))
+  {
+    ZBA_THROW("Destination view must be 8-bit BGR", Result::ZBA_INVALID_RANGE);
+  }
+}
 
-  auto dst_ptr   = out.data();
-  int dst_stride = out.channels() * out.bytes_per_channel() * out.width();
+void YUY2ToBGRFrame(const FrameView& src, const MutableFrameView& dst)
+{
+  CheckViewLayout(src, src.width(), src.height(), 2, "YUY2");
+  CheckBGRDestination(src.width(), src.height(), dst);
+  for (int y = 0; y < dst.height(); ++y)
+  {
+    YUY2ToBGRRow(src.row(y), dst.row(y), dst.width());
+  }
+}
 
-  for (int y = 0; y < out.height(); ++y)
+void NV12ToBGRFrame(const FrameView& src_y, const FrameView& src_uv, const MutableFrameView& dst)
+{
+  const int uv_width  = (src_y.width() + 1) / 2;
+  const int uv_height = (src_y.height() + 1) / 2;
+  CheckViewLayout(src_y, src_y.width(), src_y.height(), 1, "NV12 Y");
+  CheckViewLayout(src_uv, uv_width, uv_height, 2, "NV12 UV");
+  CheckBGRDestination(src_y.width(), src_y.height(), dst);
+  for (int y = 0; y < dst.height(); ++y)
   {
-    NV12ToBGRRow(src_ptr_y, src_ptr_uv, dst_ptr, out.width());
-    src_ptr_y += stride;
-    dst_ptr += dst_stride;
-    // inc on alternating rows
-    src_ptr_uv += (y & 1) * stride;
+    // uv rows are shared by pairs of y rows
+    NV12ToBGRRow(src_y.row(y), src_uv.row(y / 2), dst.row(y), dst.width());
   }
 }
-void BGRAToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+
+void I420ToBGRFrame(const FrameView& src_y, const FrameView& src_u, const FrameView& src_v,
+                    const MutableFrameView& dst)
+{
+  const int uv_width  = (src_y.width() + 1) / 2;
+  const int uv_height = (src_y.height() + 1) / 2;
+  CheckViewLayout(src_y, src_y.width(), src_y.height(), 1, "I420 Y");
+  CheckViewLayout(src_u, uv_width, uv_height, 1, "I420 U");
+  CheckViewLayout(src_v, uv_width, uv_height, 1, "I420 V");
+  CheckBGRDestination(src_y.width(), src_y.height(), dst);
+  for (int y = 0; y < dst.height(); ++y)
+  {
+    // u/v rows are shared by pairs of y rows
+    I420ToBGRRow(src_y.row(y), src_u.row(y / 2), src_v.row(y / 2), dst.row(y), dst.width());
+  }
+}
+
+void PlanarYUVToBGRFrame(const CameraFrame& src, const MutableFrameView& dst)
+{
+  if ((src.plane_count() == 2) && (src.plane(1).layout.channels == 2))
+  {
+    NV12ToBGRFrame(src.plane_view(0), src.plane_view(1), dst);
+  }
+  else if (src.plane_count() == 3)
+  {
+    I420ToBGRFrame(src.plane_view(0), src.plane_view(1), src.plane_view(2), dst);
+  }
+  else
+  {
+    ZBA_THROW("Frame is not planar YUV", Result::ZBA_UNSUPPORTED_FMT);
+  }
+}
+
+void BGRAToBGRFrame(const FrameView& src, const MutableFrameView& dst)
 {
-  auto src_ptr   = src;
-  auto dst_ptr   = out.data();
-  int dst_stride = out.channels() * out.bytes_per_channel() * out.width();
+  CheckViewLayout(src, src.width(), src.height(), 4, "BGRA");
+  CheckBGRDestination(src.width(), src.height(), dst);
+  for (int y = 0; y < dst.height(); ++y)
+  {
+    BGRAToBGRRow(src.row(y), dst.row(y), dst.width());
+  }
+}
 
-  for (int y = 0; y < out.height(); ++y)
+void GreyToFrame(const FrameView& src, const MutableFrameView& dst)
+{
+  CheckViewSizes(src.width(), src.height(), dst);
+  if (src.bytes_per_pixel() != dst.bytes_per_pixel())
   {
-    BGRAToBGRRow(src_ptr, dst_ptr, out.width());
-    src_ptr += stride;
-    dst_ptr += dst_stride;
+    ZBA_THROW("Source and destination pixel sizes differ", Result::ZBA_INVALID_RANGE);
   }
+  for (int y = 0; y < dst.height(); ++y)
+  {
+    GreyRow(src.row(y), dst.row(y), static_cast<int>(dst.row_bytes()));
+  }
+}
+
+void YUY2ToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+{
+  YUY2ToBGRFrame(FrameView(src, out.width(), out.height(), stride, 2, 1), out.view());
+}
+
+void NV12ToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+{
+  FrameView src_y(src, out.width(), out.height(), stride, 1, 1);
+  FrameView src_uv(src + stride * out.height(), (out.width() + 1) / 2, (out.height() + 1) / 2,
+                   stride, 2, 1);
+  NV12ToBGRFrame(src_y, src_uv, out.view());
+}
+
+void I420ToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+{
+  const int uv_width  = (out.width() + 1) / 2;
+  const int uv_height = (out.height() + 1) / 2;
+  const int uv_stride = (stride + 1) / 2;
+  const uint8_t* src_u = src + stride * out.height();
+  const uint8_t* src_v = src_u + uv_stride * uv_height;
+  I420ToBGRFrame(FrameView(src, out.width(), out.height(), stride, 1, 1),
+                 FrameView(src_u, uv_width, uv_height, uv_stride, 1, 1),
+                 FrameView(src_v, uv_width, uv_height, uv_stride, 1, 1), out.view());
+}
+
+void BGRAToBGRFrame(const uint8_t* src, CameraFrame& out, int stride)
+{
+  BGRAToBGRFrame(FrameView(src, out.width(), out.height(), stride, 4, 1), out.view());
 }
 
 void jpegErrorExit(j_common_ptr cinfo)
@@ -186,6 +306,7 @@ void JPEGToBGRFrame(const uint8_t* src, size_t length, CameraFrame& out, int)
 
       // Reset frame to match for now - we may want to do RGB/RGBA conversion here
       out.reset(cinfo.output_width, cinfo.output_height, cinfo.num_components, 1, false, false);
+      if (cinfo.num_components == 3) out.set_pixel_format(PixelFormat::BGR);
     }
 
     auto dst_ptr   = out.data();
@@ -250,16 +371,61 @@ void GreyRow(const uint8_t* src, uint8_t* dst, int stride)
 
 void GreyToFrame(const uint8_t* src, CameraFrame& out, int stride)
 {
-  auto src_ptr   = src;
-  auto dst_ptr   = out.data();
-  int dst_stride = out.channels() * out.bytes_per_channel() * out.width();
+  GreyToFrame(FrameView(src, out.width(), out.height(), stride, out.channels(),
+                        out.bytes_per_channel()),
+              out.view());
+}
 
-  for (int y = 0; y < out.height(); ++y)
+bool DecodeToFrame(const uint8_t* src, size_t length, const PixelFormatInfo& format,
+                   CameraFrame& frame, int stride)
+{
+  if (0 == stride)
+  {
+    stride = static_cast<int>(format.row_bytes(frame.width()));
+  }
+
+  switch (format.converter)
+  {
+    case PixelConverter::COPY:
+      GreyToFrame(src, frame, stride);
+      return true;
+    case PixelConverter::YUY2_TO_BGR:
+      YUY2ToBGRFrame(src, frame, stride);
+      return true;
+    case PixelConverter::NV12_TO_BGR:
+      NV12ToBGRFrame(src, frame, stride);
+      return true;
+    case PixelConverter::I420_TO_BGR:
+      I420ToBGRFrame(src, frame, stride);
+      return true;
+    case PixelConverter::BGRA_TO_BGR:
+      BGRAToBGRFrame(src, frame, stride);
+      return true;
+    case PixelConverter::JPEG_TO_BGR:
+      JPEGToBGRFrame(src, length, frame, stride);
+      return true;
+    case PixelConverter::NONE:
+    default:
+      return false;
+  }
+}
+
+bool DecodeFrame(const CameraFrame& raw, CameraFrame& out)
+{
+  const auto& traits = GetPixelFormatInfo(raw.pixel_format());
+  if ((traits.format == PixelFormat::UNKNOWN) || (traits.converter == PixelConverter::NONE))
+  {
+    return false;
+  }
+  if ((out.width() != raw.width()) || (out.height() != raw.height()) ||
+      (out.pixel_format() != traits.decoded))
   {
-    GreyRow(src_ptr, dst_ptr, dst_stride);
-    src_ptr += stride;
-    dst_ptr += dst_stride;
+    out.reset(raw.width(), raw.height(), traits.decoded);
   }
+  out.set_timestamp(raw.get_timestamp());
+  out.set_timing(raw.get_timing());
+  out.set_hw_sequence(raw.get_hw_sequence());
+  return DecodeToFrame(raw.data(), raw.data_size(), traits, out);
 }
 
 CameraFrame Grey16ToFrame(const uint8_t* src, int width, int height, int stride)
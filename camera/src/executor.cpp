@@ -0,0 +1,83 @@
+/// \file executor.cpp
+/// Implementation of the callback executors
+#include "executor.hpp"
+
+#include <algorithm>
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+std::shared_ptr<Executor> Executor::Inline()
+{
+  static auto executor = std::make_shared<InlineExecutor>();
+  return executor;
+}
+
+std::shared_ptr<Executor> Executor::SharedPool()
+{
+  static auto executor = std::make_shared<ThreadPoolExecutor>(
+      std::max<size_t>(1, std::thread::hardware_concurrency()));
+  return executor;
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t num_threads)
+    : exiting_(false)
+{
+  if (num_threads == 0)
+  {
+    ZBA_THROW("Executor needs at least one thread", Result::ZBA_INVALID_RANGE);
+  }
+  for (size_t i = 0; i < num_threads; ++i)
+  {
+    threads_.emplace_back(&ThreadPoolExecutor::WorkerThread, this);
+  }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_)
+  {
+    thread.join();
+  }
+}
+
+void ThreadPoolExecutor::Post(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.emplace_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPoolExecutor::WorkerThread()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;)
+  {
+    cv_.wait(lock, [&] { return exiting_ || !tasks_.empty(); });
+    if (tasks_.empty()) break;
+
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    try
+    {
+      task();
+    }
+    catch (const std::exception& e)
+    {
+      ZBA_ERR("Executor task threw: {}", e.what());
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace zebral
@@ -0,0 +1,157 @@
+/// \file frame_allocator.cpp
+/// Frame memory allocation, with huge pages where the platform has them
+#include "frame_allocator.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+#if __linux__
+#include <sys/mman.h>
+#endif
+
+#include "frame_budget.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+namespace
+{
+std::atomic<FrameMemory> g_default_memory{FrameMemory::DEFAULT};
+std::atomic<uint64_t> g_explicit_huge{0};
+std::atomic<uint64_t> g_transparent_huge{0};
+std::atomic<uint64_t> g_fallback{0};
+
+#if __linux__
+/// True if an allocation should come from huge pages.
+/// Only depends on the size and type, so frees always match their allocations.
+bool UseHugePages(size_t bytes, FrameMemory memory)
+{
+  return (memory == FrameMemory::HUGE_PAGES) && (bytes >= kHugePageSize);
+}
+
+size_t RoundToHugePage(size_t bytes)
+{
+  return (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+void* AllocateHugePages(size_t bytes)
+{
+  // Explicit huge pages, if the admin has reserved some (vm.nr_hugepages)
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED)
+  {
+    ++g_explicit_huge;
+    return ptr;
+  }
+
+  // Otherwise map normal pages, 2MB aligned so they can be backed by transparent huge pages.
+  // Over-allocate by a huge page, then trim the unaligned head and tail.
+  size_t mapped = bytes + kHugePageSize;
+  uint8_t* raw  = static_cast<uint8_t*>(
+      mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (raw == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+
+  uintptr_t addr    = reinterpret_cast<uintptr_t>(raw);
+  uintptr_t aligned = (addr + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  size_t head       = aligned - addr;
+  size_t tail       = mapped - head - bytes;
+  if (head) munmap(raw, head);
+  if (tail) munmap(reinterpret_cast<uint8_t*>(aligned) + bytes, tail);
+
+  ptr = reinterpret_cast<void*>(aligned);
+  if (0 == madvise(ptr, bytes, MADV_HUGEPAGE))
+  {
+    ++g_transparent_huge;
+  }
+  else
+  {
+    // THP disabled or not built in - still works, just with small pages.
+    static std::atomic<bool> logged = false;
+    if (!logged.exchange(true))
+    {
+      ZBA_ERRNO("Huge pages unavailable for frames, using normal pages.");
+    }
+    ++g_fallback;
+  }
+  return ptr;
+}
+#endif  // __linux__
+
+}  // namespace
+
+void SetDefaultFrameMemory(FrameMemory memory)
+{
+  g_default_memory = memory;
+}
+
+FrameMemory GetDefaultFrameMemory()
+{
+  return g_default_memory;
+}
+
+FrameMemoryStats GetFrameMemoryStats()
+{
+  return {g_explicit_huge, g_transparent_huge, g_fallback};
+}
+
+void* AllocateFrameMemory(size_t bytes, FrameMemory memory, FrameAccount* account)
+{
+  // Charge first - if that throws, there's nothing to leak. Refund it if the allocation fails.
+  if (account)
+  {
+    account->Charge(bytes);
+  }
+
+  void* ptr = nullptr;
+  try
+  {
+#if __linux__
+    if (UseHugePages(bytes, memory))
+    {
+      ptr = AllocateHugePages(RoundToHugePage(bytes));
+    }
+#endif
+    if (!ptr)
+    {
+      if ((memory == FrameMemory::HUGE_PAGES) && (bytes >= kHugePageSize))
+      {
+        ++g_fallback;
+      }
+      ptr = ::operator new(bytes);
+    }
+  }
+  catch (...)
+  {
+    if (account)
+    {
+      account->Release(bytes);
+    }
+    throw;
+  }
+  return ptr;
+}
+
+void FreeFrameMemory(void* ptr, size_t bytes, FrameMemory memory, FrameAccount* account)
+{
+  if (!ptr) return;
+  if (account)
+  {
+    account->Release(bytes);
+  }
+#if __linux__
+  if (UseHugePages(bytes, memory))
+  {
+    munmap(ptr, RoundToHugePage(bytes));
+    return;
+  }
+#else
+  (void)memory;
+#endif
+  ::operator delete(ptr);
+}
+
+}  // namespace zebral
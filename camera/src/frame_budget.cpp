@@ -0,0 +1,189 @@
+/// \file frame_budget.cpp
+/// Implementation of frame memory accounting and the process-wide frame budget
+#include "frame_budget.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+
+namespace zebral
+{
+namespace
+{
+/// Raises a peak counter to value if it's higher
+void UpdatePeak(std::atomic<size_t>& peak, size_t value)
+{
+  size_t cur = peak;
+  while ((value > cur) && !peak.compare_exchange_weak(cur, value))
+  {
+  }
+}
+}  // namespace
+
+FrameAccount::FrameAccount(const std::string& name)
+    : name_(name),
+      bytes_(0),
+      peak_bytes_(0),
+      dropped_(0),
+      refused_(0)
+{
+}
+
+void FrameAccount::Charge(size_t bytes)
+{
+  UpdatePeak(peak_bytes_, bytes_ += bytes);
+  FrameBudget::Instance().OnCharge(bytes);
+}
+
+void FrameAccount::Release(size_t bytes)
+{
+  bytes_ -= bytes;
+  FrameBudget::Instance().OnRelease(bytes);
+}
+
+FrameBudget& FrameBudget::Instance()
+{
+  static FrameBudget budget;
+  return budget;
+}
+
+FrameBudget::FrameBudget()
+    : limit_(0),
+      policy_(BudgetPolicy::DROP_OLDEST),
+      bytes_(0),
+      peak_bytes_(0),
+      waiters_(0),
+      block_timeout_(1000)
+{
+}
+
+std::shared_ptr<FrameAccount> FrameBudget::GetAccount(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto account = accounts_[name].lock();
+  if (!account)
+  {
+    account         = std::make_shared<FrameAccount>(name);
+    accounts_[name] = account;
+  }
+  return account;
+}
+
+void FrameBudget::SetLimit(size_t bytes)
+{
+  limit_ = bytes;
+  std::lock_guard<std::mutex> lock(mutex_);
+  cv_.notify_all();
+}
+
+void FrameBudget::SetPolicy(BudgetPolicy policy, std::chrono::milliseconds block_timeout)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  policy_        = policy;
+  block_timeout_ = block_timeout;
+  cv_.notify_all();
+}
+
+void FrameBudget::RegisterHolder(std::weak_ptr<FrameHolder> holder)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  holders_.erase(std::remove_if(holders_.begin(), holders_.end(),
+                                [](const auto& h) { return h.expired(); }),
+                 holders_.end());
+  holders_.emplace_back(std::move(holder));
+}
+
+void FrameBudget::OnCharge(size_t bytes)
+{
+  UpdatePeak(peak_bytes_, bytes_ += bytes);
+}
+
+void FrameBudget::OnRelease(size_t bytes)
+{
+  bytes_ -= bytes;
+  if (waiters_ > 0)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cv_.notify_all();
+  }
+}
+
+bool FrameBudget::Admit(size_t bytes, FrameAccount& account)
+{
+  if (Fits(bytes)) return true;
+
+  switch (policy_)
+  {
+    case BudgetPolicy::DROP_OLDEST:
+      if (DropOldest(bytes)) return true;
+      break;
+    case BudgetPolicy::BLOCK:
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ++waiters_;
+      bool fits = cv_.wait_for(lock, block_timeout_, [&] { return Fits(bytes); });
+      --waiters_;
+      if (fits) return true;
+      break;
+    }
+    case BudgetPolicy::REFUSE_NEW:
+    default:
+      break;
+  }
+  account.CountRefused();
+  return false;
+}
+
+bool FrameBudget::DropOldest(size_t bytes)
+{
+  // Holders free memory when they drop, which calls back into us - don't hold the lock.
+  std::vector<std::shared_ptr<FrameHolder>> holders;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& weak : holders_)
+    {
+      if (auto holder = weak.lock()) holders.emplace_back(std::move(holder));
+    }
+  }
+
+  while (!Fits(bytes))
+  {
+    std::shared_ptr<FrameHolder> oldest;
+    std::optional<TimeStamp> oldest_time;
+    for (auto& holder : holders)
+    {
+      auto t = holder->OldestFrameTime();
+      if (t && (!oldest_time || (*t < *oldest_time)))
+      {
+        oldest      = holder;
+        oldest_time = t;
+      }
+    }
+
+    // Nothing left to drop
+    if (!oldest) return false;
+    oldest->DropOldestFrame();
+  }
+  return true;
+}
+
+FrameBudgetUsage FrameBudget::GetUsage()
+{
+  FrameBudgetUsage usage{limit_, policy_, bytes_, peak_bytes_, {}};
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto iter = accounts_.begin(); iter != accounts_.end();)
+  {
+    auto account = iter->second.lock();
+    if (!account)
+    {
+      iter = accounts_.erase(iter);
+      continue;
+    }
+    usage.accounts.push_back({account->name(), account->bytes(), account->peak_bytes(),
+                              account->dropped(), account->refused()});
+    ++iter;
+  }
+  return usage;
+}
+
+}  // namespace zebral
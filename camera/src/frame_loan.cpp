@@ -0,0 +1,22 @@
+/// \file frame_loan.cpp
+/// Implementation of lent driver buffers
+#include "frame_loan.hpp"
+
+#include "log.hpp"
+
+namespace zebral
+{
+LoanLease::~LoanLease()
+{
+  if (!release_) return;
+  try
+  {
+    release_();
+  }
+  catch (const std::exception& e)
+  {
+    ZBA_ERR("Error returning a lent buffer: {}", e.what());
+  }
+}
+
+}  // namespace zebral
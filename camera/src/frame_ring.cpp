@@ -0,0 +1,233 @@
+/// \file frame_ring.cpp
+/// Implementation of the lock-free frame ring
+#include "frame_ring.hpp"
+
+#include <algorithm>
+
+#include "convert.hpp"
+#include "errors.hpp"
+
+namespace zebral
+{
+void FrameDecodeCache::SetAllocator(const FrameAllocator<uint8_t>& allocator)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  allocator_ = allocator;
+  entries_.clear();
+}
+
+std::shared_ptr<const CameraFrame> FrameDecodeCache::Get(
+    const std::shared_ptr<const CameraFrame>& raw, PixelFormat format)
+{
+  const auto& traits = GetPixelFormatInfo(raw->pixel_format());
+  if (format == PixelFormat::UNKNOWN) format = traits.decoded;
+  if ((format == raw->pixel_format()) || (format == PixelFormat::UNKNOWN)) return raw;
+  if (format != traits.decoded)
+  {
+    ZBA_THROW("Can't decode " + PixelFormatToString(raw->pixel_format()) + " to " +
+                  PixelFormatToString(format),
+              Result::ZBA_UNSUPPORTED_FMT);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = std::find_if(entries_.begin(), entries_.end(),
+                            [format](const Entry& e) { return e.format == format; });
+  if ((entry != entries_.end()) && entry->valid) return entry->frame;
+
+  // Reuse the old decoded frame's buffer unless a reader still has it.
+  if (entry == entries_.end())
+  {
+    entry = entries_.insert(entries_.end(), {format, false, nullptr});
+  }
+  if (!entry->frame || (entry->frame.use_count() > 1))
+  {
+    entry->frame = std::make_shared<CameraFrame>(allocator_);
+  }
+
+  if (!DecodeFrame(*raw, *entry->frame))
+  {
+    ZBA_THROW("No converter for " + PixelFormatToString(raw->pixel_format()),
+              Result::ZBA_UNSUPPORTED_FMT);
+  }
+  entry->valid = true;
+  return entry->frame;
+}
+
+void FrameDecodeCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : entries_)
+  {
+    entry.valid = false;
+  }
+}
+
+std::shared_ptr<const CameraFrame> FrameHandle::Decoded(PixelFormat format) const
+{
+  if (!frame) return nullptr;
+  if (cache) return cache->Get(frame, format);
+
+  // Not from a ring - decode without caching
+  FrameDecodeCache uncached;
+  return uncached.Get(frame, format);
+}
+
+FrameRing::FrameRing(size_t capacity)
+    : capacity_(capacity),
+      slots_(capacity),
+      pool_{},
+      slot_frames_(capacity, kMaxPoolFrames),
+      pool_size_(0),
+      acquired_(kMaxPoolFrames),
+      allocator_(),
+      head_(0),
+      exhausted_(0),
+      waiters_(0)
+{
+  // Need at least one pool frame free to fill while the ring is full
+  if ((capacity == 0) || (capacity >= kMaxPoolFrames))
+  {
+    ZBA_THROW("Invalid frame ring capacity", Result::ZBA_INVALID_RANGE);
+  }
+  for (auto& slot : slots_)
+  {
+    slot = 0;
+  }
+}
+
+void FrameRing::SetAllocator(const FrameAllocator<uint8_t>& allocator)
+{
+  allocator_ = allocator;
+  for (size_t i = 0; i < pool_size_; ++i)
+  {
+    pool_[i]->frame.set_allocator(allocator);
+    caches_[i]->SetAllocator(allocator);
+  }
+}
+
+std::shared_ptr<CameraFrame> FrameRing::AcquireFrame()
+{
+  // Reuse a frame that's out of the ring and that no reader has pinned.
+  for (size_t i = 0; i < pool_size_; ++i)
+  {
+    if ((std::find(slot_frames_.begin(), slot_frames_.end(), i) == slot_frames_.end()) &&
+        (pool_[i]->pins.load() == 0))
+    {
+      acquired_ = i;
+      caches_[i]->Clear();
+      return std::shared_ptr<CameraFrame>(pool_[i], &pool_[i]->frame);
+    }
+  }
+
+  if (pool_size_ == kMaxPoolFrames)
+  {
+    ++exhausted_;
+    acquired_ = kMaxPoolFrames;
+    return nullptr;
+  }
+
+  acquired_           = pool_size_;
+  pool_[pool_size_]   = std::make_shared<PoolFrame>(allocator_);
+  caches_[pool_size_] = std::make_shared<FrameDecodeCache>();
+  caches_[pool_size_]->SetAllocator(allocator_);
+  auto& pooled = pool_[pool_size_++];
+  return std::shared_ptr<CameraFrame>(pooled, &pooled->frame);
+}
+
+uint64_t FrameRing::Publish()
+{
+  if (acquired_ >= pool_size_)
+  {
+    ZBA_THROW("Publish() without a frame from AcquireFrame()", Result::ZBA_ERROR);
+  }
+
+  uint64_t sequence = head_ + 1;
+  size_t slot       = sequence % capacity_;
+
+  slot_frames_[slot] = acquired_;
+  slots_[slot].store(Pack(sequence, acquired_));
+  head_.store(sequence);
+  acquired_ = kMaxPoolFrames;
+
+  if (waiters_ > 0)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cv_.notify_all();
+  }
+  return sequence;
+}
+
+FrameHandle FrameRing::LastPublished() const
+{
+  uint64_t sequence = head_;
+  if (sequence == 0) return {};
+  size_t index = slot_frames_[sequence % capacity_];
+  ++pool_[index]->pins;
+  return MakeHandle(sequence, index);
+}
+
+FrameHandle FrameRing::MakeHandle(uint64_t sequence, size_t index) const
+{
+  // The handle keeps the pool frame alive, and unpins it when the last copy goes.
+  const auto& pooled = pool_[index];
+  std::shared_ptr<const CameraFrame> frame(
+      &pooled->frame, [pooled](const CameraFrame*) { pooled->pins.fetch_sub(1); });
+  return {sequence, std::move(frame), caches_[index]};
+}
+
+FrameHandle FrameRing::Get(uint64_t sequence) const
+{
+  const auto& slot = slots_[sequence % capacity_];
+  uint64_t packed  = slot.load(std::memory_order_acquire);
+  if ((packed >> 8) != sequence) return {};
+
+  // Pin the frame, then make sure it wasn't pulled out of the ring meanwhile.  The producer
+  // takes frames out of the ring before checking their pins, so either it sees our pin or
+  // we see the slot change.
+  size_t index = packed & 0xff;
+  ++pool_[index]->pins;
+  if (slot.load() != packed)
+  {
+    --pool_[index]->pins;
+    return {};
+  }
+  return MakeHandle(sequence, index);
+}
+
+FrameHandle FrameRing::Latest() const
+{
+  for (;;)
+  {
+    uint64_t head = head_;
+    if (head == 0) return {};
+    auto handle = Get(head);
+    if (handle) return handle;
+  }
+}
+
+FrameHandle FrameRing::Next(uint64_t sequence, std::chrono::milliseconds timeout)
+{
+  uint64_t head = head_;
+  if (head <= sequence)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++waiters_;
+    bool published = cv_.wait_for(lock, timeout, [&] { return head_ > sequence; });
+    --waiters_;
+    if (!published) return {};
+  }
+
+  for (;;)
+  {
+    head = head_;
+    // Oldest frame still in the ring, if we've fallen behind
+    uint64_t oldest = (head > capacity_) ? head - capacity_ + 1 : 1;
+    for (uint64_t s = std::max(sequence + 1, oldest); s <= head; ++s)
+    {
+      auto handle = Get(s);
+      if (handle) return handle;
+    }
+  }
+}
+
+}  // namespace zebral
@@ -0,0 +1,445 @@
+/// \file frame_share.cpp
+/// Implementation of dmabuf frame sharing over Unix sockets
+#if __linux__
+
+#include "frame_share.hpp"
+
+#include <fcntl.h>
+#include <linux/dma-buf.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+namespace
+{
+/// Fills in a Unix socket address, throwing if the path is too long
+sockaddr_un SocketAddress(const std::string& path)
+{
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || (path.size() >= sizeof(addr.sun_path)))
+  {
+    ZBA_THROW("Invalid socket path: " + path, Result::ZBA_INVALID_PARAMETER);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  return addr;
+}
+
+/// Brackets CPU reads of a dmabuf.  Not every exporter needs (or supports) it.
+void SyncDmabuf(int fd, uint64_t flags)
+{
+  dma_buf_sync sync;
+  sync.flags = flags | DMA_BUF_SYNC_READ;
+  while ((-1 == ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync)) && (EINTR == errno))
+  {
+  }
+}
+}  // namespace
+
+FrameSharePublisher::FrameSharePublisher(const std::string& path, size_t max_pending)
+    : path_(path),
+      max_pending_(max_pending),
+      socket_dev_(0),
+      socket_ino_(0),
+      listen_fd_(-1),
+      wake_fd_(-1),
+      exiting_(false),
+      next_id_(1),
+      published_(0),
+      skipped_(0)
+{
+  if (max_pending_ == 0)
+  {
+    ZBA_THROW("Clients must be able to hold a frame", Result::ZBA_INVALID_RANGE);
+  }
+
+  // Replace a stale socket, but never some other file that happens to be at the path.
+  auto addr = SocketAddress(path_);
+  struct stat existing;
+  if (0 == lstat(path_.c_str(), &existing))
+  {
+    if (!S_ISSOCK(existing.st_mode))
+    {
+      ZBA_THROW(path_ + " exists and isn't a socket", Result::ZBA_INVALID_PARAMETER);
+    }
+    unlink(path_.c_str());
+  }
+
+  // Sequenced packets keep each frame's info and fd together.
+  listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  wake_fd_   = eventfd(0, EFD_CLOEXEC);
+  if ((listen_fd_ == -1) || (wake_fd_ == -1))
+  {
+    int err = errno;
+    if (listen_fd_ != -1) close(listen_fd_);
+    if (wake_fd_ != -1) close(wake_fd_);
+    throw Error("Unable to create frame share socket", Result::ZBA_SYS_ERROR, __FILE__,
+                __LINE__, err);
+  }
+  if (-1 == bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+  {
+    int err = errno;
+    close(listen_fd_);
+    close(wake_fd_);
+    throw Error("Unable to bind " + path_, Result::ZBA_SYS_ERROR, __FILE__, __LINE__, err);
+  }
+
+  // Remember which socket is ours, so the dtor doesn't remove a later publisher's.
+  struct stat bound;
+  if (0 == lstat(path_.c_str(), &bound))
+  {
+    socket_dev_ = bound.st_dev;
+    socket_ino_ = bound.st_ino;
+  }
+  if (-1 == listen(listen_fd_, 8))
+  {
+    int err = errno;
+    close(listen_fd_);
+    close(wake_fd_);
+    RemoveSocket();
+    throw Error("Unable to listen on " + path_, Result::ZBA_SYS_ERROR, __FILE__, __LINE__, err);
+  }
+
+  link_            = std::make_shared<Link>();
+  link_->publisher = this;
+  thread_          = std::thread(&FrameSharePublisher::Run, this);
+}
+
+FrameSharePublisher::~FrameSharePublisher()
+{
+  // Loan callbacks that outlive us release their frames from now on.
+  {
+    std::lock_guard<std::mutex> lock(link_->mutex);
+    link_->publisher = nullptr;
+  }
+
+  exiting_ = true;
+  uint64_t wake = 1;
+  if (write(wake_fd_, &wake, sizeof(wake)) < 0)
+  {
+    ZBA_ERRNO("Error waking frame share thread");
+  }
+  if (thread_.joinable()) thread_.join();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!clients_.empty())
+    {
+      Disconnect(clients_.begin());
+    }
+    frames_.clear();
+  }
+  close(listen_fd_);
+  close(wake_fd_);
+  RemoveSocket();
+}
+
+void FrameSharePublisher::RemoveSocket()
+{
+  struct stat current;
+  if ((0 == lstat(path_.c_str(), &current)) && S_ISSOCK(current.st_mode) &&
+      (current.st_dev == socket_dev_) && (current.st_ino == socket_ino_))
+  {
+    unlink(path_.c_str());
+  }
+}
+
+FrameLoanCallback FrameSharePublisher::LoanCallback()
+{
+  return [link = link_](const CameraInfo&, FrameLoan loan) {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (link->publisher) link->publisher->Publish(std::move(loan));
+  };
+}
+
+size_t FrameSharePublisher::clients() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return clients_.size();
+}
+
+void FrameSharePublisher::Publish(FrameLoan loan)
+{
+  if (loan.dmabuf_fd == -1)
+  {
+    ++skipped_;
+    return;
+  }
+
+  SharedFrameInfo info;
+  info.hw_sequence  = loan.hw_sequence;
+  info.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          loan.timestamp.time_since_epoch())
+                          .count();
+  info.size   = loan.size;
+  info.format = static_cast<uint32_t>(loan.format);
+  if (!loan.view.empty())
+  {
+    info.width  = loan.view.width();
+    info.height = loan.view.height();
+    info.stride = static_cast<uint32_t>(loan.view.stride());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  info.id = next_id_++;
+
+  // The fd travels as ancillary data alongside the info.
+  char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+  iovec iov{&info, sizeof(info)};
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg      = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level   = SOL_SOCKET;
+  cmsg->cmsg_type    = SCM_RIGHTS;
+  cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &loan.dmabuf_fd, sizeof(int));
+
+  size_t holders = 0;
+  for (auto& [fd, client] : clients_)
+  {
+    if (client.held.size() >= max_pending_) continue;
+    if (sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(info)))
+    {
+      client.held.insert(info.id);
+      ++holders;
+    }
+  }
+
+  if (holders == 0)
+  {
+    ++skipped_;
+    return;
+  }
+  ++published_;
+  frames_.emplace(info.id, Frame{std::move(loan), holders});
+}
+
+void FrameSharePublisher::Run()
+{
+  std::vector<pollfd> fds;
+  while (!exiting_)
+  {
+    fds.clear();
+    fds.push_back({wake_fd_, POLLIN, 0});
+    fds.push_back({listen_fd_, POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& [fd, client] : clients_)
+      {
+        fds.push_back({fd, POLLIN, 0});
+      }
+    }
+
+    if (-1 == poll(fds.data(), fds.size(), -1))
+    {
+      if (EINTR == errno) continue;
+      ZBA_ERRNO("Frame share poll failed");
+      break;
+    }
+    if (fds[0].revents) break;
+
+    if (fds[1].revents & POLLIN)
+    {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd != -1)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clients_.emplace(fd, Client{fd, {}});
+        ZBA_LOG("Frame share client connected to {}", path_);
+      }
+    }
+
+    // Clients send back the ids of frames they're done with.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 2; i < fds.size(); ++i)
+    {
+      if (!fds[i].revents) continue;
+      auto client = clients_.find(fds[i].fd);
+      if (client == clients_.end()) continue;
+
+      uint64_t id = 0;
+      ssize_t got = 0;
+      while ((got = recv(client->first, &id, sizeof(id), MSG_DONTWAIT)) == sizeof(id))
+      {
+        if (client->second.held.erase(id)) Release(id);
+      }
+      if ((got == 0) || ((got < 0) && (EAGAIN != errno) && (EINTR != errno)))
+      {
+        Disconnect(client);
+      }
+    }
+  }
+}
+
+void FrameSharePublisher::Release(uint64_t id)
+{
+  auto frame = frames_.find(id);
+  if ((frame != frames_.end()) && (--frame->second.holders == 0))
+  {
+    frames_.erase(frame);
+  }
+}
+
+void FrameSharePublisher::Disconnect(std::map<int, Client>::iterator client)
+{
+  ZBA_LOG("Frame share client disconnected from {}", path_);
+  for (auto id : client->second.held)
+  {
+    Release(id);
+  }
+  close(client->first);
+  clients_.erase(client);
+}
+
+SharedFrame::SharedFrame(const SharedFrameInfo& info, int fd, std::shared_ptr<const int> socket)
+    : info_(info),
+      fd_(fd),
+      socket_(std::move(socket)),
+      map_(nullptr)
+{
+}
+
+SharedFrame::~SharedFrame()
+{
+  Reset();
+}
+
+SharedFrame::SharedFrame(SharedFrame&& other)
+    : info_(other.info_),
+      fd_(other.fd_),
+      socket_(std::move(other.socket_)),
+      map_(other.map_)
+{
+  other.fd_  = -1;
+  other.map_ = nullptr;
+}
+
+SharedFrame& SharedFrame::operator=(SharedFrame&& other)
+{
+  if (this != &other)
+  {
+    Reset();
+    info_      = other.info_;
+    fd_        = other.fd_;
+    socket_    = std::move(other.socket_);
+    map_       = other.map_;
+    other.fd_  = -1;
+    other.map_ = nullptr;
+  }
+  return *this;
+}
+
+const uint8_t* SharedFrame::Map()
+{
+  if (!map_)
+  {
+    void* map = mmap(nullptr, info_.size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == map)
+    {
+      ZBA_THROW_ERRNO("Error mapping shared frame", Result::ZBA_SYS_ERROR);
+    }
+    map_ = map;
+    SyncDmabuf(fd_, DMA_BUF_SYNC_START);
+  }
+  return static_cast<const uint8_t*>(map_);
+}
+
+void SharedFrame::Reset()
+{
+  if (map_)
+  {
+    SyncDmabuf(fd_, DMA_BUF_SYNC_END);
+    munmap(map_, info_.size);
+    map_ = nullptr;
+  }
+  if (fd_ != -1)
+  {
+    close(fd_);
+    fd_ = -1;
+    if (socket_ && (send(*socket_, &info_.id, sizeof(info_.id), MSG_NOSIGNAL) < 0))
+    {
+      ZBA_ERRNO("Error releasing shared frame");
+    }
+  }
+  socket_.reset();
+}
+
+FrameShareClient::FrameShareClient(const std::string& path)
+{
+  auto addr = SocketAddress(path);
+  int fd    = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+  {
+    ZBA_THROW_ERRNO("Unable to create frame share socket", Result::ZBA_SYS_ERROR);
+  }
+  socket_ = std::shared_ptr<const int>(new int(fd), [](const int* socket) {
+    close(*socket);
+    delete socket;
+  });
+  if (-1 == connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+  {
+    ZBA_THROW_ERRNO("Unable to connect to " + path, Result::ZBA_SYS_ERROR);
+  }
+}
+
+std::optional<SharedFrame> FrameShareClient::Receive(std::chrono::milliseconds timeout)
+{
+  pollfd pfd{*socket_, POLLIN, 0};
+  int result = 0;
+  while ((-1 == (result = poll(&pfd, 1, static_cast<int>(timeout.count())))) && (EINTR == errno))
+  {
+  }
+  if (result == 0) return {};
+
+  SharedFrameInfo info;
+  char control[CMSG_SPACE(sizeof(int))];
+  iovec iov{&info, sizeof(info)};
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t got        = recvmsg(*socket_, &msg, MSG_CMSG_CLOEXEC);
+  if (got <= 0)
+  {
+    ZBA_THROW("Frame share publisher disconnected", Result::ZBA_SYS_ERROR);
+  }
+
+  // Take the fd before checking the message, so a bad one doesn't leak it.
+  int fd        = -1;
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) &&
+      (cmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+  {
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if ((got != sizeof(info)) || (fd == -1))
+  {
+    if (fd != -1) close(fd);
+    ZBA_THROW("Invalid shared frame message", Result::ZBA_SYS_ERROR);
+  }
+  return SharedFrame(info, fd, socket_);
+}
+
+}  // namespace zebral
+
+#endif  // __linux__
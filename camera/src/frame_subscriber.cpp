@@ -0,0 +1,185 @@
+/// \file frame_subscriber.cpp
+/// Implementation of frame subscribers
+#include "frame_subscriber.hpp"
+
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace zebral
+{
+FrameSubscriber::FrameSubscriber(const std::string& name,
+                                 const CameraInfo& info,
+                                 FrameCallback callback,
+                                 const SubscriberOptions& options,
+                                 std::shared_ptr<FrameAccount> account)
+    : name_(name),
+      info_(info),
+      callback_(callback),
+      options_(options),
+      throttle_(options.throttle),
+      account_(account),
+      delivered_(0),
+      dropped_(0),
+      exiting_(false)
+{
+  if (!callback_)
+  {
+    ZBA_THROW("Subscriber requires a callback", Result::ZBA_INVALID_PARAMETER);
+  }
+  if (options_.policy == SubscriberPolicy::LATEST_ONLY)
+  {
+    options_.queue_size = 1;
+  }
+  else if (options_.queue_size == 0)
+  {
+    ZBA_THROW("Subscriber queue size must be at least 1", Result::ZBA_INVALID_RANGE);
+  }
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+  Stop();
+}
+
+void FrameSubscriber::Start()
+{
+  // The thread keeps us alive, so the callback can unsubscribe safely.
+  thread_ = std::thread([self = shared_from_this()] { self->DispatchThread(); });
+}
+
+void FrameSubscriber::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+    for (const auto& queued : queue_)
+    {
+      account_->Release(queued->data_size());
+    }
+    queue_.clear();
+  }
+  frame_cv_.notify_all();
+  space_cv_.notify_all();
+
+  if (thread_.joinable())
+  {
+    // Stopped from our own callback - let the thread finish by itself.
+    if (thread_.get_id() == std::this_thread::get_id())
+    {
+      thread_.detach();
+    }
+    else
+    {
+      thread_.join();
+    }
+  }
+}
+
+bool FrameSubscriber::Push(std::shared_ptr<const CameraFrame> frame)
+{
+  if (!throttle_.Accept(frame->get_timestamp())) return false;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (exiting_) return false;
+
+  if (queue_.size() >= options_.queue_size)
+  {
+    switch (options_.policy)
+    {
+      case SubscriberPolicy::BLOCK:
+      {
+        auto has_room = [&] { return exiting_ || (queue_.size() < options_.queue_size); };
+        if (!space_cv_.wait_for(lock, options_.block_timeout, has_room) || exiting_)
+        {
+          ++dropped_;
+          account_->CountDropped();
+          return false;
+        }
+        break;
+      }
+      case SubscriberPolicy::LATEST_ONLY:
+      case SubscriberPolicy::DROP_OLDEST:
+      default:
+        while (queue_.size() >= options_.queue_size)
+        {
+          DropFront();
+        }
+        break;
+    }
+  }
+
+  // The reference keeps the frame out of reuse until we're done, so charge it to us.
+  account_->Charge(frame->data_size());
+  queue_.emplace_back(std::move(frame));
+  lock.unlock();
+
+  frame_cv_.notify_one();
+  return true;
+}
+
+size_t FrameSubscriber::queued() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::optional<TimeStamp> FrameSubscriber::OldestFrameTime()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (queue_.empty()) return {};
+  return queue_.front()->get_timestamp();
+}
+
+size_t FrameSubscriber::DropOldestFrame()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (queue_.empty()) return 0;
+  size_t bytes = DropFront();
+  lock.unlock();
+
+  space_cv_.notify_one();
+  return bytes;
+}
+
+size_t FrameSubscriber::DropFront()
+{
+  size_t bytes = queue_.front()->data_size();
+  queue_.pop_front();
+  account_->Release(bytes);
+  ++dropped_;
+  account_->CountDropped();
+  return bytes;
+}
+
+void FrameSubscriber::DispatchThread()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;)
+  {
+    frame_cv_.wait(lock, [&] { return exiting_ || !queue_.empty(); });
+    if (exiting_) break;
+
+    auto frame = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    space_cv_.notify_one();
+
+    latency_.Record(TimeStampNow() - frame->get_timestamp());
+    try
+    {
+      callback_(info_, *frame);
+    }
+    catch (const std::exception& e)
+    {
+      ZBA_ERR("Subscriber {} callback threw: {}", name_, e.what());
+    }
+    ++delivered_;
+
+    // Let go of the frame before taking the lock again.
+    account_->Release(frame->data_size());
+    frame.reset();
+    lock.lock();
+  }
+}
+
+}  // namespace zebral
@@ -0,0 +1,76 @@
+/// \file frame_throttle.cpp
+/// Implementation of frame decimation and FPS throttling
+#include "frame_throttle.hpp"
+
+#include "errors.hpp"
+
+namespace zebral
+{
+FrameThrottle::FrameThrottle(const ThrottleSettings& settings)
+    : pass_through_(true),
+      count_(0),
+      skipped_(0)
+{
+  SetSettings(settings);
+}
+
+void FrameThrottle::SetSettings(const ThrottleSettings& settings)
+{
+  if ((settings.every_nth == 0) || (settings.max_fps < 0))
+  {
+    ZBA_THROW("Invalid frame throttle settings", Result::ZBA_INVALID_RANGE);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  settings_     = settings;
+  pass_through_ = (settings.every_nth == 1) && (settings.max_fps == 0);
+  count_        = 0;
+  next_due_.reset();
+}
+
+ThrottleSettings FrameThrottle::GetSettings() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return settings_;
+}
+
+void FrameThrottle::Reset()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  count_ = 0;
+  next_due_.reset();
+}
+
+bool FrameThrottle::Accept(TimeStamp timestamp)
+{
+  if (pass_through_) return true;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if ((count_++ % settings_.every_nth) != 0)
+  {
+    ++skipped_;
+    return false;
+  }
+
+  if (settings_.max_fps > 0)
+  {
+    auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / settings_.max_fps));
+    auto tolerance = std::chrono::duration_cast<Clock::duration>(interval * kJitterTolerance);
+
+    if (next_due_ && (timestamp + tolerance < *next_due_))
+    {
+      ++skipped_;
+      return false;
+    }
+
+    // Keep to the schedule, unless we've fallen a whole interval behind (e.g. a stall).
+    if (!next_due_ || (timestamp - *next_due_ > interval))
+    {
+      next_due_ = timestamp;
+    }
+    *next_due_ += interval;
+  }
+  return true;
+}
+
+}  // namespace zebral
@@ -92,4 +92,23 @@ bool ParamMenu::setIndex(int idx)
   return err;
 }
 
+AsyncOp<bool> NextParamChange(EventLoop& loop,
+                              std::shared_ptr<Param> param,
+                              std::chrono::milliseconds timeout,
+                              std::stop_token stop)
+{
+  auto start = [param](const std::shared_ptr<AsyncState<bool>>& state) {
+    // Subscriber names must be unique, so use the state's address.
+    std::weak_ptr<AsyncState<bool>> weak = state;
+    ParamChangedCb cb{"async:" + std::to_string(reinterpret_cast<uintptr_t>(state.get())),
+                      [weak](Param*, bool, bool) {
+                        if (auto cur = weak.lock()) cur->Complete(true);
+                      }};
+    param->Subscribe(cb);
+    // Can't unsubscribe from inside the param's callback, so do it on the loop.
+    state->SetCleanup([param, cb] { param->Unsubscribe(cb); });
+  };
+  return AsyncOp<bool>(loop, start, timeout, std::move(stop));
+}
+
 }  // namespace zebral
\ No newline at end of file
@@ -7,16 +7,24 @@
 #endif  // _WIN32
 
 #include <fcntl.h>
+#if __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <filesystem>
+#include <fstream>
 
+#include "camera_composite.hpp"
+#include "camera_group.hpp"
 #include "camera_manager.hpp"
 #include "camera_platform.hpp"
 #include "convert.hpp"
 #include "errors.hpp"
 #include "find_files.hpp"
+#include "frame_share.hpp"
 #include "gtest/gtest.h"
 #include "log.hpp"
 #include "param.hpp"
@@ -158,8 +166,1380 @@ TEST(CameraTests, ConvertSpeeds)
   camera->Stop();
 }
 
+TEST(CameraTests, FrameViews)
+{
+  // 8x6 BGRA frame with each pixel holding its own coordinates
+  CameraFrame bgra(8, 6, 4, 1, false, false);
+  for (int y = 0; y < bgra.height(); ++y)
+  {
+    for (int x = 0; x < bgra.width(); ++x)
+    {
+      uint8_t* px = bgra.data() + bgra.stride() * y + x * 4;
+      px[0]       = static_cast<uint8_t>(x);
+      px[1]       = static_cast<uint8_t>(y);
+      px[2]       = 0xAA;
+      px[3]       = 0xFF;
+    }
+  }
+
+  // ROIs refer to the frame's memory - no copies.
+  auto roi = bgra.roi(2, 1, 4, 3);
+  ASSERT_EQ(roi.width(), 4);
+  ASSERT_EQ(roi.height(), 3);
+  ASSERT_EQ(roi.stride(), bgra.stride());
+  ASSERT_FALSE(roi.is_contiguous());
+  ASSERT_EQ(roi.data(), bgra.data() + bgra.stride() * 1 + 2 * 4);
+  ASSERT_EQ(roi.row(2)[0], 2);
+  ASSERT_EQ(roi.row(2)[1], 3);
+
+  // Sub-ROIs of ROIs are relative to the ROI
+  auto sub = roi.roi(1, 1, 2, 2);
+  ASSERT_EQ(sub.data(), bgra.roi(3, 2, 2, 2).data());
+  EXPECT_THROW(roi.roi(3, 0, 2, 1), Error);
+
+  // Convert a BGRA ROI straight into an ROI of a larger BGR frame
+  CameraFrame bgr(10, 10, 3, 1, false, false);
+  BGRAToBGRFrame(roi, bgr.roi(5, 5, 4, 3));
+  const uint8_t* px = bgr.data() + bgr.stride() * 7 + 8 * 3;
+  ASSERT_EQ(px[0], 5);  // x = 2 + 3
+  ASSERT_EQ(px[1], 3);  // y = 1 + 2
+  ASSERT_EQ(px[2], 0xAA);
+  EXPECT_THROW(BGRAToBGRFrame(roi, bgr.roi(0, 0, 3, 3)), Error);
+
+  // Materializing a view gives an unpadded copy
+  CameraFrame copy(roi);
+  ASSERT_EQ(copy.width(), 4);
+  ASSERT_EQ(copy.height(), 3);
+  ASSERT_EQ(copy.data_size(), 4u * 3u * 4u);
+  ASSERT_EQ(0, memcmp(copy.data() + copy.stride(), roi.row(1), roi.row_bytes()));
+
+  // External buffers work too
+  std::vector<uint8_t> external(16 * 4, 7);
+  FrameView ext(external.data(), 4, 4, 16, 1, 1);
+  CameraFrame grey(2, 2, 1, 1, false, false);
+  GreyToFrame(ext.roi(1, 1, 2, 2), grey.view());
+  ASSERT_EQ(grey.data()[3], 7);
+}
+
+TEST(CameraTests, PlanarFrames)
+{
+  // 4x4 NV12 - Y plane, then a 2x2 plane of interleaved UV
+  CameraFrame nv12(4, 4, 1, {{1, 1, 1}, {2, 2, 2}});
+  ASSERT_TRUE(nv12.is_planar());
+  ASSERT_EQ(nv12.plane_count(), 2);
+  ASSERT_EQ(nv12.data_size(), 4u * 4u * 3u / 2u);
+  ASSERT_EQ(nv12.width(), 4);
+  ASSERT_EQ(nv12.height(), 4);
+  ASSERT_EQ(nv12.channels(), 1);
+  ASSERT_EQ(nv12.plane(1).offset, 16u);
+  ASSERT_EQ(nv12.plane(1).width, 2);
+  ASSERT_EQ(nv12.plane(1).stride, 4u);
+  EXPECT_THROW(nv12.plane(2), Error);
+
+  // Luma only consumers can just use view()
+  auto luma = nv12.view();
+  ASSERT_EQ(luma.data(), nv12.plane_view(0).data());
+  std::fill(nv12.data(), nv12.data() + 16, static_cast<uint8_t>(128));
+  std::fill(nv12.data() + 16, nv12.data() + 24, static_cast<uint8_t>(128));
+
+  // I420 - three planes, same image
+  CameraFrame i420(4, 4, 1, {{1, 1, 1}, {1, 2, 2}, {1, 2, 2}});
+  ASSERT_EQ(i420.plane_count(), 3);
+  ASSERT_EQ(i420.plane(2).offset, 20u);
+  std::fill(i420.data(), i420.data() + i420.data_size(), static_cast<uint8_t>(128));
+
+  // Both convert to the same BGR
+  CameraFrame bgr1(4, 4, 3, 1, false, false);
+  CameraFrame bgr2(4, 4, 3, 1, false, false);
+  PlanarYUVToBGRFrame(nv12, bgr1.view());
+  PlanarYUVToBGRFrame(i420, bgr2.view());
+  ASSERT_EQ(0, memcmp(bgr1.data(), bgr2.data(), bgr1.data_size()));
+
+  // Chroma planes, sources and destinations with the wrong layout are rejected
+  EXPECT_THROW(NV12ToBGRFrame(nv12.plane_view(0), nv12.plane_view(1).roi(0, 0, 2, 1),
+                              bgr1.view()),
+               Error);
+  EXPECT_THROW(I420ToBGRFrame(i420.plane_view(0), i420.plane_view(1), i420.plane_view(0),
+                              bgr1.view()),
+               Error);
+  EXPECT_THROW(NV12ToBGRFrame(nv12.plane_view(0), nv12.plane_view(1), nv12.view()), Error);
+  EXPECT_THROW(BGRAToBGRFrame(bgr1.view(), bgr2.view()), Error);
+
+  // Interleaved frames are a single plane
+  ASSERT_EQ(bgr1.plane_count(), 1);
+  ASSERT_FALSE(bgr1.is_planar());
+  EXPECT_THROW(PlanarYUVToBGRFrame(bgr1, bgr2.view()), Error);
+}
+
+TEST(CameraTests, PixelFormats)
+{
+  // The table is usable at compile time
+  static_assert(GetPixelFormatInfo(PixelFormat::NV12).num_planes == 2);
+  static_assert(GetPixelFormatInfo(PixelFormat::Z16).bytes_per_component == 2);
+  static_assert(GetPixelFormatInfo(PixelFormat::YUYV).row_bytes(640) == 1280);
+  static_assert(GetPixelFormatInfo(PixelFormat::I420).row_bytes(640, 1) == 320);
+  static_assert(GetPixelFormatInfo(static_cast<PixelFormat>(FOURCCTOUINT32("H264"))).format ==
+                PixelFormat::UNKNOWN);
+
+  // Windows doesn't pad FourCCs, Linux does - both are the same format.
+  ASSERT_EQ(PixelFormatFromString("L8"), PixelFormat::L8);
+  ASSERT_EQ(PixelFormatFromString("L8  "), PixelFormat::L8);
+  ASSERT_EQ(PixelFormatToString(PixelFormat::Z16), "Z16 ");
+  ASSERT_EQ(PixelFormatFromString("{00000000-0000-0000-0000-000000000000}"), PixelFormat::UNKNOWN);
+
+  FormatInfo info(640, 480, 30.0f, "D16");
+  ASSERT_EQ(info.pixel_format, PixelFormat::D16);
+  ASSERT_EQ(info.channels, 1);
+  ASSERT_EQ(info.bytespppc, 2);
+  ASSERT_TRUE(info.Matches(FormatInfo(640, 480, 30.0f, "D16 ")));
+  ASSERT_FALSE(info.Matches(FormatInfo(640, 480, 30.0f, "Z16 ")));
+
+  // Frames lay themselves out from the table
+  CameraFrame yuyv(4, 2, PixelFormat::YUYV);
+  ASSERT_EQ(yuyv.pixel_format(), PixelFormat::YUYV);
+  ASSERT_EQ(yuyv.channels(), 2);
+  ASSERT_EQ(yuyv.stride(), 8u);
+  CameraFrame i420(4, 2, PixelFormat::I420);
+  ASSERT_EQ(i420.plane_count(), 3);
+  ASSERT_EQ(i420.data_size(), 12u);
+  EXPECT_THROW(CameraFrame(4, 2, PixelFormat::UNKNOWN), Error);
+
+  // And decode through the table's converter
+  std::fill(yuyv.data(), yuyv.data() + yuyv.data_size(), static_cast<uint8_t>(128));
+  CameraFrame bgr(4, 2, GetPixelFormatInfo(PixelFormat::YUYV).decoded);
+  ASSERT_EQ(bgr.channels(), 3);
+  ASSERT_TRUE(DecodeToFrame(yuyv.data(), yuyv.data_size(), GetPixelFormatInfo(PixelFormat::YUYV),
+                            bgr));
+  ASSERT_FALSE(DecodeToFrame(yuyv.data(), yuyv.data_size(),
+                             GetPixelFormatInfo(PixelFormat::RGB), bgr));
+}
+
+// Benchmark of a 4K conversion with frames in normal pages vs huge pages.
+// The speedup depends on the machine (and whether huge pages are available), so it's logged
+// rather than asserted.
+TEST(CameraTests, HugePageFrames)
+{
+  constexpr int kWidth  = 3840;
+  constexpr int kHeight = 2160;
+
+  auto before = GetFrameMemoryStats();
+  CameraFrame normal, huge;
+  normal.set_frame_memory(FrameMemory::DEFAULT);
+  normal.reset(kWidth, kHeight, PixelFormat::BGR);
+  huge.set_frame_memory(FrameMemory::HUGE_PAGES);
+  huge.reset(kWidth, kHeight, PixelFormat::BGR);
+  memset(normal.data(), 0x5a, normal.data_size());
+  memcpy(huge.data(), normal.data(), normal.data_size());
+  auto after = GetFrameMemoryStats();
+
+  // Every huge page allocation is counted as huge, or as a fallback to normal pages.
+  ASSERT_EQ(huge.frame_memory(), FrameMemory::HUGE_PAGES);
+  ASSERT_EQ(normal.frame_memory(), FrameMemory::DEFAULT);
+  ASSERT_EQ(0, memcmp(normal.data(), huge.data(), normal.data_size()));
+  ASSERT_GT(after.explicit_huge + after.transparent_huge + after.fallback,
+            before.explicit_huge + before.transparent_huge + before.fallback);
+#if __linux__
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(huge.data()) % kHugePageSize);
+#endif
+
+  // Copies keep their memory type, and small frames just use the heap.
+  CameraFrame copy = huge;
+  ASSERT_EQ(copy.frame_memory(), FrameMemory::HUGE_PAGES);
+  copy.reset(16, 16, PixelFormat::BGR);
+  ASSERT_EQ(copy.data_size(), 16u * 16u * 3u);
+}
+
+/// Times 4K decodes into normal and huge page frames.  Slow, so run it by hand with
+/// --gtest_also_run_disabled_tests.
+TEST(CameraTests, DISABLED_HugePageFramesBenchmark)
+{
+  constexpr int kWidth      = 3840;
+  constexpr int kHeight     = 2160;
+  constexpr int kIterations = 10;
+
+  auto run = [&](FrameMemory memory, CameraFrame& bgr) {
+    SetDefaultFrameMemory(memory);
+    CameraFrame yuyv(kWidth, kHeight, PixelFormat::YUYV);
+    bgr.reset(kWidth, kHeight, PixelFormat::BGR);
+    for (size_t i = 0; i < yuyv.data_size(); ++i)
+    {
+      yuyv.data()[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    // Warm up, so we're not timing page faults
+    DecodeToFrame(yuyv.data(), yuyv.data_size(), GetPixelFormatInfo(PixelFormat::YUYV), bgr);
+    auto start = zba_now();
+    for (int i = 0; i < kIterations; ++i)
+    {
+      DecodeToFrame(yuyv.data(), yuyv.data_size(), GetPixelFormatInfo(PixelFormat::YUYV), bgr);
+    }
+    return zba_elapsed_sec(start);
+  };
+
+  CameraFrame normal, huge;
+  normal.set_frame_memory(FrameMemory::DEFAULT);
+  auto normal_time = run(FrameMemory::DEFAULT, normal);
+  huge.set_frame_memory(FrameMemory::HUGE_PAGES);
+  auto huge_time = run(FrameMemory::HUGE_PAGES, huge);
+  SetDefaultFrameMemory(FrameMemory::DEFAULT);
+
+  auto stats = GetFrameMemoryStats();
+  ZBA_LOG("4K YUYV->BGR x{}: normal pages {}s, huge pages {}s", kIterations, normal_time,
+          huge_time);
+  ZBA_LOG("Huge page allocations - explicit: {} transparent: {} fallback: {}",
+          stats.explicit_huge, stats.transparent_huge, stats.fallback);
+  ASSERT_EQ(0, memcmp(normal.data(), huge.data(), normal.data_size()));
+}
+
+/// Camera without hardware - frames are pushed in by the test.
+class TestCamera : public Camera
+{
+ public:
+  TestCamera(const std::string& name = "TestCamera") : Camera(CameraInfo(name, "")) {}
+
+  /// Delivers a frame as if it came from the device
+  void Deliver(const CameraFrame& frame)
+  {
+    if (AcceptFrame(frame.get_timestamp())) OnFrameReceived(frame);
+  }
+
+  /// Sets how frames are decoded without needing a mode
+  void SetDecode(DecodeType decode)
+  {
+    decode_ = decode;
+  }
+
+  /// Counts filled buffers as if the platform dequeued them together
+  void DequeueBuffers(size_t ready)
+  {
+    CountBufferQueue(ready);
+  }
+
+  /// Sets the mode without needing it in the camera's formats
+  void SetMode(const FormatInfo& mode)
+  {
+    current_mode_ = std::make_unique<FormatInfo>(mode);
+  }
+
+  /// Adds a mode the camera can be set to
+  void AddFormat(const FormatInfo& mode)
+  {
+    info_.AddFormat(mode);
+  }
+
+  /// Sets the buffer count as if the driver allocated it
+  void SetAllocatedBuffers(size_t count)
+  {
+    allocated_buffers_ = count;
+  }
+
+  int starts = 0;  ///< OnStart() calls
+  int stops  = 0;  ///< OnStop() calls
+
+  /// Offers a buffer for loan as if it came from the device
+  bool Lend(const std::vector<uint8_t>& buffer, std::function<void()> release)
+  {
+    FrameLoan loan;
+    loan.data      = buffer.data();
+    loan.size      = buffer.size();
+    loan.timestamp = TimeStampNow();
+    if (LendBuffer(loan, release)) return true;
+    release();
+    return false;
+  }
+
+ protected:
+  void OnStart() override
+  {
+    ++starts;
+  }
+  void OnStop() override
+  {
+    ++stops;
+  }
+  FormatInfo OnSetFormat(const FormatInfo& mode) override
+  {
+    return mode;
+  }
+};
+
+TEST(CameraTests, FrameBudget)
+{
+  auto& budget = FrameBudget::Instance();
+  TestCamera camera("BudgetCamera");
+  CameraFrame frame(64, 64, PixelFormat::BGR);
+  const size_t frame_size = frame.data_size();
+  size_t base             = budget.GetBytes();
+
+  // Frames handed out are charged to the readers account
+  camera.Deliver(frame);
+  std::vector<CameraFrame> held;
+  held.emplace_back(*camera.GetLastFrame());
+  ASSERT_EQ(camera.GetFrameAccount()->bytes(), frame_size);
+  ASSERT_EQ(budget.GetBytes(), base + 2 * frame_size);
+
+  // Refuse new frames once readers have piled up too many copies
+  budget.SetLimit(base + 3 * frame_size);
+  budget.SetPolicy(BudgetPolicy::REFUSE_NEW);
+  held.emplace_back(*camera.GetLastFrame());
+  frame.set_timestamp(TimeStampNow());
+  camera.Deliver(frame);
+  ASSERT_EQ(camera.GetFrameAccount()->refused(), 1u);
+  ASSERT_EQ(camera.GetLastFrame()->get_timestamp(), held[0].get_timestamp());
+
+  auto usage = budget.GetUsage();
+  auto readers =
+      std::find_if(usage.accounts.begin(), usage.accounts.end(),
+                   [](const FrameAccountUsage& a) { return a.name == "BudgetCamera/readers"; });
+  ASSERT_NE(readers, usage.accounts.end());
+  ASSERT_EQ(readers->bytes, 2 * frame_size);
+
+  // Block until a reader lets go of a frame
+  budget.SetPolicy(BudgetPolicy::BLOCK, std::chrono::milliseconds(5000));
+  std::thread release([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    held.pop_back();
+  });
+  frame.set_timestamp(TimeStampNow());
+  camera.Deliver(frame);
+  release.join();
+  ASSERT_EQ(camera.GetLastFrame()->get_timestamp(), frame.get_timestamp());
+
+  // Drop the oldest frame from a queue to make room
+  class Queue : public FrameHolder
+  {
+   public:
+    std::optional<TimeStamp> OldestFrameTime() override
+    {
+      if (frames.empty()) return {};
+      return frames.front().get_timestamp();
+    }
+    size_t DropOldestFrame() override
+    {
+      size_t bytes = frames.front().data_size();
+      frames.erase(frames.begin());
+      return bytes;
+    }
+    std::vector<CameraFrame> frames;
+  };
+  // The camera's ring holds 2 frames now; queue 3 more.
+  auto queue = std::make_shared<Queue>();
+  budget.RegisterHolder(queue);
+  budget.SetPolicy(BudgetPolicy::DROP_OLDEST);
+  budget.SetLimit(base + 5 * frame_size);
+  held.emplace_back(*camera.GetLastFrame());
+  held.emplace_back(*camera.GetLastFrame());
+  queue->frames = std::move(held);
+  frame.set_timestamp(TimeStampNow());
+  camera.Deliver(frame);
+  ASSERT_EQ(queue->frames.size(), 2u);
+  ASSERT_EQ(camera.GetLastFrame()->get_timestamp(), frame.get_timestamp());
+
+  budget.SetLimit(0);
+}
+
+TEST(CameraTests, FrameRing)
+{
+  FrameRing ring(2);
+  ASSERT_FALSE(ring.Latest());
+  ASSERT_FALSE(ring.Next(0, std::chrono::milliseconds(1)));
+
+  auto publish = [&](int value) {
+    auto frame = ring.AcquireFrame();
+    frame->reset(8, 8, PixelFormat::GREY);
+    memset(frame->data(), value, frame->data_size());
+    return ring.Publish();
+  };
+
+  ASSERT_EQ(publish(1), 1u);
+  ASSERT_EQ(publish(2), 2u);
+  ASSERT_EQ(ring.Latest().sequence, 2u);
+  ASSERT_EQ(ring.Next(1, std::chrono::milliseconds(1)).frame->data()[0], 2);
+
+  // Fell behind - get the oldest frame still in the ring
+  auto held = ring.Latest();
+  publish(3);
+  publish(4);
+  auto next = ring.Next(0, std::chrono::milliseconds(1));
+  ASSERT_EQ(next.sequence, 3u);
+  ASSERT_EQ(next.frame->data()[0], 3);
+
+  // Frames held by readers aren't reused
+  ASSERT_EQ(held.frame->data()[0], 2);
+  held = {};
+  next = {};
+
+  // Readers holding every pool frame make the producer drop frames rather than wait
+  std::vector<FrameHandle> handles;
+  while (ring.Exhausted() == 0)
+  {
+    handles.push_back(ring.Latest());
+    if (auto frame = ring.AcquireFrame()) ring.Publish();
+  }
+  ASSERT_GE(handles.size(), FrameRing::kMaxPoolFrames - 2);
+  handles.clear();
+  ASSERT_TRUE(ring.AcquireFrame());
+
+  // Reader waits for the next frame from another thread
+  uint64_t last = ring.Publish();
+  std::thread producer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    publish(5);
+  });
+  next = ring.Next(last, std::chrono::milliseconds(5000));
+  producer.join();
+  ASSERT_EQ(next.sequence, last + 1);
+  ASSERT_EQ(next.frame->data()[0], 5);
+
+  // Camera readers share the ring without copying
+  TestCamera camera("RingCamera");
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+  camera.Deliver(frame);
+  auto handle = camera.GetLatestFrameHandle();
+  ASSERT_EQ(handle.sequence, 1u);
+  ASSERT_FALSE(camera.GetFrameAfter(handle.sequence, 1));
+  camera.Deliver(frame);
+  ASSERT_EQ(camera.GetFrameAfter(handle.sequence, 1).sequence, 2u);
+}
+
+TEST(CameraTests, Subscribers)
+{
+  TestCamera camera("SubscriberCamera");
+  CameraFrame frame(32, 32, PixelFormat::BGR);
+
+  // A slow recorder with a small queue, and a tracker that only wants the latest frame.
+  std::atomic<int> recorded = 0;
+  std::atomic<int> tracked  = 0;
+  std::mutex gate;
+  std::unique_lock<std::mutex> hold(gate);
+  auto recorder = camera.Subscribe(
+      "recorder",
+      [&](const CameraInfo&, const CameraFrame&) {
+        std::lock_guard<std::mutex> lock(gate);
+        ++recorded;
+      },
+      {SubscriberPolicy::DROP_OLDEST, 2});
+  auto tracker = camera.Subscribe(
+      "tracker", [&](const CameraInfo&, const CameraFrame&) { ++tracked; },
+      {SubscriberPolicy::LATEST_ONLY});
+
+  // The recorder is stuck, but the tracker still gets every frame.
+  for (int i = 0; i < 10; ++i)
+  {
+    camera.Deliver(frame);
+    for (int wait = 0; (tracked <= i) && (wait < 5000); ++wait)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  ASSERT_EQ(tracked, 10);
+  ASSERT_EQ(recorded, 0);
+  ASSERT_EQ(recorder->queued(), 2u);
+  ASSERT_GE(recorder->dropped(), 7u);
+  auto usage = FrameBudget::Instance().GetUsage();
+  ASSERT_TRUE(std::any_of(usage.accounts.begin(), usage.accounts.end(),
+                          [](const FrameAccountUsage& a) {
+                            return (a.name == "SubscriberCamera/recorder") && (a.bytes > 0);
+                          }));
+
+  // Over budget, DROP_OLDEST takes the recorder's oldest queued frame to make room.
+  auto& budget  = FrameBudget::Instance();
+  size_t before = recorder->dropped();
+  budget.SetPolicy(BudgetPolicy::DROP_OLDEST);
+  budget.SetLimit(budget.GetUsage().bytes);
+  camera.Deliver(frame);
+  budget.SetLimit(0);
+  ASSERT_EQ(recorder->dropped(), before + 1);
+  ASSERT_EQ(recorder->queued(), 2u);
+
+  // Once it catches up it gets the queued frames
+  hold.unlock();
+  for (int wait = 0; (recorder->queued() > 0) && (wait < 5000); ++wait)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  camera.Unsubscribe(recorder);
+  ASSERT_EQ(recorded + recorder->dropped(), 11u);
+
+  // BLOCK waits for room, up to the timeout
+  std::atomic<bool> release = false;
+  auto blocker              = camera.Subscribe(
+      "blocker",
+      [&](const CameraInfo&, const CameraFrame&) {
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      },
+      {SubscriberPolicy::BLOCK, 1, std::chrono::milliseconds(20)});
+  camera.Deliver(frame);  // Dispatched, stuck in callback
+  for (int wait = 0; (blocker->queued() > 0) && (wait < 5000); ++wait)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  camera.Deliver(frame);  // Queued
+  camera.Deliver(frame);  // Times out
+  ASSERT_EQ(blocker->dropped(), 1u);
+  release = true;
+
+  // Subscribers can unsubscribe themselves
+  std::atomic<int> once = 0;
+  std::shared_ptr<FrameSubscriber> self;
+  std::mutex self_mutex;
+  {
+    std::lock_guard<std::mutex> lock(self_mutex);
+    self = camera.Subscribe("once", [&](const CameraInfo&, const CameraFrame&) {
+      std::lock_guard<std::mutex> lock(self_mutex);
+      ++once;
+      camera.Unsubscribe(self);
+    });
+  }
+  camera.Deliver(frame);
+  for (int wait = 0; (once == 0) && (wait < 5000); ++wait)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  camera.Deliver(frame);
+  ASSERT_EQ(once, 1);
+}
+
+TEST(CameraTests, FrameThrottle)
+{
+  // 30 fps for 3 seconds, with a little jitter
+  std::vector<TimeStamp> stamps;
+  TimeStamp start = TimeStampNow();
+  for (int i = 0; i < 90; ++i)
+  {
+    auto jitter = std::chrono::microseconds(((i * 7919) % 2001) - 1000);
+    stamps.push_back(start + std::chrono::microseconds(i * 33333) + jitter);
+  }
+  auto count = [&](FrameThrottle& throttle) {
+    return std::count_if(stamps.begin(), stamps.end(),
+                         [&](TimeStamp t) { return throttle.Accept(t); });
+  };
+
+  FrameThrottle all;
+  ASSERT_EQ(count(all), 90);
+  FrameThrottle third({3, 0});
+  ASSERT_EQ(count(third), 30);
+  ASSERT_EQ(third.skipped(), 60u);
+
+  // Rates that divide the camera's, and ones that don't, keep the right average.
+  FrameThrottle five({1, 5});
+  ASSERT_NEAR(count(five), 15, 1);
+  FrameThrottle twelve({1, 12});
+  ASSERT_NEAR(count(twelve), 36, 1);
+  ASSERT_THROW(FrameThrottle({0, 0}), Error);
+
+  // Camera-wide throttling never publishes the skipped frames
+  TestCamera camera("ThrottleCamera");
+  camera.SetThrottle({2, 0});
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+  for (int i = 0; i < 10; ++i)
+  {
+    frame.set_timestamp(stamps[i]);
+    camera.Deliver(frame);
+  }
+  ASSERT_EQ(camera.GetLatestFrameHandle().sequence, 5u);
+  ASSERT_EQ(camera.GetThrottledFrames(), 5u);
+
+  // Subscribers can throttle themselves further
+  camera.SetThrottle({});
+  std::atomic<int> received = 0;
+  SubscriberOptions options;
+  options.queue_size = 90;
+  options.throttle   = {1, 5};
+  auto subscriber    = camera.Subscribe(
+      "slow", [&](const CameraInfo&, const CameraFrame&) { ++received; }, options);
+  for (auto t : stamps)
+  {
+    frame.set_timestamp(t);
+    camera.Deliver(frame);
+  }
+  for (int wait = 0; (received + subscriber->throttled() < 90) && (wait < 5000); ++wait)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  camera.Unsubscribe(subscriber);
+  ASSERT_NEAR(received, 15, 1);
+  ASSERT_EQ(received + subscriber->throttled(), 90u);
+}
+
+TEST(CameraTests, DeferredDecode)
+{
+  CameraFrame raw(64, 32, PixelFormat::YUY2);
+  for (size_t i = 0; i < raw.data_size(); ++i)
+  {
+    raw.data()[i] = static_cast<uint8_t>(i * 13);
+  }
+  CameraFrame expected;
+  ASSERT_TRUE(DecodeFrame(raw, expected));
+  ASSERT_EQ(expected.pixel_format(), PixelFormat::BGR);
+
+  TestCamera camera("DeferredCamera");
+  camera.SetDecode(Camera::DecodeType::DEFERRED);
+  camera.Deliver(raw);
+
+  // Published raw; decoded once on first read, then shared.
+  auto handle = camera.GetLatestFrameHandle();
+  ASSERT_EQ(handle.frame->pixel_format(), PixelFormat::YUY2);
+  auto decoded = handle.Decoded();
+  ASSERT_EQ(decoded->pixel_format(), PixelFormat::BGR);
+  ASSERT_EQ(decoded, camera.GetLatestFrameHandle().Decoded(PixelFormat::BGR));
+  ASSERT_EQ(handle.Decoded(PixelFormat::YUY2), handle.frame);
+  ASSERT_THROW(handle.Decoded(PixelFormat::NV12), Error);
+  ASSERT_EQ(0, memcmp(decoded->data(), expected.data(), expected.data_size()));
+
+  auto last = camera.GetLastFrame();
+  ASSERT_EQ(last->pixel_format(), PixelFormat::BGR);
+  ASSERT_EQ(0, memcmp(last->data(), expected.data(), expected.data_size()));
+
+  // Callbacks get decoded frames too
+  PixelFormat callback_format = PixelFormat::UNKNOWN;
+  camera.Start([&](const CameraInfo&, const CameraFrame& frame) {
+    callback_format = frame.pixel_format();
+  });
+  camera.Deliver(raw);
+  camera.Stop();
+  ASSERT_EQ(callback_format, PixelFormat::BGR);
+
+  // Without DEFERRED, readers get what was published
+  camera.SetDecode(Camera::DecodeType::NONE);
+  camera.Deliver(raw);
+  ASSERT_EQ(camera.GetLastFrame()->pixel_format(), PixelFormat::YUY2);
+}
+
+TEST(CameraTests, CallbackExecutors)
+{
+  TestCamera camera("ExecutorCamera");
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+
+  // Inline runs on the capture thread
+  std::thread::id callback_thread;
+  camera.Start([&](const CameraInfo&, const CameraFrame&) {
+    callback_thread = std::this_thread::get_id();
+  });
+  camera.Deliver(frame);
+  ASSERT_EQ(callback_thread, std::this_thread::get_id());
+  camera.Stop();
+
+  // A slow callback on its own thread doesn't hold up delivery; backed up frames are skipped.
+  std::atomic<int> calls = 0;
+  camera.SetCallbackExecutor(std::make_shared<ThreadPoolExecutor>(1));
+  camera.Start([&](const CameraInfo&, const CameraFrame&) {
+    callback_thread = std::this_thread::get_id();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ++calls;
+  });
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 10; ++i)
+  {
+    camera.Deliver(frame);
+  }
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+  camera.Stop();
+
+  auto stats = camera.GetCallbackStats();
+  ASSERT_NE(callback_thread, std::this_thread::get_id());
+  ASSERT_EQ(calls, static_cast<int>(stats.calls) - 1);
+  ASSERT_EQ(stats.calls - 1 + stats.skipped, 10u);
+  ASSERT_GE(stats.max, std::chrono::milliseconds(20));
+  ASSERT_GE(stats.total, stats.max);
+
+  // Callbacks that throw, even non-std exceptions, don't wedge Stop() or reach the capture
+  // thread.
+  camera.Start([](const CameraInfo&, const CameraFrame&) { throw 42; });
+  camera.Deliver(frame);
+  camera.Stop();
+  camera.SetCallbackExecutor(std::make_shared<InlineExecutor>());
+  camera.Start([](const CameraInfo&, const CameraFrame&) { throw std::runtime_error("x"); });
+  EXPECT_NO_THROW(camera.Deliver(frame));
+  camera.Stop();
+}
+
 // You need at least one source for this to test stuff.
 // If not, it passes unit tests but skips a lot of them.
+TEST(CameraTests, CameraStats)
+{
+  TimingHistogram histogram;
+  for (int i = 0; i < 99; ++i)
+  {
+    histogram.Record(std::chrono::microseconds(100));
+  }
+  histogram.Record(std::chrono::milliseconds(10));
+  auto timing = histogram.Snapshot();
+  ASSERT_EQ(timing.count, 100u);
+  ASSERT_EQ(timing.max, std::chrono::milliseconds(10));
+  ASSERT_EQ(timing.last, std::chrono::milliseconds(10));
+  ASSERT_EQ(timing.mean(), std::chrono::nanoseconds(199000));
+  // Percentiles are bucket limits - 100us is in the under-128us bucket.
+  ASSERT_EQ(timing.Percentile(0.5), std::chrono::microseconds(128));
+  ASSERT_EQ(timing.Percentile(0.99), std::chrono::microseconds(128));
+  ASSERT_EQ(timing.Percentile(1.0), std::chrono::milliseconds(10));
+  histogram.Reset();
+  ASSERT_EQ(histogram.Snapshot().count, 0u);
+  ASSERT_EQ(histogram.Snapshot().Percentile(0.5), std::chrono::nanoseconds(0));
+
+  TestCamera camera("StatsCamera");
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+  auto subscriber = camera.Subscribe("stats", [](const CameraInfo&, const CameraFrame&) {});
+  camera.SetThrottle({2, 0});
+  camera.Start([](const CameraInfo&, const CameraFrame&) {});
+  for (int i = 0; i < 10; ++i)
+  {
+    FrameTiming timing{};
+    timing.dequeued = TimeStampNow();
+    frame.set_timestamp(timing.dequeued - std::chrono::milliseconds(10));
+    frame.set_timing(timing);
+    camera.Deliver(frame);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  camera.Stop();
+  auto last   = camera.GetLastFrame();
+  auto stages = last->get_timing();
+  ASSERT_EQ(stages.dequeued - last->get_timestamp(), std::chrono::milliseconds(10));
+  ASSERT_GE(stages.published, stages.dequeued);
+
+  auto stats = camera.GetStats();
+  ASSERT_EQ(stats.captured, 10u);
+  ASSERT_EQ(stats.delivered, 5u);
+  ASSERT_EQ(stats.throttled, 5u);
+  ASSERT_EQ(stats.dropped, 0u);
+  ASSERT_EQ(stats.callback.count, 5u);
+  ASSERT_GT(stats.fps, 0);
+  ASSERT_LT(stats.fps, 1000.0 / 5);
+  ASSERT_EQ(stats.subscribers.size(), 1u);
+  ASSERT_EQ(stats.subscribers[0].name, "stats");
+
+  std::stringstream ss;
+  ss << stats;
+  ASSERT_NE(ss.str().find("delivered: 5"), std::string::npos);
+
+  // Latency - frames are stamped with the monotonic clock, 10ms before they're dequeued
+  ASSERT_EQ(stats.driver_to_user.count, 5u);
+  ASSERT_EQ(stats.capture_to_user.count, 5u);
+  ASSERT_EQ(stats.publish.count, 5u);
+  ASSERT_EQ(stats.subscribers[0].latency.count, 5u);
+  ASSERT_GE(stats.driver_to_user.max, std::chrono::milliseconds(10));
+  ASSERT_GE(stats.driver_to_user.Percentile(0.5), std::chrono::milliseconds(10));
+  ASSERT_LT(stats.capture_to_user.max, std::chrono::milliseconds(10));
+  ASSERT_GE(stats.subscribers[0].latency.max, std::chrono::milliseconds(10));
+
+  camera.ResetStats();
+  stats = camera.GetStats();
+  ASSERT_EQ(stats.captured, 0u);
+  ASSERT_EQ(stats.delivered, 0u);
+  ASSERT_EQ(stats.throttled, 0u);
+  ASSERT_EQ(stats.callback.count, 0u);
+  ASSERT_EQ(stats.fps, 0);
+  camera.Unsubscribe(subscriber);
+}
+
+TEST(CameraTests, PauseResume)
+{
+  TestCamera camera("PausedCamera");
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+  int calls = 0;
+  camera.Start([&](const CameraInfo&, const CameraFrame&) { ++calls; });
+
+  // Paused frames are discarded before the throttle, and the camera stays running.
+  camera.SetThrottle({2, 0});
+  camera.Deliver(frame);
+  camera.Pause();
+  ASSERT_TRUE(camera.IsPaused());
+  ASSERT_TRUE(camera.IsRunning());
+  for (int i = 0; i < 3; ++i)
+  {
+    camera.Deliver(frame);
+  }
+  ASSERT_EQ(calls, 1);
+  auto stats = camera.GetStats();
+  ASSERT_EQ(stats.captured, 4u);
+  ASSERT_EQ(stats.paused, 3u);
+  ASSERT_EQ(stats.throttled, 0u);
+
+  // Resuming starts the throttle over, so the next frame is delivered.
+  camera.Resume();
+  ASSERT_FALSE(camera.IsPaused());
+  camera.Deliver(frame);
+  ASSERT_EQ(calls, 2);
+
+  // Stop() resumes
+  camera.Pause();
+  camera.Stop();
+  ASSERT_FALSE(camera.IsPaused());
+  camera.ResetStats();
+  ASSERT_EQ(camera.GetStats().paused, 0u);
+}
+
+TEST(CameraTests, SwitchFormat)
+{
+  TestCamera camera("SwitchingCamera");
+  FormatInfo preview(320, 240, 30, "YUY2");
+  FormatInfo full(1280, 960, 15, "YUY2");
+  camera.AddFormat(preview);
+  camera.AddFormat(full);
+
+  // Stopped, it's just SetFormat()
+  camera.SwitchFormat(preview, Camera::DecodeType::NONE);
+  ASSERT_EQ(camera.GetFormat()->width, 320);
+  ASSERT_EQ(camera.starts, 0);
+
+  int calls = 0;
+  camera.Start([&](const CameraInfo&, const CameraFrame&) { ++calls; });
+  auto subscriber = camera.Subscribe("switch", [](const CameraInfo&, const CameraFrame&) {});
+  int stops = camera.stops;
+
+  // Running, only the platform is restarted - the camera keeps its callback and subscribers.
+  camera.SwitchFormat(full, Camera::DecodeType::NONE);
+  ASSERT_TRUE(camera.IsRunning());
+  ASSERT_EQ(camera.starts, 2);
+  ASSERT_EQ(camera.stops, stops + 1);
+  ASSERT_EQ(camera.GetFormat()->width, 1280);
+  camera.Deliver(CameraFrame(1280, 960, PixelFormat::YUY2));
+  ASSERT_EQ(calls, 1);
+  ASSERT_EQ(camera.GetLastFrame()->width(), 1280);
+
+  // Unknown modes are refused without stopping
+  ASSERT_THROW(camera.SwitchFormat(FormatInfo(640, 480, 0, "YUY2")), Error);
+  ASSERT_TRUE(camera.IsRunning());
+  ASSERT_EQ(camera.GetFormat()->width, 1280);
+
+  camera.Unsubscribe(subscriber);
+  camera.Stop();
+}
+
+TEST(CameraTests, FrameRateRanges)
+{
+  // A stepwise/continuous mode matches any rate in its range
+  FormatInfo range(640, 480, 60, "YUY2");
+  range.min_fps = 5;
+  ASSERT_TRUE(range.HasFpsRange());
+  ASSERT_TRUE(range.Matches(FormatInfo(640, 480, 12.5f, "YUY2")));
+  ASSERT_TRUE(FormatInfo(640, 480, 5, "YUY2").Matches(range));
+  ASSERT_FALSE(range.Matches(FormatInfo(640, 480, 90, "YUY2")));
+  ASSERT_FALSE(range.Matches(FormatInfo(640, 480, 2, "YUY2")));
+  ASSERT_TRUE(range.Matches(FormatInfo(640, 480, 0, "YUY2")));
+  std::stringstream ss;
+  ss << range;
+  ASSERT_NE(ss.str().find("@5-60fps"), std::string::npos);
+
+  // Discrete rates still have to be within 0.1
+  ASSERT_TRUE(FormatInfo(640, 480, 30, "YUY2").Matches(FormatInfo(640, 480, 29.97f, "YUY2")));
+  ASSERT_FALSE(FormatInfo(640, 480, 30, "YUY2").Matches(FormatInfo(640, 480, 25, "YUY2")));
+
+  // Setting a range mode asks the platform for the requested rate
+  TestCamera camera("RateCamera");
+  camera.AddFormat(range);
+  camera.SetFormat(FormatInfo(640, 480, 12.5f, "YUY2"), Camera::DecodeType::NONE);
+  ASSERT_FLOAT_EQ(camera.GetFormat()->fps, 12.5f);
+  ASSERT_FALSE(camera.GetFormat()->HasFpsRange());
+
+  // Without a rate, the whole range is passed on for the platform to pick
+  camera.SetFormat(FormatInfo(640, 480, 0, "YUY2"), Camera::DecodeType::NONE);
+  ASSERT_TRUE(camera.GetFormat()->HasFpsRange());
+}
+
+TEST(CameraTests, FrameSizeRanges)
+{
+  // A stepwise mode is one entry, matching any size in its range
+  FormatInfo range(1920, 1080, 30, "YUY2");
+  range.min_width   = 160;
+  range.min_height  = 120;
+  range.step_width  = 16;
+  range.step_height = 8;
+  ASSERT_TRUE(range.HasSizeRange());
+  ASSERT_TRUE(range.Matches(FormatInfo(800, 600, 30, "YUY2")));
+  ASSERT_TRUE(FormatInfo(160, 120, 0, "YUY2").Matches(range));
+  ASSERT_FALSE(range.Matches(FormatInfo(80, 60, 30, "YUY2")));
+  ASSERT_FALSE(range.Matches(FormatInfo(3840, 2160, 30, "YUY2")));
+  ASSERT_FALSE(FormatInfo(640, 480).Matches(FormatInfo(800, 600)));
+  std::stringstream ss;
+  ss << range;
+  ASSERT_NE(ss.str().find("(160-1920, 120-1080)"), std::string::npos);
+
+  // Sizes in the range are asked for on a step
+  TestCamera camera("SizeCamera");
+  camera.AddFormat(range);
+  camera.AddFormat(FormatInfo(640, 480, 30, "YUY2"));
+  ASSERT_EQ(camera.GetCameraInfo().formats.size(), 2u);
+  camera.SetFormat(FormatInfo(810, 605, 30, "YUY2"), Camera::DecodeType::NONE);
+  auto mode = camera.GetFormat();
+  ASSERT_EQ(mode->width, 800);
+  ASSERT_EQ(mode->height, 600);
+  ASSERT_FALSE(mode->HasSizeRange());
+
+  // Without a size, the largest
+  camera.SetFormat(FormatInfo(0, 0, 30, "YUY2"), Camera::DecodeType::NONE);
+  ASSERT_EQ(camera.GetFormat()->width, 1920);
+  ASSERT_EQ(camera.GetFormat()->height, 1080);
+}
+
+TEST(CameraTests, SoftwareCrop)
+{
+  TestCamera camera("CropCamera");
+  camera.AddFormat(FormatInfo(64, 32, 30, "YUY2"));
+  camera.SetFormat(FormatInfo(64, 32, 30, "YUY2"), Camera::DecodeType::NONE);
+  ASSERT_EQ(camera.GetCropMode(), CropMode::NONE);
+
+  // The test camera can't crop on the device, so frames are cropped as they're published,
+  // on whole YUYV pixel pairs.
+  camera.SetCrop({11, 4, 20, 8});
+  ASSERT_EQ(camera.GetCropMode(), CropMode::SOFTWARE);
+  auto crop = camera.GetCrop();
+  ASSERT_EQ(crop.x, 10);
+  ASSERT_EQ(crop.y, 4);
+  ASSERT_EQ(crop.width, 20);
+  ASSERT_EQ(crop.height, 8);
+  ASSERT_EQ(camera.GetFormat()->width, 64);
+
+  CameraFrame frame(64, 32, PixelFormat::YUY2);
+  auto view = frame.view();
+  for (int y = 0; y < frame.height(); ++y)
+  {
+    for (size_t x = 0; x < view.row_bytes(); ++x)
+    {
+      view.row(y)[x] = static_cast<uint8_t>(y * 4 + x);
+    }
+  }
+  camera.Deliver(frame);
+  auto cropped = camera.GetLastFrame();
+  ASSERT_EQ(cropped->width(), 20);
+  ASSERT_EQ(cropped->height(), 8);
+  ASSERT_EQ(cropped->pixel_format(), PixelFormat::YUY2);
+  ASSERT_EQ(cropped->view().row(0)[0], frame.view().row(4)[20]);
+  ASSERT_EQ(cropped->view().row(7)[39], frame.view().row(11)[59]);
+
+  // Crops are clipped to the frame, and an empty one captures whole frames again.
+  camera.SetCrop({40, 0, 100, 100});
+  ASSERT_EQ(camera.GetCrop().width, 24);
+  ASSERT_EQ(camera.GetCrop().height, 32);
+  camera.SetCrop({});
+  ASSERT_EQ(camera.GetCropMode(), CropMode::NONE);
+  ASSERT_TRUE(camera.GetCrop().empty());
+  ASSERT_THROW(camera.SetCrop({-1, 0, 10, 10}), Error);
+}
+
+TEST(CameraTests, BufferQueue)
+{
+  TestCamera camera("QueueCamera");
+  ASSERT_EQ(camera.GetBufferCount(), Camera::kDefaultBufferCount);
+  ASSERT_THROW(camera.SetBufferCount(0), Error);
+  ASSERT_THROW(camera.SetBufferCount(Camera::kMaxBufferCount + 1), Error);
+  camera.SetBufferCount(3);
+  ASSERT_EQ(camera.GetBufferCount(), 3u);
+
+  // One buffer at a time while keeping up, then falling behind until all three are full.
+  for (int i = 0; i < 5; ++i)
+  {
+    camera.DequeueBuffers(1);
+  }
+  camera.DequeueBuffers(2);
+  camera.DequeueBuffers(3);
+  auto stats = camera.GetStats();
+  ASSERT_EQ(stats.buffers, 3u);
+  ASSERT_EQ(stats.queue_depth, (std::vector<uint64_t>{5, 1, 1}));
+
+  // More than we asked for (the driver may allocate extra) still shows up.
+  camera.DequeueBuffers(5);
+  stats = camera.GetStats();
+  ASSERT_EQ(stats.queue_depth, (std::vector<uint64_t>{5, 1, 1, 0, 1}));
+
+  std::stringstream ss;
+  ss << stats;
+  ASSERT_NE(ss.str().find("queue depth: 5 1 1 0 1"), std::string::npos);
+
+  camera.ResetStats();
+  ASSERT_EQ(camera.GetStats().queue_depth, (std::vector<uint64_t>{0, 0, 0}));
+
+  // User pointer buffers from the application set the count
+  std::vector<uint8_t> memory(1024 * 2);
+  std::vector<UserBuffer> user_buffers = {{memory.data(), 1024}, {memory.data() + 1024, 1024}};
+  ASSERT_EQ(camera.GetBufferMemory(), BufferMemory::MMAP);
+  ASSERT_THROW(camera.SetBufferMemory(BufferMemory::MMAP, user_buffers), Error);
+  ASSERT_THROW(camera.SetBufferMemory(BufferMemory::USERPTR, {{nullptr, 1024}}), Error);
+  camera.SetBufferMemory(BufferMemory::USERPTR, user_buffers);
+  ASSERT_EQ(camera.GetBufferMemory(), BufferMemory::USERPTR);
+  ASSERT_EQ(camera.GetBufferCount(), 2u);
+  ASSERT_EQ(camera.GetStats().buffers, 2u);
+  camera.SetBufferMemory(BufferMemory::USERPTR);
+  ASSERT_EQ(camera.GetBufferCount(), 3u);
+}
+
+TEST(CameraTests, FrameLoans)
+{
+  TestCamera camera("LoanCamera");
+  camera.SetMode(FormatInfo(16, 8, 30, "YUY2"));
+  camera.SetDecode(Camera::DecodeType::NONE);
+  camera.SetBufferCount(3);
+  ASSERT_THROW(camera.SetLoanCallback(nullptr, 0), Error);
+
+  std::vector<uint8_t> buffer(16 * 8 * 2, 7);
+  int returned = 0;
+  std::vector<FrameLoan> held;
+  camera.SetLoanCallback([&](const CameraInfo&, FrameLoan loan) { held.push_back(loan); }, 4);
+
+  // Lent buffers point at the driver's memory; one always stays with the driver.
+  ASSERT_TRUE(camera.Lend(buffer, [&] { ++returned; }));
+  ASSERT_TRUE(camera.Lend(buffer, [&] { ++returned; }));
+  ASSERT_FALSE(camera.Lend(buffer, [&] { ++returned; }));
+  ASSERT_EQ(held.size(), 2u);
+  ASSERT_EQ(held[0].data, buffer.data());
+  ASSERT_EQ(held[0].format, PixelFormat::YUY2);
+  ASSERT_EQ(held[0].view.width(), 16);
+  ASSERT_EQ(held[0].view.row(7)[0], 7);
+  ASSERT_EQ(returned, 1);
+
+  // Returned when the last copy of a loan lets go
+  auto copy = held[0];
+  held[0].Release();
+  ASSERT_EQ(returned, 1);
+  copy = FrameLoan();
+  ASSERT_EQ(returned, 2);
+  ASSERT_TRUE(camera.Lend(buffer, [&] { ++returned; }));
+
+  auto stats = camera.GetStats();
+  ASSERT_EQ(stats.lent, 3u);
+  ASSERT_EQ(stats.loans_refused, 1u);
+  ASSERT_EQ(stats.loans_out, 2u);
+  held.clear();
+  ASSERT_EQ(returned, 4);
+  ASSERT_EQ(camera.GetStats().loans_out, 0u);
+
+  // The limit follows what the driver allocated, not what was asked for
+  camera.SetAllocatedBuffers(2);
+  ASSERT_TRUE(camera.Lend(buffer, [&] { ++returned; }));
+  ASSERT_FALSE(camera.Lend(buffer, [&] { ++returned; }));
+  held.clear();
+  camera.SetAllocatedBuffers(0);
+
+  // A release that throws still gives the loan back
+  ASSERT_TRUE(camera.Lend(buffer, [] { throw std::runtime_error("requeue failed"); }));
+  held.clear();
+  ASSERT_EQ(camera.GetStats().loans_out, 0u);
+
+  // Only raw frames are lent
+  camera.SetDecode(Camera::DecodeType::INTERNAL);
+  ASSERT_FALSE(camera.Lend(buffer, [&] { ++returned; }));
+  ASSERT_TRUE(held.empty());
+}
+
+#if __linux__
+TEST(CameraTests, FrameSharing)
+{
+  // A memfd stands in for an exported dmabuf.
+  const std::string contents = "shared frame";
+  int memfd                  = memfd_create("zebral_share", MFD_CLOEXEC);
+  ASSERT_NE(memfd, -1);
+  ASSERT_EQ(write(memfd, contents.data(), contents.size()), ssize_t(contents.size()));
+
+  std::atomic<int> released = 0;
+  auto make_loan            = [&](uint64_t sequence, int fd) {
+    FrameLoan loan;
+    loan.size        = contents.size();
+    loan.timestamp   = TimeStampNow();
+    loan.hw_sequence = sequence;
+    loan.dmabuf_fd   = fd;
+    loan.lease       = std::make_shared<LoanLease>([&] { ++released; });
+    return loan;
+  };
+  auto wait_for = [](auto condition) {
+    for (int i = 0; (i < 500) && !condition(); ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return condition();
+  };
+
+  auto path = (std::filesystem::temp_directory_path() /
+               ("zebral_share_" + std::to_string(getpid()) + ".sock"))
+                  .string();
+  // Files that aren't sockets are never replaced
+  {
+    std::ofstream(path + ".file") << "keep";
+    ASSERT_THROW(FrameSharePublisher(path + ".file"), Error);
+    ASSERT_TRUE(std::filesystem::exists(path + ".file"));
+    std::filesystem::remove(path + ".file");
+  }
+
+  FrameSharePublisher publisher(path, 2);
+  ASSERT_THROW(FrameShareClient(path + ".none"), Error);
+
+  // Nobody to send to - released straight away
+  publisher.Publish(make_loan(1, memfd));
+  ASSERT_EQ(released, 1);
+
+  FrameShareClient client(path);
+  ASSERT_TRUE(wait_for([&] { return publisher.clients() == 1; }));
+  publisher.Publish(make_loan(2, memfd));
+  publisher.Publish(make_loan(3, memfd));
+  publisher.Publish(make_loan(4, memfd));  // client already holds 2
+  publisher.Publish(make_loan(5, -1));     // not exported
+  ASSERT_EQ(released, 3);
+  ASSERT_EQ(publisher.published(), 2u);
+  ASSERT_EQ(publisher.skipped(), 3u);
+
+  auto frame = client.Receive(std::chrono::milliseconds(1000));
+  ASSERT_TRUE(frame);
+  ASSERT_EQ(frame->info().hw_sequence, 2u);
+  ASSERT_EQ(frame->info().size, contents.size());
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(frame->Map()), contents.size()), contents);
+
+  // Releasing it in the client releases the loan in the publisher
+  frame.reset();
+  ASSERT_TRUE(wait_for([&] { return released == 4; }));
+
+  // As does dropping the other
+  {
+    auto held = client.Receive(std::chrono::milliseconds(1000));
+    ASSERT_EQ(held->info().hw_sequence, 3u);
+    ASSERT_FALSE(client.Receive(std::chrono::milliseconds(10)));
+  }
+  ASSERT_TRUE(wait_for([&] { return released == 5; }));
+
+  // A loan callback that outlives its publisher just releases frames
+  {
+    auto callback = [&] {
+      FrameSharePublisher temporary(path + ".tmp", 1);
+      return temporary.LoanCallback();
+    }();
+    ASSERT_FALSE(std::filesystem::exists(path + ".tmp"));
+    callback(CameraInfo("share", ""), make_loan(6, memfd));
+    ASSERT_EQ(released, 6);
+  }
+  close(memfd);
+}
+
+TEST(CameraTests, CaptureReactor)
+{
+  // Pipes stand in for devices - readable when a "frame" is written.
+  constexpr int kDevices = 8;
+  CaptureReactor reactor(2);
+  ASSERT_EQ(reactor.threads(), 2u);
+  std::array<std::array<int, 2>, kDevices> pipes;
+  std::array<std::atomic<int>, kDevices> frames{};
+  for (int i = 0; i < kDevices; ++i)
+  {
+    ASSERT_EQ(pipe2(pipes[i].data(), O_NONBLOCK | O_CLOEXEC), 0);
+    reactor.Add(pipes[i][0], [&, i] {
+      char frame;
+      while (read(pipes[i][0], &frame, 1) == 1)
+      {
+        ++frames[i];
+      }
+    });
+  }
+  ASSERT_EQ(reactor.size(), size_t(kDevices));
+
+  auto wait_for = [](auto condition) {
+    for (int i = 0; (i < 500) && !condition(); ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return condition();
+  };
+  for (int round = 0; round < 3; ++round)
+  {
+    for (int i = 0; i < kDevices; ++i)
+    {
+      ASSERT_EQ(write(pipes[i][1], "f", 1), 1);
+    }
+    ASSERT_TRUE(wait_for([&] {
+      return std::all_of(frames.begin(), frames.end(), [&](auto& n) { return n == round + 1; });
+    }));
+  }
+
+  // Removed while running - Remove() waits for the handler, which doesn't run again.
+  std::atomic<bool> in_handler = false;
+  int slow[2];
+  ASSERT_EQ(pipe2(slow, O_NONBLOCK | O_CLOEXEC), 0);
+  reactor.Add(slow[0], [&] {
+    in_handler = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    in_handler = false;
+  });
+  ASSERT_EQ(write(slow[1], "f", 1), 1);
+  ASSERT_TRUE(wait_for([&] { return in_handler.load(); }));
+  reactor.Remove(slow[0]);
+  ASSERT_FALSE(in_handler);
+
+  // Handlers can remove themselves (the pipe still has its unread frame)
+  reactor.Add(slow[0], [&] { reactor.Remove(slow[0]); });
+  ASSERT_TRUE(wait_for([&] { return reactor.size() == size_t(kDevices); }));
+  close(slow[0]);
+  close(slow[1]);
+
+  // Handlers that throw and fds that hang up fail, and aren't waited on again.
+  std::atomic<int> failed = 0;
+  std::atomic<int> calls  = 0;
+  int bad[2];
+  ASSERT_EQ(pipe2(bad, O_NONBLOCK | O_CLOEXEC), 0);
+  reactor.Add(
+      bad[0],
+      [&] {
+        ++calls;
+        throw std::runtime_error("device gone");
+      },
+      [&](const std::string&) { ++failed; });
+  ASSERT_EQ(write(bad[1], "f", 1), 1);
+  ASSERT_TRUE(wait_for([&] { return failed == 1; }));
+  ASSERT_EQ(write(bad[1], "f", 1), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_EQ(calls, 1);
+  reactor.Remove(bad[0]);
+
+  reactor.Add(bad[0], [&] { ++calls; }, [&](const std::string&) { ++failed; });
+  close(bad[1]);
+  ASSERT_TRUE(wait_for([&] { return failed == 2; }));
+  ASSERT_EQ(reactor.failures(), 2u);
+  reactor.Remove(bad[0]);
+  close(bad[0]);
+
+  for (auto& fds : pipes)
+  {
+    reactor.Remove(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+  }
+  ASSERT_EQ(reactor.size(), 0u);
+  ASSERT_GE(reactor.handled(), uint64_t(3 * kDevices));
+}
+#endif
+
+TEST(CameraTests, CameraGroups)
+{
+  std::vector<std::shared_ptr<TestCamera>> cameras;
+  std::vector<std::shared_ptr<Camera>> members;
+  for (int i = 0; i < 3; ++i)
+  {
+    cameras.push_back(std::make_shared<TestCamera>("GroupCamera" + std::to_string(i)));
+    members.push_back(cameras.back());
+  }
+
+  std::mutex mutex;
+  std::vector<FrameSet> sets;
+  GroupOptions options;
+  options.tolerance = std::chrono::milliseconds(2);
+  options.window    = 8;
+  auto group        = std::make_unique<CameraGroup>(
+      members,
+      [&](const FrameSet& set) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sets.push_back(set);
+      },
+      options);
+  ASSERT_EQ(group->size(), 3u);
+
+  // Triggered at 30fps with up to 1.5ms of skew; camera 2 misses trigger 3.
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+  TimeStamp base = TimeStampNow();
+  for (int trigger = 0; trigger < 10; ++trigger)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      if ((i == 2) && (trigger == 3)) continue;
+      frame.set_timestamp(base + std::chrono::milliseconds(33 * trigger) +
+                          std::chrono::microseconds(500 * i));
+      cameras[i]->Deliver(frame);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  // Subscribers deliver on their own threads
+  for (int wait = 0; wait < 100; ++wait)
+  {
+    if (group->GetStats().sets + group->GetStats().dropped / 2 >= 10) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  auto stats = group->GetStats();
+  ASSERT_EQ(stats.sets, 9u);
+  ASSERT_EQ(stats.dropped, 2u);
+  ASSERT_EQ(stats.overrun, 0u);
+  ASSERT_EQ(stats.camera_dropped, (std::vector<uint64_t>{1, 1, 0}));
+  ASSERT_EQ(stats.skew.count, 9u);
+  ASSERT_EQ(stats.skew.max, std::chrono::milliseconds(1));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ASSERT_EQ(sets.size(), 9u);
+  for (size_t i = 0; i < sets.size(); ++i)
+  {
+    int trigger = static_cast<int>(i < 3 ? i : i + 1);
+    ASSERT_EQ(sets[i].sequence, i);
+    ASSERT_EQ(sets[i].frames.size(), 3u);
+    ASSERT_EQ(sets[i].timestamp, base + std::chrono::milliseconds(33 * trigger));
+    ASSERT_EQ(sets[i].frames[2].get_timestamp() - sets[i].frames[0].get_timestamp(),
+              std::chrono::milliseconds(1));
+  }
+
+  // Unsubscribes on destruction
+  group.reset();
+  ASSERT_TRUE(cameras[0]->GetStats().subscribers.empty());
+  ASSERT_THROW(CameraGroup({members[0]}, [](const FrameSet&) {}), Error);
+}
+
+TEST(CameraTests, CompositeCameras)
+{
+  // Depth and IR nodes on one USB device, and an unrelated webcam
+  std::vector<CameraInfo> infos = {
+      CameraInfo(0, "Depth Camera", "1-2", "/dev/video0", "uvcvideo", 0x8086, 0x0b07),
+      CameraInfo(1, "Webcam", "1-3", "/dev/video2", "uvcvideo", 0x046d, 0x0825),
+      CameraInfo(2, "Depth Camera", "1-2", "/dev/video4", "uvcvideo", 0x8086, 0x0b07)};
+  auto composites = CameraManager::GroupComposites(infos);
+  ASSERT_EQ(composites.size(), 1u);
+  ASSERT_EQ(composites[0].bus, "1-2");
+  ASSERT_EQ(composites[0].nodes.size(), 2u);
+  ASSERT_EQ(composites[0].nodes[1].path, "/dev/video4");
+
+  auto depth = std::make_shared<TestCamera>("Depth");
+  auto ir    = std::make_shared<TestCamera>("IR");
+  CompositeCamera composite(composites[0], {depth, ir});
+
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, uint64_t>> pairs;
+  composite.Start([&](const FrameSet& set) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pairs.emplace_back(set.frames[0].get_hw_sequence(), set.frames[1].get_hw_sequence());
+  });
+  ASSERT_TRUE(composite.IsRunning());
+
+  // The IR stream's counter started 3 frames later, and the driver drops IR frame 4.
+  // Timestamps are too jittery to pair by, once the offset is known.
+  CameraFrame frame(16, 16, PixelFormat::GREY);
+  TimeStamp base = TimeStampNow();
+  for (uint64_t i = 0; i < 8; ++i)
+  {
+    auto stamp = base + std::chrono::milliseconds(33 * i);
+    frame.set_hw_sequence(i + 10);
+    frame.set_timestamp(stamp);
+    depth->Deliver(frame);
+    if (i != 4)
+    {
+      frame.set_hw_sequence(i + 13);
+      frame.set_timestamp(stamp + std::chrono::milliseconds((i % 2) ? 20 : 1));
+      ir->Deliver(frame);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  for (int wait = 0; wait < 100; ++wait)
+  {
+    if (composite.GetStats()->sets >= 7) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  auto stats = composite.GetStats();
+  composite.Stop();
+  ASSERT_FALSE(composite.IsRunning());
+  ASSERT_FALSE(composite.GetStats());
+
+  ASSERT_EQ(stats->sets, 7u);
+  ASSERT_EQ(stats->camera_dropped, (std::vector<uint64_t>{1, 0}));
+  std::lock_guard<std::mutex> lock(mutex);
+  ASSERT_EQ(pairs.size(), 7u);
+  for (const auto& pair : pairs)
+  {
+    ASSERT_NE(pair.first, 14u);
+    ASSERT_EQ(pair.second, pair.first + 3);
+  }
+}
+
 TEST(CameraTests, CameraSanity)
 {
   CameraManager cmgr;
@@ -345,6 +1725,100 @@ TEST(CameraTests, Params)
   ASSERT_TRUE(watch.deviceChanges == 2);
 }
 
+TEST(CameraTests, Coroutines)
+{
+  EventLoop loop;
+  CameraFrame frame(16, 16, PixelFormat::BGR);
+
+  // One loop thread waits on a bunch of cameras at once.
+  constexpr int kNumCameras = 24;
+  std::vector<std::unique_ptr<TestCamera>> cameras;
+  for (int i = 0; i < kNumCameras; ++i)
+  {
+    cameras.emplace_back(std::make_unique<TestCamera>("AsyncCamera" + std::to_string(i)));
+  }
+
+  std::atomic<int> received = 0;
+  auto consume              = [&](TestCamera& camera) -> Task<void> {
+    for (int i = 0; i < 3; ++i)
+    {
+      auto handle = co_await camera.NextFrame(loop);
+      if (handle) ++received;
+    }
+  };
+  for (auto& camera : cameras)
+  {
+    loop.Spawn(consume(*camera));
+  }
+
+  std::thread producer([&] {
+    for (int i = 0; i < 3; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      for (auto& camera : cameras) camera->Deliver(frame);
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  loop.RunUntilComplete();
+  producer.join();
+  ASSERT_EQ(received, kNumCameras * 3);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  // Timeouts, cancellation and parameter changes
+  ParamRanged<int, double> volume("Volume", {}, 25, 50, 0, 100, 1, false, false, IntToUnit,
+                                  UnitToInt);
+  auto param = std::shared_ptr<Param>(&volume, [](Param*) {});
+  std::stop_source cancel;
+  bool timed_out = false;
+  bool cancelled = false;
+  bool changed   = false;
+  auto waits     = [&]() -> Task<int> {
+    timed_out = !co_await cameras[0]->NextFrame(loop, std::chrono::milliseconds(10));
+    cancelled = !co_await cameras[0]->NextFrame(loop, std::chrono::milliseconds(0),
+                                                cancel.get_token());
+    changed   = co_await NextParamChange(loop, param);
+    co_return 3;
+  };
+  auto run = [&]() -> Task<void> {
+    int result = co_await waits();
+    EXPECT_EQ(result, 3);
+  };
+  loop.Spawn(run());
+  std::thread controller([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    cancel.request_stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    volume.set(75);
+  });
+  loop.RunUntilComplete();
+  controller.join();
+  ASSERT_TRUE(timed_out);
+  ASSERT_TRUE(cancelled);
+  ASSERT_TRUE(changed);
+
+  // Destroying a loop destroys coroutines still waiting on it, and unregisters their ops
+  bool unregistered = false;
+  auto held         = std::make_shared<int>(0);
+  {
+    EventLoop pending;
+    auto wait_forever = [&](std::shared_ptr<int> ref) -> Task<void> {
+      co_await AsyncOp<bool>(
+          pending,
+          [&](const std::shared_ptr<AsyncState<bool>>& state) {
+            state->SetCleanup([&] { unregistered = true; });
+          },
+          std::chrono::seconds(10));
+      EXPECT_FALSE(ref);
+    };
+    pending.Spawn(wait_forever(held));
+    pending.Post([&] { pending.Stop(); });
+    pending.Run();
+    ASSERT_EQ(held.use_count(), 2);
+  }
+  ASSERT_TRUE(unregistered);
+  ASSERT_EQ(held.use_count(), 1);
+}
+
 TEST(CameraTests, FindFiles)
 {
   ZBA_LOG("Current Dir: {}", std::filesystem::current_path().string().c_str());
@@ -1,4 +1,5 @@
 #include <camera/inc/buffer_memmap.hpp>
+#include <camera/inc/buffer_types.hpp>
 #include <camera/inc/camera.hpp>
 // Don't need this one, and adds opencv dep
 //#include <camera/inc/camera2cv.hpp>
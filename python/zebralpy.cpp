@@ -34,7 +34,12 @@ PYBIND11_MODULE(zebralpy, m)
       .def(py::init<int, int, float, const std::string &>())
       .def_readwrite("width", &FormatInfo::width)
       .def_readwrite("height", &FormatInfo::height)
+      .def_readwrite("min_width", &FormatInfo::min_width)
+      .def_readwrite("min_height", &FormatInfo::min_height)
+      .def_readwrite("step_width", &FormatInfo::step_width)
+      .def_readwrite("step_height", &FormatInfo::step_height)
       .def_readwrite("fps", &FormatInfo::fps)
+      .def_readwrite("min_fps", &FormatInfo::min_fps)
       .def_readwrite("channels", &FormatInfo::channels)
       .def_readwrite("bytespppc", &FormatInfo::bytespppc)
       .def_readwrite("format", &FormatInfo::format)
@@ -65,7 +70,10 @@ PYBIND11_MODULE(zebralpy, m)
       .def(py::init<>())
       .def(py::init<int, int, int, int, bool, bool, TimeStamp, const uint8_t *>())
       .def("clear", &CameraFrame::clear)
-      .def("reset", &CameraFrame::reset)
+      .def("reset", py::overload_cast<int, int, int, int, bool, bool, TimeStamp, const uint8_t *>(
+                        &CameraFrame::reset))
+      .def("plane_count", &CameraFrame::plane_count)
+      .def("is_planar", &CameraFrame::is_planar)
       .def("empty", &CameraFrame::empty)
       .def("width", &CameraFrame::width)
       .def("height", &CameraFrame::height)
@@ -116,5 +124,6 @@ PYBIND11_MODULE(zebralpy, m)
       .value("INTERNAL", Camera::DecodeType::INTERNAL)
       .value("SYSTEM", Camera::DecodeType::SYSTEM)
       .value("NONE", Camera::DecodeType::NONE)
+      .value("DEFERRED", Camera::DecodeType::DEFERRED)
       .export_values();
 }
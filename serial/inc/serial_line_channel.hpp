@@ -3,13 +3,17 @@
 #ifndef LIGHTBOX_SERIAL_SERIAL_LINE_CHANNEL_HPP_
 #define LIGHTBOX_SERIAL_SERIAL_LINE_CHANNEL_HPP_
 
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "async.hpp"
 #include "serial_info.hpp"
 
 namespace zebral
@@ -36,12 +40,25 @@ class SerialLineChannel
   /// Writes a string (with CR added!) to the port
   void Write(const std::string& outLine);
 
+  /// Awaitable for the next line, for coroutines running on an EventLoop.
+  /// While a coroutine is waiting, lines go to it instead of the ReadCallback.
+  /// \param loop - loop the awaiting coroutine runs on
+  /// \param timeout - how long to wait, 0 for no timeout
+  /// \param stop - cancels the wait
+  /// \returns AsyncOp<std::optional<std::string>> - co_await for the line, empty on
+  ///          timeout or cancellation.
+  AsyncOp<std::optional<std::string>> ReadLineAsync(
+      EventLoop& loop,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(5000),
+      std::stop_token stop = {});
+
  protected:
   /// Called when we receive a chunk of data.
   /// Manages buffer and calls OnReceivedLine for each line.
   void OnReceivedData(const uint8_t* data, size_t length);
 
-  /// Called for each line of data we received. Calls callback_ if non-null.
+  /// Called for each line of data we received.
+  /// Completes the oldest ReadLineAsync(), or calls callback_ if none and non-null.
   void OnReceivedLine(const std::string& incoming);
 
   /// Internal callback used if we aren't given one, just dumps the data to stdout
@@ -53,6 +70,11 @@ class SerialLineChannel
   std::string read_buffer_;  ///< Accumulates strings until line ends
   unsigned int baud_;        ///< User-specified speed of port (115200 default)
 
+  std::mutex line_waiter_mutex_;  ///< Protects line_waiters_
+
+  /// Coroutines waiting in ReadLineAsync(), oldest first
+  std::deque<std::shared_ptr<AsyncState<std::optional<std::string>>>> line_waiters_;
+
   /// The implementation sits in the Impl object
   /// to avoid throwing all sorts of stuff into the header.
   class Impl;
@@ -46,9 +46,32 @@ void SerialLineChannel::OnReceivedData(const uint8_t* data, size_t length)
   }
 }
 
-/// Called for each line of data we received. Calls callback_ if non-null.
+AsyncOp<std::optional<std::string>> SerialLineChannel::ReadLineAsync(
+    EventLoop& loop, std::chrono::milliseconds timeout, std::stop_token stop)
+{
+  auto start = [this](const std::shared_ptr<AsyncState<std::optional<std::string>>>& state) {
+    std::lock_guard<std::mutex> lock(line_waiter_mutex_);
+    std::erase_if(line_waiters_, [](const auto& waiter) { return waiter->done(); });
+    line_waiters_.push_back(state);
+  };
+  return AsyncOp<std::optional<std::string>>(loop, start, timeout, std::move(stop));
+}
+
+/// Called for each line of data we received.
+/// Completes the oldest ReadLineAsync(), or calls callback_ if none and non-null.
 void SerialLineChannel::OnReceivedLine(const std::string& incoming)
 {
+  {
+    std::lock_guard<std::mutex> lock(line_waiter_mutex_);
+    while (!line_waiters_.empty())
+    {
+      // Skip waits that timed out or were cancelled
+      auto waiter = std::move(line_waiters_.front());
+      line_waiters_.pop_front();
+      if (waiter->Complete(incoming)) return;
+    }
+  }
+
   if (callback_)
   {
     callback_(incoming);